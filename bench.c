@@ -0,0 +1,342 @@
+// microbenchmarks of the phases of hsolver, built by "make bench".
+// includes the library itself to reach the internal phases without exporting them
+#include "libhsolver.c"
+
+#include <time.h>
+
+#define HS_BENCH_MIN_TIME_NS 50000000.0
+#define HS_BENCH_REPEATS 5
+#define HS_BENCH_DEFAULT_THRESHOLD 10.0
+#define HS_BENCH_MAX_RESULTS 64
+#define HS_BENCH_LINE_SIZE 4096
+
+typedef enum hs_bench_phase {
+    HS_BENCH_TOKENIZE,
+    HS_BENCH_SHUNTING_YARD,
+    HS_BENCH_SOLVE,
+    HS_BENCH_VM,
+    HS_BENCH_OUTPUT,
+    HS_BENCH_RUN,
+    HS_BENCH_RUN_CACHED,
+    HS_BENCH_PHASES,
+} hs_bench_phase_t;
+
+const char *hs_bench_phase_names[] = {
+    [HS_BENCH_TOKENIZE] = "hs_tokenize",
+    [HS_BENCH_SHUNTING_YARD] = "hs_shunting_yard",
+    [HS_BENCH_SOLVE] = "hs_solve",
+    [HS_BENCH_VM] = "hs_program_run",
+    [HS_BENCH_OUTPUT] = "hs_output",
+    [HS_BENCH_RUN] = "hs_run",
+    [HS_BENCH_RUN_CACHED] = "hs_run_cached",
+};
+
+typedef struct hs_bench_case {
+    const char *name;
+    // lines run once on a fresh state before measuring
+    void (*setup)(hs_state_t *state);
+    const char *line;
+} hs_bench_case_t;
+
+typedef struct hs_bench_result {
+    char name[64];
+    double ns;
+    double allocations;
+} hs_bench_result_t;
+
+void hs_bench_setup_params(hs_state_t *state) {
+    hs_run(state, "f(a, b, c, d, e, g, h, k) = a + b * c - d / e + g ^ 2 - h * k");
+}
+
+void hs_bench_setup_context(hs_state_t *state) {
+    char line[128];
+    for (size_t i = 0; i < 10000; i++) {
+        snprintf(line, sizeof(line), "v" SIZE_T_F " = " SIZE_T_F ".5", i, i);
+        hs_run(state, line);
+    }
+    for (size_t i = 0; i < 200; i++) {
+        snprintf(line, sizeof(line), "fn" SIZE_T_F "(a, b) = a * v" SIZE_T_F " + b", i, i * 7);
+        hs_run(state, line);
+    }
+}
+
+char hs_bench_nested[HS_BENCH_LINE_SIZE];
+
+const hs_bench_case_t hs_bench_cases[] = {
+    {.name = "short", .setup = NULL, .line = "1 + 2 * 3 - 4 / 5"},
+    {.name = "radix", .setup = NULL, .line = "0xffff'ffff'ffff'ffff + 0b1010'1010'1010'1010'1010'1010'1010'1010'1010 - 0o7777'7777'7777 + 3.14159265358979 * 2.718281828459045"},
+    {.name = "nested", .setup = NULL, .line = hs_bench_nested},
+    {.name = "params", .setup = hs_bench_setup_params, .line = "f(1, 2, 3, 4, 5, 6, 7, 8) + f(8, 7, 6, 5, 4, 3, 2, 1)"},
+    {.name = "context", .setup = hs_bench_setup_context, .line = "v1234 + v9876 * fn150(2, v42) - fn3(v7, 1)"},
+};
+
+double hs_bench_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+// where the arena stood, everything allocated after it can be dropped
+typedef struct hs_bench_mark {
+    hs_arena_block_t *block;
+    size_t used;
+} hs_bench_mark_t;
+
+hs_bench_mark_t hs_bench_mark(hs_state_t *state) {
+    hs_arena_block_t *block = state->arena.blocks;
+    return (hs_bench_mark_t){.block = block, .used = block != NULL ? block->used : 0};
+}
+
+void hs_bench_reset_to(hs_state_t *state, hs_bench_mark_t mark) {
+    while (state->arena.blocks != mark.block) {
+        hs_arena_block_t *next = state->arena.blocks->next;
+        free(state->arena.blocks);
+        state->arena.blocks = next;
+    }
+    if (mark.block != NULL)
+        mark.block->used = mark.used;
+}
+
+// everything a phase needs, prepared once per case
+typedef struct hs_bench_input {
+    hs_state_t *state;
+    char *text;
+    size_t length;
+    // tokens for hs_shunting_yard in the arena below mark, it marks variables in them so they are restored from original
+    hs_token_list_t tokens;
+    hs_token_t *original;
+    hs_bench_mark_t mark;
+    hs_token_list_t rpn;
+    hs_program_t program;
+    hs_value_t value;
+} hs_bench_input_t;
+
+void hs_bench_iterate(hs_bench_input_t *input, hs_bench_phase_t phase, size_t iterations) {
+    hs_state_t *state = input->state;
+    for (size_t i = 0; i < iterations; i++) {
+        switch (phase) {
+            case HS_BENCH_TOKENIZE:
+                hs_tokenize(input->text, input->length, state);
+                hs_bench_reset_to(state, input->mark);
+                break;
+            case HS_BENCH_SHUNTING_YARD:
+                memcpy(input->tokens.items, input->original, input->tokens.size * sizeof(hs_token_t));
+                hs_shunting_yard(&input->tokens, state);
+                hs_bench_reset_to(state, input->mark);
+                break;
+            case HS_BENCH_SOLVE:
+                input->value = hs_solve(&input->rpn, state, -1);
+                break;
+            case HS_BENCH_VM:
+                input->value = hs_program_run(&input->program, state, -1);
+                break;
+            case HS_BENCH_OUTPUT:
+                hs_output(input->value, state);
+                state->out.size = 0;
+                break;
+            case HS_BENCH_RUN:
+                // a new line version makes the line cache miss, so the line is run in full every time
+                state->line_version++;
+                hs_run(state, input->text);
+                state->out.size = 0;
+                break;
+            case HS_BENCH_RUN_CACHED:
+                // the same line again, served from the line cache after the first time
+                hs_run(state, input->text);
+                state->out.size = 0;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// best time per iteration out of a few rounds, each long enough to be measured
+double hs_bench_measure(hs_bench_input_t *input, hs_bench_phase_t phase, double *allocations) {
+    size_t iterations = 1;
+    double elapsed = 0;
+    while (true) {
+        double start = hs_bench_now();
+        hs_bench_iterate(input, phase, iterations);
+        elapsed = hs_bench_now() - start;
+        if (elapsed >= HS_BENCH_MIN_TIME_NS / HS_BENCH_REPEATS)
+            break;
+        iterations *= elapsed > 0 && HS_BENCH_MIN_TIME_NS / elapsed < 10 ? 2 : 10;
+    }
+    double best = elapsed / iterations;
+    size_t allocations_before = input->state->allocations;
+    for (size_t r = 1; r < HS_BENCH_REPEATS; r++) {
+        double start = hs_bench_now();
+        hs_bench_iterate(input, phase, iterations);
+        double ns = (hs_bench_now() - start) / iterations;
+        if (ns < best)
+            best = ns;
+    }
+    *allocations = (double)(input->state->allocations - allocations_before) / (iterations * (HS_BENCH_REPEATS - 1));
+    return best;
+}
+
+// the tokens of the line as hs_execute hands them to hs_shunting_yard
+bool hs_bench_tokens(hs_bench_input_t *input, hs_token_list_t *tokens2) {
+    hs_state_t *state = input->state;
+    hs_token_list_t tokens = hs_tokenize(input->text, input->length, state);
+    if (tokens.items == NULL)
+        return false;
+    *tokens2 = hs_token_list_init(state, &tokens);
+    return tokens2->items != NULL && hs_handle_commands(&tokens, tokens2, NULL, state) == 0;
+}
+
+// prepares the tokens, rpn, program and value of the line like hs_execute does
+bool hs_bench_prepare(hs_bench_input_t *input) {
+    hs_state_t *state = input->state;
+    hs_token_list_t tokens2;
+    if (!hs_bench_tokens(input, &tokens2))
+        return false;
+    hs_token_list_t rpn = hs_shunting_yard(&tokens2, state);
+    if (rpn.items == NULL)
+        return false;
+    rpn = hs_optimize(&rpn, state);
+    if (rpn.items == NULL)
+        return false;
+    // moved to the heap, the arena is reset while measuring
+    if (!hs_body_store(state, &rpn, &input->rpn, &input->program) || input->program.code == NULL)
+        return false;
+    input->value = hs_solve(&input->rpn, state, -1);
+    hs_arena_reset(state);
+    // the arena is one block now, large enough for all of the line, so the phases below never add another
+    if (!hs_bench_tokens(input, &input->tokens))
+        return false;
+    input->original = malloc(input->tokens.size * sizeof(hs_token_t));
+    if (input->original == NULL)
+        return false;
+    memcpy(input->original, input->tokens.items, input->tokens.size * sizeof(hs_token_t));
+    input->mark = hs_bench_mark(state);
+    return true;
+}
+
+double hs_bench_baseline(hs_bench_result_t *baseline, size_t baseline_count, const char *name) {
+    for (size_t i = 0; i < baseline_count; i++) {
+        if (strcmp(baseline[i].name, name) == 0)
+            return baseline[i].ns;
+    }
+    return -1;
+}
+
+int main(int argc, char *argv[]) {
+    const char *save_path = NULL;
+    const char *compare_path = NULL;
+    double threshold = HS_BENCH_DEFAULT_THRESHOLD;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+            compare_path = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = strtod(argv[++i], NULL);
+        } else {
+            printf("usage: hsbench [--save file] [--compare file] [--threshold percent]" ENDL);
+            return 1;
+        }
+    }
+
+    hs_bench_result_t baseline[HS_BENCH_MAX_RESULTS];
+    size_t baseline_count = 0;
+    if (compare_path != NULL) {
+        FILE *file = fopen(compare_path, "r");
+        if (file == NULL) {
+            printf("ERROR: could not open %s" ENDL, compare_path);
+            return 1;
+        }
+        while (baseline_count < HS_BENCH_MAX_RESULTS
+               && fscanf(file, "%63s %lf %lf", baseline[baseline_count].name, &baseline[baseline_count].ns, &baseline[baseline_count].allocations) == 3)
+            baseline_count++;
+        fclose(file);
+    }
+
+    // 64 levels of parentheses around a sum
+    size_t nested_length = 0;
+    for (size_t i = 0; i < 64; i++)
+        nested_length += snprintf(hs_bench_nested + nested_length, HS_BENCH_LINE_SIZE - nested_length, "(" SIZE_T_F " + ", i);
+    nested_length += snprintf(hs_bench_nested + nested_length, HS_BENCH_LINE_SIZE - nested_length, "1");
+    for (size_t i = 0; i < 64; i++)
+        nested_length += snprintf(hs_bench_nested + nested_length, HS_BENCH_LINE_SIZE - nested_length, ") * 2");
+
+    hs_bench_result_t results[HS_BENCH_MAX_RESULTS];
+    size_t results_count = 0;
+    size_t regressions = 0;
+    printf("%-26s %12s %10s %12s %10s", "benchmark", "ns/op", "allocs/op", "op/s", "MB/s");
+    if (baseline_count > 0)
+        printf(" %12s %8s", "baseline", "change");
+    printf(ENDL);
+
+    for (size_t c = 0; c < sizeof(hs_bench_cases) / sizeof(hs_bench_case_t); c++) {
+        const hs_bench_case_t *bench_case = &hs_bench_cases[c];
+        hs_state_t *state = hs_state_create();
+        if (state == NULL) {
+            printf("ERROR: out of memory during initialization :(" ENDL);
+            return 1;
+        }
+        if (bench_case->setup != NULL)
+            bench_case->setup(state);
+        // hs_output and hs_run print into a buffer that is dropped after every iteration
+        state->out.kind = HS_SINK_BUFFER;
+
+        size_t length = strlen(bench_case->line);
+        hs_bench_input_t input = {.state = state, .length = length};
+        input.text = malloc(length + 1);
+        if (input.text == NULL) {
+            printf("ERROR: out of memory during initialization :(" ENDL);
+            return 1;
+        }
+        memcpy(input.text, bench_case->line, length + 1);
+        hs_preprocess_input(input.text);
+        if (!hs_bench_prepare(&input)) {
+            printf("ERROR: could not prepare %s" ENDL, bench_case->name);
+            if (state->out.data != NULL)
+                fwrite(state->out.data, 1, state->out.size, stdout);
+            return 1;
+        }
+        state->out.size = 0;
+
+        for (hs_bench_phase_t phase = 0; phase < HS_BENCH_PHASES; phase++) {
+            double allocations;
+            double ns = hs_bench_measure(&input, phase, &allocations);
+
+            hs_bench_result_t *result = &results[results_count++];
+            snprintf(result->name, sizeof(result->name), "%s/%s", bench_case->name, hs_bench_phase_names[phase]);
+            result->ns = ns;
+            result->allocations = allocations;
+            printf("%-26s %12.1f %10.2f %12.0f %10.1f", result->name, ns, allocations, ns > 0 ? 1e9 / ns : 0, ns > 0 ? length * 1e3 / ns : 0);
+            double before = hs_bench_baseline(baseline, baseline_count, result->name);
+            if (before > 0) {
+                double change = (ns - before) / before * 100;
+                bool regressed = change > threshold;
+                printf(" %12.1f %+7.1f%%%s", before, change, regressed ? " REGRESSION" : "");
+                if (regressed)
+                    regressions++;
+            }
+            printf(ENDL);
+        }
+
+        hs_body_free(&input.rpn, &input.program);
+        free(input.original);
+        free(input.text);
+        hs_state_destroy(state);
+    }
+
+    if (save_path != NULL) {
+        FILE *file = fopen(save_path, "w");
+        if (file == NULL) {
+            printf("ERROR: could not open %s for writing" ENDL, save_path);
+            return 1;
+        }
+        for (size_t i = 0; i < results_count; i++)
+            fprintf(file, "%s %.3f %.3f\n", results[i].name, results[i].ns, results[i].allocations);
+        fclose(file);
+    }
+    if (regressions > 0) {
+        printf(SIZE_T_F " benchmarks are more than %.1f%% slower than the baseline" ENDL, regressions, threshold);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,152 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// tiny client for "hsolver --serve": sends the expression given as arguments (or every line of stdin)
+// and prints the answers, which the server terminates by '\0'
+
+#define HS_SERVER_DEFAULT_PATH "/tmp/hsolver.sock"
+#define HS_CLIENT_BUFFER_SIZE 65536
+
+// writes everything or fails, the socket is blocking
+bool hs_send_all(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+// prints what arrived without the terminating '\0's, false once the server closed the connection
+bool hs_receive(int fd, char *buffer) {
+    ssize_t received;
+    do {
+        received = recv(fd, buffer, HS_CLIENT_BUFFER_SIZE, 0);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0)
+        return false;
+    size_t start = 0;
+    for (size_t i = 0; i < (size_t)received; i++) {
+        if (buffer[i] == '\0') {
+            fwrite(buffer + start, 1, i - start, stdout);
+            start = i + 1;
+        }
+    }
+    fwrite(buffer + start, 1, received - start, stdout);
+    fflush(stdout);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    char *path = HS_SERVER_DEFAULT_PATH;
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "--socket") == 0) {
+        path = argv[2];
+        first = 3;
+    }
+
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        printf("ERROR: socket path %s is too long\n", path);
+        return 1;
+    }
+    strcpy(address.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        printf("ERROR: could not connect to %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    char *buffer = malloc(HS_CLIENT_BUFFER_SIZE);
+    if (buffer == NULL) {
+        printf("ERROR: out of memory :(\n");
+        close(fd);
+        return 1;
+    }
+
+    int result = 1;
+    if (argc > first) {
+        // the arguments are one line, like "hsolver expr"
+        for (int i = first; i < argc; i++) {
+            if (!hs_send_all(fd, argv[i], strlen(argv[i])))
+                goto hs_client_error;
+        }
+        if (!hs_send_all(fd, "\n", 1))
+            goto hs_client_error;
+        shutdown(fd, SHUT_WR);
+    } else {
+        // forward stdin while reading answers, so many lines can be in flight.
+        // the server stops reading while answers pile up, so never block on sending
+        char *input = malloc(HS_CLIENT_BUFFER_SIZE);
+        size_t input_size = 0;
+        size_t input_sent = 0;
+        bool input_eof = false;
+        if (input == NULL)
+            goto hs_client_error;
+        while (!input_eof || input_sent < input_size) {
+            struct pollfd fds[2] = {{.fd = fd, .events = POLLIN}, {.fd = STDIN_FILENO}};
+            if (input_sent < input_size)
+                fds[0].events |= POLLOUT;
+            else
+                fds[1].events = POLLIN;
+            if (poll(fds, input_eof ? 1 : 2, -1) < 0) {
+                if (errno == EINTR)
+                    continue;
+                free(input);
+                goto hs_client_error;
+            }
+            if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+                if (!hs_receive(fd, buffer)) {
+                    free(input);
+                    goto hs_client_done;
+                }
+            }
+            if (fds[0].revents & POLLOUT) {
+                ssize_t sent = send(fd, input + input_sent, input_size - input_sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    free(input);
+                    goto hs_client_error;
+                }
+                if (sent > 0)
+                    input_sent += sent;
+            }
+            if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+                ssize_t read_size = read(STDIN_FILENO, input, HS_CLIENT_BUFFER_SIZE);
+                if (read_size < 0 && errno == EINTR)
+                    continue;
+                if (read_size <= 0) {
+                    input_eof = true;
+                } else {
+                    input_size = read_size;
+                    input_sent = 0;
+                }
+            }
+        }
+        free(input);
+        shutdown(fd, SHUT_WR);
+    }
+    // the server closes the connection after the last answer
+    while (hs_receive(fd, buffer))
+        ;
+
+hs_client_done:
+    result = 0;
+hs_client_error:
+    if (result != 0)
+        printf("ERROR: connection to %s failed: %s\n", path, strerror(errno));
+    free(buffer);
+    close(fd);
+    return result;
+}
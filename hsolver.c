@@ -1,26 +1,47 @@
+#ifdef UNIX
+#define _POSIX_C_SOURCE 200809L
+#endif
 #include <stdio.h>
-#include <stdint.h>
+#include <stdlib.h>
 #include <stdbool.h>
-#include <malloc.h>
-#include <math.h>
+#include <string.h>
+#include <time.h>
 
-// TODO:
-//  - commands for char settings (sep_char_in/_out, dec_sep_char_in/_out)
-//  - console colors/bold (especially "list")
+#include "hsolver.h"
 
-#define HS_MAX_FRAC_DIGITS 13
-#define HS_BUF_SIZE 64
-#define HS_EPSILON 1e-20
-#define HS_MAX_EXP_LIST_LEN 30
 #define HS_FORCE_INTERACTIVE 0
+#define HS_BATCH_BLOCK_SIZE (1 << 20)
+#define HS_BATCH_CHUNK_LINES 1024
+// large enough for any value hs_format produces
+#define HS_CLI_FORMAT_SIZE 2048
+#define HS_SERVER_DEFAULT_PATH "/tmp/hsolver.sock"
+#define HS_SERVER_BUFFER_SIZE 4096
+#define HS_SERVER_MAX_LINE (1 << 20)
+// answers waiting for a client before its next lines are run
+#define HS_SERVER_MAX_PENDING (1 << 20)
+#define HS_SERVER_EVENTS 64
 
 #ifdef WIN
+#include <io.h>
 #define ENDL "\r\n"
 #define SIZE_T_F "%i"
+#define HS_IS_TERMINAL(file) _isatty(_fileno(file))
 #endif
 #ifdef UNIX
+#include <unistd.h>
+#include <pthread.h>
+#define HS_THREADS 1
 #define ENDL "\n"
 #define SIZE_T_F "%lu"
+#define HS_IS_TERMINAL(file) isatty(fileno(file))
+#endif
+#if defined(UNIX) && defined(__linux__)
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#define HS_SERVER 1
 #endif
 
 #ifndef ENDL
@@ -30,1592 +51,697 @@
 #ifndef SIZE_T_F
 #define SIZE_T_F "%lu"
 #endif
+#ifndef HS_IS_TERMINAL
+#define HS_IS_TERMINAL(file) 1
+#endif
+#ifndef HS_THREADS
+#define HS_THREADS 0
+#endif
+#ifndef HS_SERVER
+#define HS_SERVER 0
+#endif
 
-#define HS_ZERO ((hs_value_t){.re = 0, .im = 0})
-#define HS_ONE ((hs_value_t){.re = 1, .im = 0})
-
-const char *help_text = \
-"--COMMANDS--" ENDL \
-"  help" ENDL \
-"  list" ENDL \
-"  settings" ENDL \
-"  bin [optional inline expression]" ENDL \
-"  oct [optional inline expression]" ENDL \
-"  dec [optional inline expression]" ENDL \
-"  hex [optional inline expression]" ENDL \
-"  scient_min = expression" ENDL \
-"  scient_max = expression" ENDL \
-"  sep_out = expression" ENDL \
-;
-
-typedef struct hs_value {
-    double re;
-    double im;
-} hs_value_t;
-
-typedef struct hs_var {
-    char id[HS_BUF_SIZE];
-    hs_value_t value;
-} hs_var_t;
-
-hs_var_t hs_default_vars[] = {
-    {.id = "zero",   .value = {.re = 0,                .im = 0}},
-    {.id = "one",    .value = {.re = 1,                .im = 0}},
-    {.id = "inch",   .value = {.re = 0.0254,           .im = 0}},
-    {.id = "foot",   .value = {.re = 0.3048,           .im = 0}},
-    {.id = "mile",   .value = {.re = 1609.34,          .im = 0}},
-    {.id = "i",      .value = {.re = 0,                .im = 1}},
-    {.id = "e",      .value = {.re = 2.718281828459045235360287471352662497757247093, .im = 0}},
-    {.id = "pi",     .value = {.re = 3.141592653589793238462643383279502884197169399, .im = 0}},
-    {.id = "tau",    .value = {.re = 6.283185307179586476925286766559005768394338798, .im = 0}},
-    {.id = "phi",    .value = {.re = 1.618033988749894848204586834365638117720309179, .im = 0}},
-    {.id = "c",      .value = {.re = 299792458,        .im = 0}},
-    {.id = "g",      .value = {.re = 9.80665,          .im = 0}},
-    {.id = "ev",     .value = {.re = 1.602176634e-19,  .im = 0}},
-    {.id = "mu_0",   .value = {.re = 1.25663706127e-6, .im = 0}},
-    {.id = "epsi_0", .value = {.re = 8.8541878188e-12, .im = 0}},
-};
-
-hs_value_t hs_f_abs(hs_value_t a, hs_value_t b) {
-    return (hs_value_t){.re = sqrt(a.re * a.re + a.im * a.im), .im = 0};
-}
-
-hs_value_t hs_f_add(hs_value_t a, hs_value_t b) {
-    return (hs_value_t){.re = a.re + b.re, .im = a.im + b.im};
-}
-
-hs_value_t hs_f_subtract(hs_value_t a, hs_value_t b) {
-    return (hs_value_t){.re = a.re - b.re, .im = a.im - b.im};
-}
-
-hs_value_t hs_f_multiply(hs_value_t a, hs_value_t b) {
-    return (hs_value_t){.re = a.re * b.re - a.im * b.im, .im = a.re * b.im + a.im * b.re};
-}
-
-hs_value_t hs_f_divide(hs_value_t a, hs_value_t b) {
-    if (hs_f_abs(b, HS_ZERO).re < HS_EPSILON) {
-        printf("ERROR: division by zero" ENDL);
-        return (hs_value_t){.re = NAN, .im = NAN};
-    }
-    return (hs_value_t){.re = (a.re * b.re + a.im * b.im) / (b.re * b.re + b.im * b.im), .im = (a.im * b.re - a.re * b.im) / (b.re * b.re + b.im * b.im)};
-}
-
-hs_value_t hs_f_round(hs_value_t a, hs_value_t b) {
-    return (hs_value_t){.re = round(a.re), .im = round(a.im)};
-}
-
-hs_value_t hs_f_floor(hs_value_t a, hs_value_t b) {
-    return (hs_value_t){.re = floor(a.re), .im = floor(a.im)};
-}
-
-hs_value_t hs_f_ceil(hs_value_t a, hs_value_t b) {
-    return (hs_value_t){.re = ceil(a.re), .im = ceil(a.im)};
-}
-
-hs_value_t hs_f_modulo(hs_value_t a, hs_value_t b) {
-    if (fabs(b.im) < HS_EPSILON) {
-        return (hs_value_t){.re = fmod(a.re, b.re), .im = 0};
-    } else {
-        return (hs_value_t){.re = fmod(a.re, b.re), .im = fmod(a.im, b.im)};
-    }
-}
-
-hs_value_t hs_f_pow(hs_value_t a, hs_value_t b) {
-    if (fabs(a.im) >= HS_EPSILON || fabs(b.im) >= HS_EPSILON) {
-        printf("ERROR: i'm sorry dave, i can't let you do that (-> exponent) with complex numbers" ENDL);
-    }
-    return (hs_value_t){.re = pow(a.re, b.re), .im = 0};
-}
-
-hs_value_t hs_f_root(hs_value_t a, hs_value_t b) {
-    if (fabs(a.im) >= HS_EPSILON || fabs(b.im) >= HS_EPSILON) {
-        printf("ERROR: i'm sorry dave, i can't let you do that (-> root) with complex numbers" ENDL);
-    }
-    return hs_f_pow(a, hs_f_divide(HS_ONE, b));
-}
-
-hs_value_t hs_f_sqrt(hs_value_t a, hs_value_t b) {
-    if (fabs(b.im) >= HS_EPSILON) {
-        return (hs_value_t){.re = sqrt((hs_f_abs(a, HS_ZERO).re + a.re) / 2), .im = a.im / fabs(a.im) * sqrt((hs_f_abs(a, HS_ZERO).re - a.re) / 2)};
-    } else if (hs_f_abs(hs_f_subtract(a, (hs_value_t){.re = -1, .im = 0}), HS_ZERO).re < HS_EPSILON) {
-        return (hs_value_t){.re = 0, .im = 1};
-    }
-    return hs_f_root(a, (hs_value_t){.re = 2, .im = 0});
-}
-
-hs_value_t hs_f_ln(hs_value_t a, hs_value_t b) {
-    return (hs_value_t){.re = log(sqrt(a.re * a.re + a.im * a.im)), .im = atan2(a.im, a.re)};
-}
-
-hs_value_t hs_f_log2(hs_value_t a, hs_value_t b) {
-    if (fabs(a.im) >= HS_EPSILON) {
-        printf("ERROR: i'm sorry dave, i can't let you do that (-> log2) with complex numbers" ENDL);
-    }
-    return (hs_value_t){.re = log2(a.re), .im = 0};
-}
-
-hs_value_t hs_f_log10(hs_value_t a, hs_value_t b) {
-    if (fabs(a.im) >= HS_EPSILON) {
-        printf("ERROR: i'm sorry dave, i can't let you do that (-> log10) with complex numbers" ENDL);
-    }
-    return (hs_value_t){.re = log10(a.re), .im = 0};
-}
-
-hs_value_t hs_f_sin(hs_value_t a, hs_value_t b) {
-    if (fabs(a.im) >= HS_EPSILON) {
-        printf("ERROR: i'm sorry dave, i can't let you do that (-> sin) with complex numbers" ENDL);
-    }
-    return (hs_value_t){.re = sin(a.re), .im = 0};
-}
-
-hs_value_t hs_f_sinh(hs_value_t a, hs_value_t b) {
-    if (fabs(a.im) >= HS_EPSILON) {
-        printf("ERROR: i'm sorry dave, i can't let you do that (-> sinh) with complex numbers" ENDL);
+// calls handle for every non-empty line of file in order, reading in large blocks and splitting lines in place
+bool hs_read_lines(FILE *file, void (*handle)(char *line, void *context), void *context, size_t *lines) {
+    size_t capacity = HS_BATCH_BLOCK_SIZE;
+    char *buffer = malloc(capacity + 1);
+    if (buffer == NULL) {
+        printf("ERROR: out of memory while reading input :(" ENDL);
+        return false;
     }
-    return (hs_value_t){.re = sinh(a.re), .im = 0};
-}
-
-hs_value_t hs_f_asin(hs_value_t a, hs_value_t b) {
-    if (fabs(a.im) >= HS_EPSILON) {
-        printf("ERROR: i'm sorry dave, i can't let you do that (-> asin) with complex numbers" ENDL);
+    size_t filled = 0;
+    bool eof = false;
+
+    while (!eof) {
+        if (filled == capacity) {
+            // a single line does not fit into the buffer
+            capacity *= 2;
+            char *new_buffer = realloc(buffer, capacity + 1);
+            if (new_buffer == NULL) {
+                printf("ERROR: out of memory while reading input :(" ENDL);
+                free(buffer);
+                return false;
+            }
+            buffer = new_buffer;
+        }
+        size_t read = fread(buffer + filled, 1, capacity - filled, file);
+        eof = read == 0;
+        filled += read;
+
+        size_t line_start = 0;
+        while (line_start < filled) {
+            char *line = buffer + line_start;
+            char *newline = memchr(line, '\n', filled - line_start);
+            if (newline == NULL) {
+                if (!eof)
+                    break;
+                newline = buffer + filled;
+            }
+            *newline = '\0';
+            if (newline > line && newline[-1] == '\r')
+                newline[-1] = '\0';
+            line_start = newline - buffer + 1;
+            if (line[0] != '\0') {
+                handle(line, context);
+                (*lines)++;
+            }
+        }
+        if (line_start > filled)
+            line_start = filled;
+        memmove(buffer, buffer + line_start, filled - line_start);
+        filled -= line_start;
     }
-    return (hs_value_t){.re = asin(a.re), .im = 0};
-}
 
-hs_value_t hs_f_cos(hs_value_t a, hs_value_t b) {
-    if (fabs(a.im) >= HS_EPSILON) {
-        printf("ERROR: i'm sorry dave, i can't let you do that (-> cos) with complex numbers" ENDL);
-    }
-    return (hs_value_t){.re = cos(a.re), .im = 0};
+    free(buffer);
+    return true;
 }
 
-hs_value_t hs_f_cosh(hs_value_t a, hs_value_t b) {
-    if (fabs(a.im) >= HS_EPSILON) {
-        printf("ERROR: i'm sorry dave, i can't let you do that (-> cosh) with complex numbers" ENDL);
+void hs_batch_line(char *line, void *state) {
+    hs_run(state, line);
+}
+
+#if HS_THREADS
+typedef struct hs_batch_chunk {
+    char **lines;
+    size_t lines_count;
+    // output of all lines of this chunk, collected by the worker's output callback
+    char *out;
+    size_t out_size;
+    size_t out_capacity;
+    bool done;
+} hs_batch_chunk_t;
+
+typedef struct hs_batch_pool {
+    // every worker reads the definitions of the initial state from here, assignments stay in its own session
+    hs_shared_t *shared;
+    hs_batch_chunk_t *chunks;
+    size_t chunks_count;
+    size_t next_chunk;
+    pthread_mutex_t lock;
+    pthread_cond_t chunk_done;
+} hs_batch_pool_t;
+
+void hs_batch_chunk_write(const char *data, size_t size, void *context) {
+    hs_batch_chunk_t *chunk = context;
+    if (chunk->out_size + size > chunk->out_capacity) {
+        size_t capacity = chunk->out_capacity > 0 ? chunk->out_capacity : 256;
+        while (chunk->out_size + size > capacity)
+            capacity *= 2;
+        char *out = realloc(chunk->out, capacity);
+        if (out == NULL)
+            return;
+        chunk->out = out;
+        chunk->out_capacity = capacity;
     }
-    return (hs_value_t){.re = cosh(a.re), .im = 0};
+    memcpy(chunk->out + chunk->out_size, data, size);
+    chunk->out_size += size;
 }
 
-hs_value_t hs_f_acos(hs_value_t a, hs_value_t b) {
-    if (fabs(a.im) >= HS_EPSILON) {
-        printf("ERROR: i'm sorry dave, i can't let you do that (-> acos) with complex numbers" ENDL);
-    }
-    return (hs_value_t){.re = acos(a.re), .im = 0};
-}
+void *hs_batch_worker(void *arg) {
+    hs_batch_pool_t *pool = arg;
+    hs_state_t *state = hs_state_create_shared(pool->shared);
 
-hs_value_t hs_f_tan(hs_value_t a, hs_value_t b) {
-    if (fabs(a.im) >= HS_EPSILON) {
-        printf("ERROR: i'm sorry dave, i can't let you do that (-> tan) with complex numbers" ENDL);
-    }
-    return (hs_value_t){.re = tan(a.re), .im = 0};
-}
+    while (true) {
+        pthread_mutex_lock(&pool->lock);
+        size_t chunk_i = pool->next_chunk++;
+        pthread_mutex_unlock(&pool->lock);
+        if (chunk_i >= pool->chunks_count)
+            break;
 
-hs_value_t hs_f_tanh(hs_value_t a, hs_value_t b) {
-    if (fabs(a.im) >= HS_EPSILON) {
-        printf("ERROR: i'm sorry dave, i can't let you do that (-> tanh) with complex numbers" ENDL);
-    }
-    return (hs_value_t){.re = tanh(a.re), .im = 0};
-}
+        hs_batch_chunk_t *chunk = &pool->chunks[chunk_i];
+        if (state == NULL) {
+            char message[64];
+            int length = snprintf(message, sizeof(message), "ERROR: could not set up worker for chunk " SIZE_T_F ENDL, chunk_i);
+            hs_batch_chunk_write(message, length, chunk);
+        } else {
+            hs_set_output_callback(state, hs_batch_chunk_write, chunk);
+            for (size_t i = 0; i < chunk->lines_count; i++)
+                hs_run(state, chunk->lines[i]);
+            hs_flush(state);
+            hs_set_output_callback(state, NULL, NULL);
+        }
 
-hs_value_t hs_f_atan(hs_value_t a, hs_value_t b) {
-    if (fabs(a.im) >= HS_EPSILON) {
-        printf("ERROR: i'm sorry dave, i can't let you do that (-> atan) with complex numbers" ENDL);
+        pthread_mutex_lock(&pool->lock);
+        chunk->done = true;
+        pthread_cond_broadcast(&pool->chunk_done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    hs_state_destroy(state);
+    return NULL;
+}
+
+// runs every line of file on a pool of workers, lines must not depend on each other (assignments stay local to a worker).
+// the whole input is read first, the output of each chunk is buffered and written in input order
+bool hs_batch_parallel(FILE *file, size_t threads, hs_state_t *state, size_t *lines) {
+    size_t capacity = HS_BATCH_BLOCK_SIZE;
+    size_t filled = 0;
+    char *buffer = malloc(capacity + 1);
+    if (buffer == NULL)
+        goto hs_batch_parallel_oom;
+    size_t read;
+    while ((read = fread(buffer + filled, 1, capacity - filled, file)) > 0) {
+        filled += read;
+        if (filled == capacity) {
+            capacity *= 2;
+            char *new_buffer = realloc(buffer, capacity + 1);
+            if (new_buffer == NULL)
+                goto hs_batch_parallel_oom;
+            buffer = new_buffer;
+        }
     }
-    return (hs_value_t){.re = atan(a.re), .im = 0};
-}
-
-hs_value_t hs_f_atan2(hs_value_t a, hs_value_t b) {
-    if (fabs(a.im) >= HS_EPSILON || fabs(b.im) >= HS_EPSILON) {
-        printf("ERROR: i'm sorry dave, i can't let you do that (-> atan2) with complex numbers" ENDL);
+    buffer[filled] = '\0';
+
+    size_t lines_capacity = HS_BATCH_CHUNK_LINES;
+    char **line_list = malloc(lines_capacity * sizeof(char *));
+    if (line_list == NULL)
+        goto hs_batch_parallel_oom;
+    size_t lines_count = 0;
+    for (char *line = buffer; line < buffer + filled;) {
+        char *newline = memchr(line, '\n', buffer + filled - line);
+        if (newline == NULL)
+            newline = buffer + filled;
+        *newline = '\0';
+        if (newline > line && newline[-1] == '\r')
+            newline[-1] = '\0';
+        if (line[0] != '\0') {
+            if (lines_count == lines_capacity) {
+                lines_capacity *= 2;
+                char **new_line_list = realloc(line_list, lines_capacity * sizeof(char *));
+                if (new_line_list == NULL) {
+                    free(line_list);
+                    goto hs_batch_parallel_oom;
+                }
+                line_list = new_line_list;
+            }
+            line_list[lines_count++] = line;
+        }
+        line = newline + 1;
     }
-    return (hs_value_t){.re = atan2(a.re, b.re), .im = 0};
-}
-
-hs_value_t hs_f_and(hs_value_t a, hs_value_t b) {
-    return (hs_value_t){.re = (uint64_t)a.re & (uint64_t)b.re, .im = (uint64_t)a.im & (uint64_t)b.im};
-}
-
-hs_value_t hs_f_or(hs_value_t a, hs_value_t b) {
-    return (hs_value_t){.re = (uint64_t)a.re | (uint64_t)b.re, .im = (uint64_t)a.im | (uint64_t)b.im};
-}
-
-hs_value_t hs_f_xor(hs_value_t a, hs_value_t b) {
-    return (hs_value_t){.re = (uint64_t)a.re ^ (uint64_t)b.re, .im = (uint64_t)a.im ^ (uint64_t)b.im};
-}
-
-hs_value_t hs_f_shiftl(hs_value_t a, hs_value_t b) {
-    return (hs_value_t){.re = (uint64_t)a.re << (uint64_t)b.re, .im = (uint64_t)a.im << (uint64_t)b.im};
-}
-
-hs_value_t hs_f_shiftr(hs_value_t a, hs_value_t b) {
-    return (hs_value_t){.re = (uint64_t)a.re >> (uint64_t)b.re, .im = (uint64_t)a.im >> (uint64_t)b.im};
-}
-
-typedef struct hs_func_param hs_func_param_t;
-
-typedef struct hs_func {
-    char id[HS_BUF_SIZE];
-    hs_value_t (*func)(hs_value_t a, hs_value_t b);
-    uint8_t params_count;
-    hs_func_param_t *params_linked;
-    char *expression;
-} hs_func_t;
-
-typedef struct hs_func_param {
-    char id[HS_BUF_SIZE];
-    hs_func_param_t *next;
-} hs_func_param_t;
-
-hs_func_t hs_default_funcs[] = {
-    {.id = "add",       .func = hs_f_add,       .params_count = 2},
-    {.id = "subtract",  .func = hs_f_subtract,  .params_count = 2},
-    {.id = "multiply",  .func = hs_f_multiply,  .params_count = 2},
-    {.id = "divide",    .func = hs_f_divide,    .params_count = 2},
-    {.id = "modulo",    .func = hs_f_modulo,    .params_count = 2},
-    {.id = "pow",       .func = hs_f_pow,       .params_count = 2},
-    {.id = "root",      .func = hs_f_root,      .params_count = 2},
-    {.id = "sqrt",      .func = hs_f_sqrt,      .params_count = 1},
-    {.id = "round",     .func = hs_f_round,     .params_count = 1},
-    {.id = "floor",     .func = hs_f_floor,     .params_count = 1},
-    {.id = "ceil",      .func = hs_f_ceil,      .params_count = 1},
-    {.id = "abs",       .func = hs_f_abs,       .params_count = 1},
-    {.id = "ln",        .func = hs_f_ln,        .params_count = 1},
-    {.id = "log2",      .func = hs_f_log2,      .params_count = 1},
-    {.id = "log10",     .func = hs_f_log10,     .params_count = 1},
-    {.id = "sin",       .func = hs_f_sin,       .params_count = 1},
-    {.id = "sinh",      .func = hs_f_sinh,      .params_count = 1},
-    {.id = "asin",      .func = hs_f_asin,      .params_count = 1},
-    {.id = "cos",       .func = hs_f_cos,       .params_count = 1},
-    {.id = "cosh",      .func = hs_f_cosh,      .params_count = 1},
-    {.id = "acos",      .func = hs_f_acos,      .params_count = 1},
-    {.id = "tan",       .func = hs_f_tan,       .params_count = 1},
-    {.id = "tanh",      .func = hs_f_tanh,      .params_count = 1},
-    {.id = "atan",      .func = hs_f_atan,      .params_count = 1},
-    {.id = "atan2",     .func = hs_f_atan2,     .params_count = 1},
-    {.id = "and",       .func = hs_f_and,       .params_count = 2},
-    {.id = "or",        .func = hs_f_or,        .params_count = 2},
-    {.id = "xor",       .func = hs_f_xor,       .params_count = 2},
-    {.id = "shiftl",    .func = hs_f_shiftl,    .params_count = 2},
-    {.id = "shiftr",    .func = hs_f_shiftr,    .params_count = 2},
-};
-
-typedef enum hs_output_mode {
-    HS_OUTPUT_BIN = 2,
-    HS_OUTPUT_OCT = 8,
-    HS_OUTPUT_DEC = 10,
-    HS_OUTPUT_HEX = 16,
-} hs_output_mode_t;
 
-typedef struct hs_settings {
-    hs_output_mode_t output_mode;
-    double scient_min;
-    double scient_max;
-    char dec_sep_char_in;
-    char dec_sep_char_out;
-    bool sep_out;
-    char sep_char_in;
-    char sep_char_out;
-} hs_settings_t;
-
-typedef struct hs_state {
-    hs_var_t *context_vars;
-    size_t context_vars_length;
-    hs_func_t *context_funcs;
-    size_t context_funcs_length;
-    hs_settings_t settings;
-} hs_state_t;
-
-bool hs_funcs_push(hs_state_t *state, hs_func_t func);
-
-hs_state_t hs_default_state() {
-    hs_state_t state = {
-        .context_vars = malloc(sizeof(hs_default_vars) + 1 * sizeof(hs_var_t)),
-        .context_vars_length = sizeof(hs_default_vars) / sizeof(hs_var_t) + 1,
-        .context_funcs = malloc(sizeof(hs_default_funcs)),
-        .context_funcs_length = sizeof(hs_default_funcs) / sizeof(hs_func_t),
-        .settings = {
-            .output_mode = HS_OUTPUT_DEC,
-            .scient_min = 0.01,
-            .scient_max = 10000,
-            .dec_sep_char_in = '.',
-            .dec_sep_char_out = '.',
-            .sep_out = true,
-            .sep_char_in = '\'',
-            .sep_char_out = '\'',
-        },
-    };
-    if (state.context_vars == NULL) {
-        printf("ERROR: out of memory during variable list initialization :(" ENDL);
-        return state;
-    }
-    if (state.context_funcs == NULL ) {
-        printf("ERROR: out of memory during function list initialization :(" ENDL);
-        return state;
-    }
-    state.context_vars[0] = (hs_var_t){
-        .id = "ans",
-        .value = HS_ZERO,
+    hs_batch_pool_t pool = {
+        .shared = hs_shared_create(state),
+        .chunks = NULL,
+        .chunks_count = (lines_count + HS_BATCH_CHUNK_LINES - 1) / HS_BATCH_CHUNK_LINES,
+        .next_chunk = 0,
     };
-    for (size_t i = 0; i < sizeof(hs_default_vars) / sizeof(hs_var_t); i++) {
-        state.context_vars[i + 1] = hs_default_vars[i];
-    }
-    for (size_t i = 0; i < state.context_funcs_length; i++) {
-        state.context_funcs[i] = hs_default_funcs[i];
-        state.context_funcs[i].params_linked = NULL;
-        state.context_funcs[i].expression = NULL;
+    pool.chunks = malloc((pool.chunks_count > 0 ? pool.chunks_count : 1) * sizeof(hs_batch_chunk_t));
+    pthread_t *workers = malloc(threads * sizeof(pthread_t));
+    if (pool.shared == NULL || pool.chunks == NULL || workers == NULL) {
+        hs_shared_destroy(pool.shared);
+        free(pool.chunks);
+        free(workers);
+        free(line_list);
+        goto hs_batch_parallel_oom;
+    }
+    for (size_t i = 0; i < pool.chunks_count; i++) {
+        size_t first = i * HS_BATCH_CHUNK_LINES;
+        pool.chunks[i] = (hs_batch_chunk_t){
+            .lines = line_list + first,
+            .lines_count = lines_count - first < HS_BATCH_CHUNK_LINES ? lines_count - first : HS_BATCH_CHUNK_LINES,
+            .out = NULL,
+            .out_size = 0,
+            .out_capacity = 0,
+            .done = false,
+        };
     }
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.chunk_done, NULL);
 
-    return state;
-}
-
-bool hs_str_same(char*, char*);
-
-bool hs_vars_push(hs_state_t *state, hs_var_t var) {
-    size_t var_i = -1;
-    for (size_t i = 0; i < state->context_vars_length; i++) {
-        if (hs_str_same(var.id, state->context_vars[i].id)) {
-            var_i = i;
+    size_t started = 0;
+    for (; started < threads && started < pool.chunks_count; started++) {
+        if (pthread_create(&workers[started], NULL, hs_batch_worker, &pool) != 0)
             break;
-        }
     }
-    if (var_i == -1) {
-        state->context_vars_length++;
-        state->context_vars = realloc(state->context_vars, state->context_vars_length * sizeof(hs_var_t));
-        if (state->context_vars == NULL) {
-            printf("ERROR: out of memory during variable list reallocation at " SIZE_T_F " tokens :(" ENDL, state->context_vars_length);
-            return false;
+    if (started == 0 && pool.chunks_count > 0) {
+        // no thread could be started, work through the chunks right here
+        hs_batch_worker(&pool);
+    }
+
+    for (size_t i = 0; i < pool.chunks_count; i++) {
+        pthread_mutex_lock(&pool.lock);
+        while (!pool.chunks[i].done)
+            pthread_cond_wait(&pool.chunk_done, &pool.lock);
+        pthread_mutex_unlock(&pool.lock);
+        if (pool.chunks[i].out != NULL) {
+            fwrite(pool.chunks[i].out, 1, pool.chunks[i].out_size, stdout);
+            free(pool.chunks[i].out);
         }
-        var_i = state->context_vars_length - 1;
     }
-    state->context_vars[var_i] = var;
+    for (size_t i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+
+    pthread_cond_destroy(&pool.chunk_done);
+    pthread_mutex_destroy(&pool.lock);
+    hs_shared_destroy(pool.shared);
+    free(workers);
+    free(pool.chunks);
+    free(line_list);
+    free(buffer);
+    *lines = lines_count;
     return true;
-}
 
-void hs_param_free_recursive(hs_func_param_t *param) {
-    if (param->next != NULL) {
-        hs_param_free_recursive(param->next);
-        param->next = NULL;
-    }
-    if (param != NULL) {
-        free(param);
-    }
+hs_batch_parallel_oom:
+    printf("ERROR: out of memory while reading input :(" ENDL);
+    free(buffer);
+    return false;
 }
+#endif
 
-bool hs_funcs_push(hs_state_t *state, hs_func_t func) {
-    size_t func_i = -1;
-    for (size_t i = 0; i < state->context_funcs_length; i++) {
-        if (hs_str_same(func.id, state->context_funcs[i].id)) {
-            func_i = i;
-            if (state->context_funcs[i].expression != NULL)
-                free(state->context_funcs[i].expression);
-            if (state->context_funcs[i].params_linked != NULL)
-                hs_param_free_recursive(state->context_funcs[i].params_linked);
-            break;
+// runs every line of path (or stdin if path is NULL or "-") without prompts, on threads workers if threads > 1
+int hs_batch(char *path, size_t threads, hs_state_t *state) {
+    FILE *file = stdin;
+    if (path != NULL && strcmp(path, "-") != 0) {
+        file = fopen(path, "rb");
+        if (file == NULL) {
+            printf("ERROR: could not open %s" ENDL, path);
+            return 1;
         }
     }
-    if (func_i == -1) {
-        state->context_funcs_length++;
-        state->context_funcs = realloc(state->context_funcs, state->context_funcs_length * sizeof(hs_func_t));
-        if (state->context_funcs == NULL) {
-            printf("ERROR: out of memory during function list reallocation at " SIZE_T_F " tokens :(" ENDL, state->context_funcs_length);
-            return false;
+    size_t lines = 0;
+    bool success;
+    struct timespec time_start, time_end;
+    timespec_get(&time_start, TIME_UTC);
+
+#if HS_THREADS
+    if (threads > 1)
+        success = hs_batch_parallel(file, threads, state, &lines);
+    else
+#else
+    if (threads > 1)
+        printf("WARNING: threads are not supported on this platform, running sequentially" ENDL);
+#endif
+        success = hs_read_lines(file, hs_batch_line, state, &lines);
+
+    hs_flush(state);
+    fflush(stdout);
+    timespec_get(&time_end, TIME_UTC);
+    double seconds = (double)(time_end.tv_sec - time_start.tv_sec) + (double)(time_end.tv_nsec - time_start.tv_nsec) * 1e-9;
+    fprintf(stderr, SIZE_T_F " lines in %.3f s (%.0f lines/s)" ENDL, lines, seconds, seconds > 0 ? lines / seconds : 0.0);
+
+    if (file != stdin)
+        fclose(file);
+    return success ? 0 : 1;
+}
+
+typedef struct hs_columns {
+    hs_state_t *state;
+    // expression compiled once before the first row
+    hs_expr_t *expr;
+    // variable each column is bound to, NULL for columns that are skipped
+    char **names;
+    size_t count;
+    char delimiter; // picked from the first row
+    size_t rows;
+} hs_columns_t;
+
+void hs_columns_row(char *line, void *context) {
+    hs_columns_t *columns = context;
+    hs_state_t *state = columns->state;
+    size_t length = strlen(line);
+    if (columns->delimiter == '\0') {
+        if (memchr(line, '\t', length) != NULL) {
+            columns->delimiter = '\t';
+        } else if (memchr(line, ';', length) != NULL) {
+            columns->delimiter = ';';
+        } else {
+            columns->delimiter = ',';
         }
-        func_i = state->context_funcs_length - 1;
     }
-    state->context_funcs[func_i] = func;
-    return true;
-}
+    columns->rows++;
 
-void hs_preprocess_input(char *input) {
-    while (*input != '\0') {
-        if (*input >= 'A' && *input <= 'Z') {
-            *input += 'a' - 'A';
+    char *field = line;
+    for (size_t c = 0; c < columns->count; c++) {
+        if (field == NULL) {
+            printf("ERROR: row " SIZE_T_F " has only " SIZE_T_F " columns" ENDL, columns->rows, c);
+            return;
         }
-        input++;
-    }
-}
-
-typedef enum hs_token_kind {
-    HS_TOKEN_EOF,
-    HS_TOKEN_ID,
-    HS_TOKEN_ID_IS_VAR,
-    HS_TOKEN_LIT_DEC,
-    HS_TOKEN_LIT_BIN,
-    HS_TOKEN_LIT_OCT,
-    HS_TOKEN_LIT_HEX,
-    HS_TOKEN_ADD,
-    HS_TOKEN_SUBTRACT,
-    HS_TOKEN_MULTIPLY,
-    HS_TOKEN_DIVIDE,
-    HS_TOKEN_MODULO,
-    HS_TOKEN_POWER,
-    HS_TOKEN_AND,
-    HS_TOKEN_OR,
-    HS_TOKEN_XOR,
-    HS_TOKEN_SHIFTL,
-    HS_TOKEN_SHIFTR,
-    HS_TOKEN_OPEN_P,
-    HS_TOKEN_CLOSE_P,
-    HS_TOKEN_COMMA,
-} hs_token_kind_t;
-
-typedef struct hs_token {
-    hs_token_kind_t kind;
-    char content[HS_BUF_SIZE];
-} hs_token_t;
-
-typedef struct hs_token_list {
-    hs_token_t *items;
-    size_t capacity;
-    size_t size;
-} hs_token_list_t;
-
-hs_token_list_t hs_token_list_init() {
-    hs_token_list_t list = {
-        .items = malloc(sizeof(hs_token_t)),
-        .capacity = 1,
-        .size = 0,
+        char *end = memchr(field, columns->delimiter, line + length - field);
+        if (end == NULL)
+            end = line + length;
+        if (columns->names[c] != NULL) {
+            double value;
+            if (!hs_parse_number(state, field, end - field, &value)) {
+                // a first row that is not a number is the header
+                if (columns->rows > 1)
+                    printf("ERROR: column " SIZE_T_F " of row " SIZE_T_F " is not a number" ENDL, c + 1, columns->rows);
+                return;
+            }
+            hs_var_set(state, columns->names[c], (hs_value_t){.re = value, .im = 0});
+        }
+        field = end < line + length ? end + 1 : NULL;
+    }
+
+    hs_value_t result;
+    const char *error;
+    hs_expr_eval(state, columns->expr, &result, &error);
+    if (error != NULL)
+        fputs(error, stdout);
+    char formatted[HS_CLI_FORMAT_SIZE];
+    hs_format(state, result, formatted, sizeof(formatted));
+    printf("%s" ENDL, formatted);
+}
+
+// evaluates expression once per row of file (or stdin if path is NULL or "-"),
+// names is a comma separated list binding the columns to variables in order, empty names skip a column
+int hs_columns(char *names, char *expression, char *path, hs_state_t *state) {
+    hs_columns_t columns = {
+        .state = state,
+        .expr = NULL,
+        .names = NULL,
+        .count = 1,
+        .delimiter = '\0',
+        .rows = 0,
     };
-    if (list.items == NULL) {
-        printf("ERROR: out of memory during token list initialization :(" ENDL);
-        return list;
-    }
-    return list;
-}
+    FILE *file = stdin;
+    int result = 1;
 
-bool hs_token_list_push(hs_token_list_t *list, hs_token_t token) {
-    if (list->size >= list->capacity) {
-        list->capacity *= 2;
-        list->items = realloc(list->items, list->capacity * sizeof(hs_token_t));
-        if (list->items == NULL) {
-            printf("ERROR: out of memory during token list reallocation at " SIZE_T_F " tokens :(" ENDL, list->size);
-            return false;
-        }
+    for (size_t i = 0; names[i] != '\0'; i++) {
+        if (names[i] == ',')
+            columns.count++;
     }
-    list->items[list->size++] = token;
-    return true;
-}
-
-hs_token_t hs_token_list_pop(hs_token_list_t *list) {
-    if (list->size > 0) {
-        list->size--;
-        return list->items[list->size];
-    } else {
-        printf("WARNING: missing some expected token" ENDL);
-        return (hs_token_t){
-            .kind = HS_TOKEN_EOF,
-        };
+    columns.names = malloc(columns.count * sizeof(char *));
+    if (columns.names == NULL) {
+        printf("ERROR: out of memory during column list initialization :(" ENDL);
+        return 1;
     }
-}
-
-hs_token_list_t hs_tokenize(char *input, hs_state_t *state) {
-    hs_token_list_t tokens = hs_token_list_init();
-
-    if (tokens.items == NULL)
-        goto hs_tokenize_error;
-
-    for (size_t i = 0; input[i] != '\0'; i++) {
-        if (input[i] == '+') {
-            if (!hs_token_list_push(&tokens, (hs_token_t){.kind = HS_TOKEN_ADD})) goto hs_tokenize_error;
-        } else if (input[i] == '-') {
-            if (!hs_token_list_push(&tokens, (hs_token_t){.kind = HS_TOKEN_SUBTRACT})) goto hs_tokenize_error;
-        } else if (input[i] == '*') {
-            if (!hs_token_list_push(&tokens, (hs_token_t){.kind = HS_TOKEN_MULTIPLY})) goto hs_tokenize_error;
-        } else if (input[i] == '/') {
-            if (!hs_token_list_push(&tokens, (hs_token_t){.kind = HS_TOKEN_DIVIDE})) goto hs_tokenize_error;
-        } else if (input[i] == '%') {
-            if (!hs_token_list_push(&tokens, (hs_token_t){.kind = HS_TOKEN_MODULO})) goto hs_tokenize_error;
-        } else if (input[i] == '^') {
-            if (!hs_token_list_push(&tokens, (hs_token_t){.kind = HS_TOKEN_POWER})) goto hs_tokenize_error;
-        } else if (input[i] == '&') {
-            if (!hs_token_list_push(&tokens, (hs_token_t){.kind = HS_TOKEN_AND})) goto hs_tokenize_error;
-        } else if (input[i] == '|') {
-            if (!hs_token_list_push(&tokens, (hs_token_t){.kind = HS_TOKEN_OR})) goto hs_tokenize_error;
-        } else if (input[i] == '~') {
-            if (!hs_token_list_push(&tokens, (hs_token_t){.kind = HS_TOKEN_XOR})) goto hs_tokenize_error;
-        } else if (input[i] == '<') {
-            if (!hs_token_list_push(&tokens, (hs_token_t){.kind = HS_TOKEN_SHIFTL})) goto hs_tokenize_error;
-        } else if (input[i] == '>') {
-            if (!hs_token_list_push(&tokens, (hs_token_t){.kind = HS_TOKEN_SHIFTR})) goto hs_tokenize_error;
-        } else if (input[i] == '(') {
-            if (!hs_token_list_push(&tokens, (hs_token_t){.kind = HS_TOKEN_OPEN_P})) goto hs_tokenize_error;
-        } else if (input[i] == ')') {
-            if (!hs_token_list_push(&tokens, (hs_token_t){.kind = HS_TOKEN_CLOSE_P})) goto hs_tokenize_error;
-        } else if (input[i] == ',') {
-            if (!hs_token_list_push(&tokens, (hs_token_t){.kind = HS_TOKEN_COMMA})) goto hs_tokenize_error;
-        } else if ((input[i] >= '0' && input[i] <= '9') || input[i] == state->settings.dec_sep_char_in) {
-            hs_token_t token_lit;
-            if (input[i] == '0') {
-                if (input[i + 1] == 'b') {
-                    i += 2;
-                    size_t token_start = i;
-                    token_lit.kind = HS_TOKEN_LIT_BIN;
-                    while (((input[i] >= '0' && input[i] <= '1') || input[i] == state->settings.dec_sep_char_in || input[i] == state->settings.sep_char_in) && i - token_start < HS_BUF_SIZE - 1) {
-                        token_lit.content[i - token_start] = input[i];
-                        i++;
-                    }
-                    token_lit.content[i - token_start] = '\0';
-                    i--;
-                    if (!hs_token_list_push(&tokens, token_lit))
-                        goto hs_tokenize_error;
-                    continue;
-                } else if (input[i + 1] == 'o') {
-                    i += 2;
-                    size_t token_start = i;
-                    token_lit.kind = HS_TOKEN_LIT_OCT;
-                    while (((input[i] >= '0' && input[i] <= '7') || input[i] == state->settings.dec_sep_char_in || input[i] == state->settings.sep_char_in) && i - token_start < HS_BUF_SIZE - 1) {
-                        token_lit.content[i - token_start] = input[i];
-                        i++;
-                    }
-                    token_lit.content[i - token_start] = '\0';
-                    i--;
-                    if (!hs_token_list_push(&tokens, token_lit))
-                        goto hs_tokenize_error;
-                    continue;
-                } else if (input[i + 1] == 'x') {
-                    i += 2;
-                    size_t token_start = i;
-                    token_lit.kind = HS_TOKEN_LIT_HEX;
-                    while (((input[i] >= '0' && input[i] <= '9') || (input[i] >= 'a' && input[i] <= 'f') || input[i] == state->settings.dec_sep_char_in || input[i] == state->settings.sep_char_in) && i - token_start < HS_BUF_SIZE - 1) {
-                        token_lit.content[i - token_start] = input[i];
-                        i++;
-                    }
-                    token_lit.content[i - token_start] = '\0';
-                    i--;
-                    if (!hs_token_list_push(&tokens, token_lit))
-                        goto hs_tokenize_error;
-                    continue;
-                }
-            }
-            size_t token_start = i;
-            token_lit.kind = HS_TOKEN_LIT_DEC;
-            while (((input[i] >= '0' && input[i] <= '9') || input[i] == state->settings.dec_sep_char_in || input[i] == state->settings.sep_char_in) && i - token_start < HS_BUF_SIZE - 1) {
-                token_lit.content[i - token_start] = input[i];
-                i++;
-            }
-            token_lit.content[i - token_start] = '\0';
-            i--;
-            if (tokens.items[tokens.size - 1].kind == HS_TOKEN_SUBTRACT &&
-               ((tokens.size >= 2 && (tokens.items[tokens.size - 2].kind == HS_TOKEN_OPEN_P ||
-                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_COMMA ||
-                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_ADD ||
-                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_SUBTRACT ||
-                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_MULTIPLY ||
-                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_DIVIDE ||
-                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_MODULO ||
-                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_POWER ||
-                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_AND ||
-                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_OR ||
-                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_XOR ||
-                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_SHIFTL ||
-                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_SHIFTR)) || tokens.size == 1)) {
-                hs_token_list_pop(&tokens);
-                char last_char = '-';
-                for (size_t j = 0; last_char != '\0'; j++) {
-                    char temp = token_lit.content[j];
-                    token_lit.content[j] = last_char;
-                    last_char = temp;
-                }
-            }
-            if (!hs_token_list_push(&tokens, token_lit))
-                goto hs_tokenize_error;
-        } else if (input[i] >= 'a' && input[i] <= 'z') {
-            hs_token_t token_id = {.kind = HS_TOKEN_ID};
-            size_t token_start = i;
-            while (((input[i] >= '0' && input[i] <= '9') || (input[i] >= 'a' && input[i] <= 'z') || input[i] == '_') && i - token_start < HS_BUF_SIZE - 1) {
-                token_id.content[i - token_start] = input[i];
-                i++;
+    char *name = names;
+    for (size_t c = 0; c < columns.count; c++) {
+        size_t length = 0;
+        while (name[length] != '\0' && name[length] != ',')
+            length++;
+        bool last = name[length] == '\0';
+        name[length] = '\0';
+        // names are case insensitive like everything else the user types
+        for (size_t i = 0; i < length; i++) {
+            if (name[i] >= 'A' && name[i] <= 'Z')
+                name[i] += 'a' - 'A';
+        }
+        columns.names[c] = NULL;
+        if (length > 0) {
+            columns.names[c] = name;
+            if (!hs_var_set(state, name, (hs_value_t){.re = 0, .im = 0})) {
+                printf("ERROR: invalid column name %s" ENDL, name);
+                goto hs_columns_done;
             }
-            token_id.content[i - token_start] = '\0';
-            i--;
-            if (!hs_token_list_push(&tokens, token_id))
-                goto hs_tokenize_error;
+        }
+        if (!last)
+            name += length + 1;
+    }
+
+    const char *error;
+    columns.expr = hs_compile(state, expression, &error);
+    if (error != NULL)
+        fputs(error, stdout);
+    if (columns.expr == NULL)
+        goto hs_columns_done;
+
+    if (path != NULL && strcmp(path, "-") != 0) {
+        file = fopen(path, "rb");
+        if (file == NULL) {
+            printf("ERROR: could not open %s" ENDL, path);
+            goto hs_columns_done;
         }
     }
-    if (!hs_token_list_push(&tokens, (hs_token_t){.kind = HS_TOKEN_EOF}))
-        goto hs_tokenize_error;
+    size_t lines = 0;
+    if (hs_read_lines(file, hs_columns_row, &columns, &lines))
+        result = 0;
 
-    return tokens;
-
-hs_tokenize_error:
-    return tokens;
+hs_columns_done:
+    if (file != stdin)
+        fclose(file);
+    hs_expr_free(columns.expr);
+    free(columns.names);
+    return result;
 }
 
-bool hs_is_op(hs_token_kind_t kind) {
-    switch (kind) {
-        case HS_TOKEN_ADD:
-        case HS_TOKEN_SUBTRACT:
-        case HS_TOKEN_MULTIPLY:
-        case HS_TOKEN_DIVIDE:
-        case HS_TOKEN_MODULO:
-        case HS_TOKEN_POWER:
-        case HS_TOKEN_AND:
-        case HS_TOKEN_OR:
-        case HS_TOKEN_XOR:
-        case HS_TOKEN_SHIFTL:
-        case HS_TOKEN_SHIFTR:
-            return true;
-        default:
+#if HS_SERVER
+typedef struct hs_conn {
+    int fd;
+    // session of this client on top of the shared base
+    hs_state_t *state;
+    char *in;
+    size_t in_size;
+    size_t in_capacity;
+    char *out;
+    size_t out_size;
+    size_t out_capacity;
+    size_t out_sent;
+    // the client shut down its side, the connection is closed once all answers are sent
+    bool eof;
+    bool failed;
+} hs_conn_t;
+
+bool hs_buffer_append(char **data, size_t *size, size_t *capacity, const char *append, size_t length) {
+    if (*size + length > *capacity) {
+        size_t new_capacity = *capacity > 0 ? *capacity : HS_SERVER_BUFFER_SIZE;
+        while (*size + length > new_capacity)
+            new_capacity *= 2;
+        char *new_data = realloc(*data, new_capacity);
+        if (new_data == NULL)
             return false;
+        *data = new_data;
+        *capacity = new_capacity;
     }
+    memcpy(*data + *size, append, length);
+    *size += length;
+    return true;
 }
 
-int8_t hs_op_prio(hs_token_kind_t kind) {
-    switch (kind) {
-        case HS_TOKEN_OR:
-            return 0;
-        case HS_TOKEN_XOR:
-            return 1;
-        case HS_TOKEN_AND:
-            return 2;
-        case HS_TOKEN_SHIFTL:
-        case HS_TOKEN_SHIFTR:
-            return 3;
-        case HS_TOKEN_ADD:
-        case HS_TOKEN_SUBTRACT:
-            return 4;
-        case HS_TOKEN_MULTIPLY:
-        case HS_TOKEN_DIVIDE:
-        case HS_TOKEN_MODULO:
-            return 5;
-        case HS_TOKEN_POWER:
-            return 6;
-        default:
-            return -1;
-    }
+void hs_conn_write(const char *data, size_t size, void *context) {
+    hs_conn_t *conn = context;
+    if (!hs_buffer_append(&conn->out, &conn->out_size, &conn->out_capacity, data, size))
+        conn->failed = true;
 }
 
-hs_token_list_t hs_shunting_yard(hs_token_list_t tokens) {
-    size_t input_i = 0;
-    hs_token_list_t output = hs_token_list_init();
-    hs_token_list_t stack = hs_token_list_init();
-
-    if (output.items == NULL)
-        goto hs_shunting_yard_error;
-    if (stack.items == NULL)
-        goto hs_shunting_yard_error;
+void hs_conn_free(hs_conn_t *conn) {
+    close(conn->fd);
+    hs_state_destroy(conn->state);
+    free(conn->in);
+    free(conn->out);
+    free(conn);
+}
 
-    int32_t last_value = -2;
-    while (input_i < tokens.size) {
-        switch (tokens.items[input_i].kind) {
-            case HS_TOKEN_LIT_DEC:
-            case HS_TOKEN_LIT_BIN:
-            case HS_TOKEN_LIT_OCT:
-            case HS_TOKEN_LIT_HEX:
-            case HS_TOKEN_ID:
-                if (tokens.items[input_i].kind == HS_TOKEN_ID) {
-                    if (tokens.items[input_i + 1].kind == HS_TOKEN_OPEN_P) {
-                        // function call
-                        if (!hs_token_list_push(&stack, tokens.items[input_i]))
-                            goto hs_shunting_yard_error;
-                        break;
-                    } else {
-                        tokens.items[input_i].kind = HS_TOKEN_ID_IS_VAR;
-                        if (last_value == input_i - 1) {
-                            // implied multiplication
-                            while (stack.size > 0 &&
-                                   hs_is_op(stack.items[stack.size - 1].kind) &&
-                                   hs_op_prio(HS_TOKEN_MULTIPLY) <= hs_op_prio(stack.items[stack.size - 1].kind)) {
-                                // TODO: except for exponent, possibly
-                                if (!hs_token_list_push(&output, hs_token_list_pop(&stack)))
-                                    goto hs_shunting_yard_error;
-                            }
-                            if (!hs_token_list_push(&stack, (hs_token_t){.kind = HS_TOKEN_MULTIPLY}))
-                                goto hs_shunting_yard_error;
-                        }
-                    }
-                } else {
-                    last_value = input_i;
-                }
-                // var or value
-                if (!hs_token_list_push(&output, tokens.items[input_i]))
-                    goto hs_shunting_yard_error;
-                break;
-            case HS_TOKEN_COMMA:
-                if (stack.size == 0) {
-                    printf("ERROR: unexpected comma" ENDL);
-                    goto hs_shunting_yard_error;
-                }
-                while (stack.items[stack.size - 1].kind != HS_TOKEN_OPEN_P) {
-                    if (!hs_token_list_push(&output, hs_token_list_pop(&stack)))
-                        goto hs_shunting_yard_error;
-                    if (stack.size == 0) {
-                        printf("ERROR: unexpected comma" ENDL);
-                        goto hs_shunting_yard_error;
-                    }
-                }
-                break;
-            case HS_TOKEN_ADD:
-            case HS_TOKEN_SUBTRACT:
-            case HS_TOKEN_MULTIPLY:
-            case HS_TOKEN_DIVIDE:
-            case HS_TOKEN_MODULO:
-            case HS_TOKEN_POWER:
-            case HS_TOKEN_AND:
-            case HS_TOKEN_OR:
-            case HS_TOKEN_XOR:
-            case HS_TOKEN_SHIFTL:
-            case HS_TOKEN_SHIFTR:
-                while (stack.size > 0 &&
-                       hs_is_op(stack.items[stack.size - 1].kind) &&
-                       hs_op_prio(tokens.items[input_i].kind) <= hs_op_prio(stack.items[stack.size - 1].kind)) {
-                    // TODO: except for exponent, possibly
-                    if (!hs_token_list_push(&output, hs_token_list_pop(&stack)))
-                        goto hs_shunting_yard_error;
-                }
-                if (!hs_token_list_push(&stack, tokens.items[input_i]))
-                    goto hs_shunting_yard_error;
-                break;
-            case HS_TOKEN_OPEN_P:
-                if (last_value == input_i - 1) {
-                    // implied multiplication
-                    while (stack.size > 0 &&
-                           hs_is_op(stack.items[stack.size - 1].kind) &&
-                           hs_op_prio(HS_TOKEN_MULTIPLY) <= hs_op_prio(stack.items[stack.size - 1].kind)) {
-                        // TODO: except for exponent, possibly
-                        if (!hs_token_list_push(&output, hs_token_list_pop(&stack)))
-                            goto hs_shunting_yard_error;
-                    }
-                    if (!hs_token_list_push(&stack, (hs_token_t){.kind = HS_TOKEN_MULTIPLY}))
-                        goto hs_shunting_yard_error;
-                }
-                if (!hs_token_list_push(&stack, tokens.items[input_i]))
-                    goto hs_shunting_yard_error;
-                break;
-            case HS_TOKEN_CLOSE_P:
-                if (stack.size == 0) {
-                    printf("ERROR: closing parenthesis without opening one" ENDL);
-                    goto hs_shunting_yard_error;
-                }
-                while (stack.items[stack.size - 1].kind != HS_TOKEN_OPEN_P) {
-                    if (stack.size == 0) {
-                        printf("ERROR: closing parenthesis without opening one" ENDL);
-                        goto hs_shunting_yard_error;
-                    }
-                    if (!hs_token_list_push(&output, hs_token_list_pop(&stack)))
-                        goto hs_shunting_yard_error;
-                }
-                hs_token_list_pop(&stack);
-                if (stack.size > 0 && stack.items[stack.size - 1].kind == HS_TOKEN_ID) {
-                    if (!hs_token_list_push(&output, hs_token_list_pop(&stack)))
-                        goto hs_shunting_yard_error;
-                }
-                break;
-            case HS_TOKEN_EOF:
-            default:
+// runs every complete line received so far, each answer is terminated by '\0'.
+// stops early while too many answers wait for the client to read them
+void hs_conn_process(hs_conn_t *conn) {
+    size_t line_start = 0;
+    while (line_start < conn->in_size && conn->out_size - conn->out_sent < HS_SERVER_MAX_PENDING) {
+        char *line = conn->in + line_start;
+        char *newline = memchr(line, '\n', conn->in_size - line_start);
+        if (newline == NULL) {
+            // the last line does not need a newline
+            if (!conn->eof)
                 break;
+            newline = conn->in + conn->in_size;
         }
-        input_i++;
-    }
-    while (stack.size > 0) {
-        hs_token_t stack_token = hs_token_list_pop(&stack);
-        if (!hs_token_list_push(&output, stack_token))
-            goto hs_shunting_yard_error;
-    }
-
-    free(stack.items);
-
-    return output;
-
-hs_shunting_yard_error:
-    if (stack.items != NULL)
-        free(stack.items);
-
-    return output;
-}
-
-typedef struct hs_value_list {
-    hs_value_t *items;
-    size_t capacity;
-    size_t size;
-} hs_value_list_t;
-
-hs_value_list_t hs_rpn_list_init() {
-    hs_value_list_t list = {
-        .items = malloc(sizeof(hs_value_t)),
-        .capacity = 1,
-        .size = 0,
-    };
-    if (list.items == NULL) {
-        printf("ERROR: out of memory during value list initialization :(" ENDL);
-        return list;
-    }
-    return list;
-}
-
-bool hs_value_list_push(hs_value_list_t *list, hs_value_t item) {
-    if (list->size >= list->capacity) {
-        list->capacity *= 2;
-        list->items = realloc(list->items, list->capacity * sizeof(hs_value_t));
-        if (list->items == NULL) {
-            printf("ERROR: out of memory during value list reallocation at " SIZE_T_F " items :(" ENDL, list->size);
+        *newline = '\0';
+        if (newline > line && newline[-1] == '\r')
+            newline[-1] = '\0';
+        line_start = newline - conn->in + 1;
+        if (line_start > conn->in_size)
+            line_start = conn->in_size;
+        hs_run(conn->state, line);
+        hs_flush(conn->state);
+        hs_conn_write("", 1, conn);
+    }
+    if (line_start > 0)
+        memmove(conn->in, conn->in + line_start, conn->in_size - line_start);
+    conn->in_size -= line_start;
+}
+
+// sends as much of the answers as the socket takes, false if the connection is broken
+bool hs_conn_send(hs_conn_t *conn) {
+    while (conn->out_sent < conn->out_size) {
+        ssize_t sent = send(conn->fd, conn->out + conn->out_sent, conn->out_size - conn->out_sent, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return true;
+            if (errno == EINTR)
+                continue;
             return false;
         }
+        conn->out_sent += sent;
     }
-    if (list->items == NULL) {
-        return false;
-    }
-    list->items[list->size++] = item;
+    conn->out_size = 0;
+    conn->out_sent = 0;
     return true;
 }
 
-hs_value_t hs_value_list_pop(hs_value_list_t *list) {
-    if (list->size > 0 && list->items != NULL) {
-        list->size--;
-        return list->items[list->size];
-    } else {
-        printf("WARNING: missing some expected value" ENDL);
-        return HS_ZERO;
-    }
-}
-
-bool hs_str_same(char *a, char *b) {
-    size_t i = 0;
-    while (a[i] != '\0' && b[i] != '\0') {
-        if (a[i] != b[i]) {
+// false if the connection is done, either broken or closed by the client with everything answered.
+// reads until the socket has nothing more (the socket is edge triggered) unless the client is slow reading answers
+bool hs_conn_handle(hs_conn_t *conn) {
+    while (true) {
+        hs_conn_process(conn);
+        if (conn->failed || !hs_conn_send(conn))
             return false;
+        if (conn->out_size - conn->out_sent >= HS_SERVER_MAX_PENDING)
+            return true;
+        if (conn->eof)
+            return conn->in_size > 0 || conn->out_size > 0;
+        if (conn->in_capacity - conn->in_size < HS_SERVER_BUFFER_SIZE) {
+            // everything left is part of one line, a line this long is no expression
+            if (conn->in_capacity >= HS_SERVER_MAX_LINE)
+                return false;
+            size_t capacity = conn->in_capacity > 0 ? conn->in_capacity * 2 : HS_SERVER_BUFFER_SIZE * 2;
+            char *in = realloc(conn->in, capacity);
+            if (in == NULL)
+                return false;
+            conn->in = in;
+            conn->in_capacity = capacity;
         }
-        i++;
-    }
-    return a[i] == '\0' && b[i] == '\0';
-}
-
-size_t hs_str_len(char *a) {
-    size_t i = 0;
-    while (a[i] != '\0')
-        i++;
-    return i;
-}
-
-hs_value_t hs_solve(hs_token_list_t tokens, hs_state_t *state) {
-    hs_value_list_t list = hs_rpn_list_init();
-    hs_value_t result = HS_ZERO;
-
-    if (list.items == NULL)
-        goto hs_solve_error;
-
-    for (size_t i = 0; i < tokens.size; i++) {
-        hs_value_t a, b;
-
-        switch (tokens.items[i].kind) {
-            case HS_TOKEN_LIT_DEC:
-            case HS_TOKEN_LIT_BIN:
-            case HS_TOKEN_LIT_OCT:
-            case HS_TOKEN_LIT_HEX: {
-                hs_value_t lit_value = HS_ZERO;
-                int base = 0;
-                if (tokens.items[i].kind == HS_TOKEN_LIT_DEC) {
-                    base = 10;
-                } else if (tokens.items[i].kind == HS_TOKEN_LIT_BIN) {
-                    base = 2;
-                } else if (tokens.items[i].kind == HS_TOKEN_LIT_OCT) {
-                    base = 8;
-                } else if (tokens.items[i].kind == HS_TOKEN_LIT_HEX) {
-                    base = 16;
-                }
-                bool frac = false;
-                double frac_fac = 1.0 / base;
-                bool negative = false;
-                size_t j = 0;
-                if (tokens.items[i].content[0] == '-') {
-                    negative = true;
-                    j++;
-                }
-
-                for (; j < HS_BUF_SIZE && tokens.items[i].content[j] != '\0'; j++) {
-                    if (tokens.items[i].content[j] >= '0' && tokens.items[i].content[j] <= '9') {
-                        if (!frac) {
-                            lit_value = hs_f_multiply(lit_value, (hs_value_t){.re = base, .im = 0});
-                            lit_value = hs_f_add(lit_value, (hs_value_t){.re = tokens.items[i].content[j] - '0', .im = 0});
-                        } else {
-                            lit_value = hs_f_add(lit_value, (hs_value_t){.re = frac_fac * (double)(tokens.items[i].content[j] - '0'), .im = 0});
-                            frac_fac /= (double)base;
-                        }
-                    } else if (tokens.items[i].content[j] >= 'a' && tokens.items[i].content[j] <= 'z' && base == 16) {
-                        if (!frac) {
-                            lit_value = hs_f_multiply(lit_value, (hs_value_t){.re = base, .im = 0});
-                            lit_value = hs_f_add(lit_value, (hs_value_t){.re = tokens.items[i].content[j] - 'a' + 10, .im = 0});
-                        } else {
-                            lit_value = hs_f_add(lit_value, (hs_value_t){.re = frac_fac * (double)(tokens.items[i].content[j] - 'a' + 10), .im = 0});
-                            frac_fac /= (double)base;
-                        }
-                    } else if (tokens.items[i].content[j] == state->settings.dec_sep_char_in) {
-                        frac = true;
-                    } else if (tokens.items[i].content[j] != state->settings.sep_char_in) {
-                        printf("WARNING: unexpected token \"%c\" in literal" ENDL, tokens.items[i].content[j]);
-                    }
-                }
-                if (negative)
-                    lit_value = (hs_value_t){.re = -lit_value.re, .im = -lit_value.im};
-                if (!hs_value_list_push(&list, lit_value))
-                    goto hs_solve_error;
-                break;
-            }
-            case HS_TOKEN_ID_IS_VAR: {
-                bool var_found = false;
-                for (size_t j = 0; j < state->context_vars_length; j++) {
-                    if (hs_str_same(tokens.items[i].content, state->context_vars[j].id)) {
-                        if (!hs_value_list_push(&list, state->context_vars[j].value))
-                            goto hs_solve_error;
-                        var_found = true;
-                        break;
-                    }
-                }
-                if (!var_found) {
-                    printf("ERROR: var %s not found" ENDL, tokens.items[i].content);
-                    goto hs_solve_error;
-                }
-                break;
-            }
-            case HS_TOKEN_ID: {
-                bool function_found = false;
-                for (size_t j = 0; j < state->context_funcs_length; j++) {
-                    if (hs_str_same(tokens.items[i].content, state->context_funcs[j].id)) {
-                        hs_value_t return_value;
-                        if (state->context_funcs[j].func == NULL) {
-                            hs_state_t call_state = *state;
-                            call_state.context_vars = malloc(call_state.context_vars_length * sizeof(hs_var_t));
-                            for (size_t k = 0; k < call_state.context_vars_length; k++) {
-                                for (size_t l = 0; l < HS_BUF_SIZE; l++) {
-                                    call_state.context_vars[k].id[l] = state->context_vars[k].id[l];
-                                    if (call_state.context_vars[k].id[l] == '\0')
-                                        break;
-                                }
-                                call_state.context_vars[k].value = state->context_vars[k].value;
-                            }
-
-                            for (uint8_t k = 0; k < state->context_funcs[j].params_count; k++) {
-                                hs_func_param_t *param = state->context_funcs[j].params_linked;
-                                for (uint8_t l = 0; l < state->context_funcs[j].params_count - k - 1; l++) {
-                                    if (param->next == NULL) {
-                                        printf("ERROR: incorrect number of arguments for %s. expected %hhu" ENDL, state->context_funcs[j].id, state->context_funcs[j].params_count);
-                                        goto hs_solve_error;
-                                    }
-                                    param = param->next;
-                                }
-                                hs_var_t new_var = {
-                                    .value = hs_value_list_pop(&list),
-                                };
-                                for (size_t l = 0; l < HS_BUF_SIZE; l++) {
-                                    new_var.id[l] = param->id[l];
-                                    if (new_var.id[l] == '\0')
-                                        break;
-                                }
-                                hs_vars_push(&call_state, new_var);
-                            }
-
-                            char *exp_input = malloc(hs_str_len(state->context_funcs[j].expression) + 1);
-                            for (size_t k = 0; k < hs_str_len(state->context_funcs[j].expression) + 1; k++) {
-                                exp_input[k] = state->context_funcs[j].expression[k];
-                            }
-                            hs_preprocess_input(exp_input);
-                            hs_token_list_t tokens1 = hs_tokenize(exp_input, &call_state);
-                            free(exp_input);
-                            if (tokens1.items == NULL)
-                                goto hs_solve_error;
-                            hs_token_list_t tokens2 = hs_shunting_yard(tokens1);
-                            free(tokens1.items);
-                            if (tokens2.items == NULL)
-                                goto hs_solve_error;
-                            if (tokens2.size > 0) {
-                                return_value = hs_solve(tokens2, &call_state);
-                            }
-                            free(tokens2.items);
-
-                            free(call_state.context_vars);
-                        } else {
-                            if (state->context_funcs[j].params_count == 1) {
-                                a = hs_value_list_pop(&list);
-                                return_value = state->context_funcs[j].func(a, HS_ZERO);
-                            } else {
-                                b = hs_value_list_pop(&list);
-                                a = hs_value_list_pop(&list);
-                                return_value = state->context_funcs[j].func(a, b);
-                            }
-                        }
-                        if (!hs_value_list_push(&list, return_value))
-                            goto hs_solve_error;
-                        function_found = true;
-                        break;
-                    }
-                }
-                if (!function_found) {
-                    printf("ERROR: function %s not found" ENDL, tokens.items[i].content);
-                    goto hs_solve_error;
-                }
-                break;
-            }
-            case HS_TOKEN_COMMA:
-                printf("ERROR: comma made it to rpn?" ENDL);
-                goto hs_solve_error;
-            case HS_TOKEN_ADD:
-                b = hs_value_list_pop(&list);
-                a = hs_value_list_pop(&list);
-                if (!hs_value_list_push(&list, hs_f_add(a, b)))
-                    goto hs_solve_error;
-                break;
-            case HS_TOKEN_SUBTRACT:
-                b = hs_value_list_pop(&list);
-                a = hs_value_list_pop(&list);
-                if (!hs_value_list_push(&list, hs_f_subtract(a, b)))
-                    goto hs_solve_error;
-                break;
-            case HS_TOKEN_MULTIPLY:
-                b = hs_value_list_pop(&list);
-                a = hs_value_list_pop(&list);
-                if (!hs_value_list_push(&list, hs_f_multiply(a, b)))
-                    goto hs_solve_error;
-                break;
-            case HS_TOKEN_DIVIDE:
-                b = hs_value_list_pop(&list);
-                a = hs_value_list_pop(&list);
-                if (!hs_value_list_push(&list, hs_f_divide(a, b)))
-                    goto hs_solve_error;
-                break;
-            case HS_TOKEN_MODULO:
-                b = hs_value_list_pop(&list);
-                a = hs_value_list_pop(&list);
-                if (!hs_value_list_push(&list, hs_f_modulo(a, b)))
-                    goto hs_solve_error;
-                break;
-            case HS_TOKEN_POWER:
-                b = hs_value_list_pop(&list);
-                a = hs_value_list_pop(&list);
-                if (!hs_value_list_push(&list, hs_f_pow(a, b)))
-                    goto hs_solve_error;
-                break;
-            case HS_TOKEN_AND:
-                b = hs_value_list_pop(&list);
-                a = hs_value_list_pop(&list);
-                if (!hs_value_list_push(&list, hs_f_and(a, b)))
-                    goto hs_solve_error;
-                break;
-            case HS_TOKEN_OR:
-                b = hs_value_list_pop(&list);
-                a = hs_value_list_pop(&list);
-                if (!hs_value_list_push(&list, hs_f_or(a, b)))
-                    goto hs_solve_error;
-                break;
-            case HS_TOKEN_XOR:
-                b = hs_value_list_pop(&list);
-                a = hs_value_list_pop(&list);
-                if (!hs_value_list_push(&list, hs_f_xor(a, b)))
-                    goto hs_solve_error;
-                break;
-            case HS_TOKEN_SHIFTL:
-                b = hs_value_list_pop(&list);
-                a = hs_value_list_pop(&list);
-                if (!hs_value_list_push(&list, hs_f_shiftl(a, b)))
-                    goto hs_solve_error;
-                break;
-            case HS_TOKEN_SHIFTR:
-                b = hs_value_list_pop(&list);
-                a = hs_value_list_pop(&list);
-                if (!hs_value_list_push(&list, hs_f_shiftr(a, b)))
-                    goto hs_solve_error;
-                break;
-            default:
-                break;
-        }
-    }
-
-    if (list.size == 0) {
-        printf("ERROR: something went wrong during rpn calculation" ENDL);
-        goto hs_solve_error;
-    } else {
-        if (list.size > 1) {
-            printf("WARNING: multiple entries left at end of rpn, which is slightly odd" ENDL);
-        }
-        result = hs_value_list_pop(&list);
-    }
-
-    free(list.items);
-
-    return result;
-
-hs_solve_error:
-    if (list.size > 0 && list.items != NULL)
-        result = hs_value_list_pop(&list);
-    printf("(possibly erroneous) ");
-
-    free(list.items);
-
-    return result;
-}
-
-char hs_1dim_out_buf[64];
-
-void hs_output_1dim_f(double value, hs_state_t *state, int8_t max_digits) {
-    uint32_t hs_1dim_i = 0;
-
-    if (max_digits < 0) {
-        max_digits = HS_MAX_FRAC_DIGITS;
-    }
-
-    if (value <= -HS_EPSILON) {
-        putchar('-');
-        value = -value;
-    }
-    double log_base_2 = 1.0;
-    uint8_t sep_spacing = 4;
-    switch (state->settings.output_mode) {
-        case HS_OUTPUT_HEX:
-            putchar('0');
-            putchar('x');
-            log_base_2 = 1.0 / 4.0;
-            sep_spacing = 2;
-            break;
-        case HS_OUTPUT_OCT:
-            putchar('0');
-            putchar('o');
-            log_base_2 = 1.0 / 3.0;
-            sep_spacing = 2;
-            break;
-        case HS_OUTPUT_DEC:
-            log_base_2 = 0.301029995664;
-            sep_spacing = 3;
-            break;
-        case HS_OUTPUT_BIN:
-            putchar('0');
-            putchar('b');
-            log_base_2 = 1.0;
-            sep_spacing = 4;
-            break;
-    }
-    int32_t highest_digit = (int32_t)(log2(value) * log_base_2) + 1;
-    if (highest_digit < 0) {
-        highest_digit = 0;
-    }
-    if (state->settings.output_mode == HS_OUTPUT_BIN) {
-        highest_digit = (highest_digit + 3) / 4 * 4 - 1;
-    }
-    double value_of_digit = pow((int)state->settings.output_mode, highest_digit);
-    bool has_trailing = false;
-    for (int32_t i = highest_digit; (fabs(value) >= HS_EPSILON && i > -max_digits - 1) || i >= 0; i--) {
-        int digit = (int)(value / value_of_digit + 0.001);
-        if (digit >= 0 && digit < 10) {
-            hs_1dim_out_buf[hs_1dim_i++] = '0' + digit;
-        } else if (digit >= 0 && digit < 16) {
-            hs_1dim_out_buf[hs_1dim_i++] = 'A' + digit - 10;
+        ssize_t received = recv(conn->fd, conn->in + conn->in_size, conn->in_capacity - conn->in_size, 0);
+        if (received < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return true;
+            if (errno != EINTR)
+                return false;
+        } else if (received == 0) {
+            conn->eof = true;
         } else {
-            break;
-        }
-        value -= digit * value_of_digit;
-        if (i == 0) {
-            hs_1dim_out_buf[hs_1dim_i++] = state->settings.dec_sep_char_out;
-            has_trailing = true;
-        } else if (i % sep_spacing == 0 && i > 0 && state->settings.sep_out) {
-            hs_1dim_out_buf[hs_1dim_i++] = state->settings.sep_char_out;
-        }
-        value_of_digit /= (int)state->settings.output_mode;
-    }
-    hs_1dim_out_buf[hs_1dim_i] = '\0';
-
-    if (has_trailing) {
-        for (hs_1dim_i--; hs_1dim_i > 0; hs_1dim_i--) {
-            if (hs_1dim_out_buf[hs_1dim_i] != '0' && hs_1dim_out_buf[hs_1dim_i] != state->settings.sep_char_out) {
-                if (hs_1dim_out_buf[hs_1dim_i] == state->settings.dec_sep_char_out) {
-                    hs_1dim_i--;
-                }
-                break;
-            }
-        }
-    }
-
-    size_t trailing_zeros_start = hs_1dim_i;
-    bool leading_done = false;
-    if (state->settings.output_mode == HS_OUTPUT_BIN) {
-        leading_done = true;
-    }
-    bool output_empty = true;
-    for (hs_1dim_i = 0; hs_1dim_i <= trailing_zeros_start; hs_1dim_i++) {
-        if ((hs_1dim_out_buf[hs_1dim_i] != '0' && hs_1dim_out_buf[hs_1dim_i] != state->settings.sep_char_out) || leading_done) {
-            putchar(hs_1dim_out_buf[hs_1dim_i]);
-            output_empty = false;
-            leading_done = true;
+            conn->in_size += received;
         }
     }
-    if (output_empty)
-        putchar('0');
 }
 
-void hs_output_1dim(double value, hs_state_t *state) {
-    if (fabs(value) < 1e-15) {
-        putchar('0');
-    } else if ((fabs(value) < state->settings.scient_min || fabs(value) >= state->settings.scient_max) && state->settings.output_mode == HS_OUTPUT_DEC) {
-        // scientific output
-        int16_t expo = floor(log10(value) / 3.0) * 3;
-        hs_output_1dim_f(value / pow(10, expo), state, 3);
-        putchar(' ');
-        putchar('*');
-        putchar(' ');
-        putchar('1');
-        putchar('0');
-        putchar('^');
-        hs_output_1dim_f(expo, state, 0);
-    } else {
-        // normal output
-        hs_output_1dim_f(value, state, -1);
+// serves sessions over a unix domain socket at path, every line a client sends is run like at the prompt
+// and answered with its output followed by '\0'. clients may send many lines without waiting for the answers
+int hs_serve(char *path, hs_state_t *state) {
+    hs_shared_t *shared = hs_shared_create(state);
+    if (shared == NULL) {
+        printf("ERROR: out of memory during initialization :(" ENDL);
+        return 1;
     }
-}
-
-void hs_output(hs_value_t value, hs_state_t *state) {
-    if (fabs(value.im) < HS_EPSILON) {
-        hs_output_1dim(value.re, state);
-    } else {
-        putchar('(');
-        hs_output_1dim(value.re, state);
-        putchar(' ');
-        if (value.im <= -HS_EPSILON) {
-            value.im = -value.im;
-            putchar('-');
-        } else {
-            putchar('+');
-        }
-        putchar(' ');
-        hs_output_1dim(value.im, state);
-        putchar('i');
-        putchar(')');
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        printf("ERROR: socket path %s is too long" ENDL, path);
+        hs_shared_destroy(shared);
+        return 1;
     }
-}
+    strcpy(address.sun_path, path);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    int epoll = epoll_create1(0);
+    unlink(path);
+    if (listener < 0 || epoll < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0
+        || listen(listener, SOMAXCONN) != 0 || fcntl(listener, F_SETFL, O_NONBLOCK) != 0) {
+        printf("ERROR: could not listen on %s: %s" ENDL, path, strerror(errno));
+        if (listener >= 0)
+            close(listener);
+        if (epoll >= 0)
+            close(epoll);
+        hs_shared_destroy(shared);
+        return 1;
+    }
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+    epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &event);
+    fprintf(stderr, "listening on %s" ENDL, path);
 
-uint8_t hs_handle_commands(hs_token_list_t *tokens1, hs_token_list_t *tokens2, bool *is_number_base, hs_state_t *state) {
-    for (size_t i = 0; i < tokens1->size; i++) {
-        if (tokens1->items[i].kind == HS_TOKEN_ID) {
-            if (hs_str_same(tokens1->items[i].content, "help")) {
-                printf(help_text);
+    struct epoll_event events[HS_SERVER_EVENTS];
+    while (true) {
+        int count = epoll_wait(epoll, events, HS_SERVER_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR)
                 continue;
-            } else if (hs_str_same(tokens1->items[i].content, "list")) {
-                size_t len_func = 0;
-                size_t len_var = 0;
-                
-                for (size_t j = 0; j < state->context_funcs_length; j++) {
-                    size_t len = 3;
-                    len += hs_str_len(state->context_funcs[j].id);
-
-                    hs_func_param_t *param = state->context_funcs[j].params_linked;
-                    for (uint8_t p = 0; p < state->context_funcs[j].params_count; p++) {
-                        if (param == NULL) {
-                            len++;
-                        } else {
-                            len += hs_str_len(param->id);
-                            param = param->next;
-                        }
-                        if (p < state->context_funcs[j].params_count - 1) {
-                            len += 2;
-                        }
-                    }
-                    if (state->context_funcs[j].expression != NULL) {
-                        size_t exp_len = hs_str_len(state->context_funcs[j].expression);
-                        if (exp_len > HS_MAX_EXP_LIST_LEN) {
-                            len += HS_MAX_EXP_LIST_LEN + 6;
-                        } else {
-                            len += exp_len + 3;
-                        }
-                    }
-                    
-                    len_func = len > len_func ? len : len_func;
-                }
-                for (size_t j = 0; j < state->context_vars_length; j++) {
-                    size_t len = hs_str_len(state->context_vars[j].id) + 2;
-                    len_var = len > len_var ? len : len_var;
-                }
-
-                const char *funcs = "FUNCS";
-                const char *vars = "VARS";
-                printf("--%s", funcs);
-                for (size_t s = 0; s <= len_func - (hs_str_len((char *)funcs) + 2); s++) {
-                    putchar('-');
-                }
-                printf("-|--%s", vars);
-                for (size_t s = 0; s <= len_var + 2 + HS_MAX_FRAC_DIGITS - hs_str_len((char *)vars); s++) {
-                    putchar('-');
-                }
-                printf(ENDL);
-
-                for (size_t j = 0; j < state->context_vars_length || j < state->context_funcs_length; j++) {
-                    if (j < state->context_funcs_length) {
-                        size_t len = 3;
-                        printf("  %s(", state->context_funcs[j].id);
-                        len += hs_str_len(state->context_funcs[j].id);
-    
-                        hs_func_param_t *param = state->context_funcs[j].params_linked;
-                        for (uint8_t p = 0; p < state->context_funcs[j].params_count; p++) {
-                            if (param == NULL) {
-                                putchar('a' + p);
-                                len++;
-                            } else {
-                                printf("%s", param->id);
-                                len += hs_str_len(param->id);
-                                param = param->next;
-                            }
-                            if (p < state->context_funcs[j].params_count - 1) {
-                                putchar(',');
-                                putchar(' ');
-                                len += 2;
-                            }
-                        }
-                        putchar(')');
-                        if (state->context_funcs[j].expression != NULL) {
-                            putchar(' ');
-                            putchar('=');
-                            putchar(' ');
-                            size_t exp_len = hs_str_len(state->context_funcs[j].expression);
-                            if (exp_len > HS_MAX_EXP_LIST_LEN) {
-                                for (size_t k = 0; k < HS_MAX_EXP_LIST_LEN; k++) {
-                                    putchar(state->context_funcs[j].expression[k]);
-                                }
-                                printf("...");
-                                len += HS_MAX_EXP_LIST_LEN + 6;
-                            } else {
-                                printf("%s", state->context_funcs[j].expression);
-                                len += exp_len + 3;
-                            }
-                        }
-                        for (size_t s = 0; s <= len_func - len; s++) {
-                            putchar(' ');
-                        }
-                    } else {
-                        for (size_t s = 0; s <= len_func + 1; s++) {
-                            putchar(' ');
-                        }
-                    }
-                    putchar('|');
-                    if (j < state->context_vars_length) {
-                        printf("  %s", state->context_vars[j].id);
-                        for (size_t s = 0; s <= len_var - (hs_str_len(state->context_vars[j].id) + 2); s++) {
-                            putchar(' ');
-                        }
-                        putchar('=');
-                        putchar(' ');
-                        hs_output(state->context_vars[j].value, state);
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            hs_conn_t *conn = events[i].data.ptr;
+            if (conn == NULL) {
+                int fd;
+                while ((fd = accept(listener, NULL, NULL)) >= 0) {
+                    conn = calloc(1, sizeof(hs_conn_t));
+                    hs_state_t *session = hs_state_create_shared(shared);
+                    if (conn == NULL || session == NULL || fcntl(fd, F_SETFL, O_NONBLOCK) != 0) {
+                        close(fd);
+                        free(conn);
+                        hs_state_destroy(session);
+                        continue;
                     }
-                    printf(ENDL);
+                    conn->fd = fd;
+                    conn->state = session;
+                    hs_set_output_callback(session, hs_conn_write, conn);
+                    // clients must not read or write files of the server
+                    hs_set_files(session, false);
+                    event = (struct epoll_event){.events = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP, .data.ptr = conn};
+                    if (epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) != 0)
+                        hs_conn_free(conn);
                 }
                 continue;
-            } else if (hs_str_same(tokens1->items[i].content, "settings")) {
-                printf("--SETTINGS--" ENDL);
-                printf("  scient_min = %f" ENDL, state->settings.scient_min);
-                printf("  scient_max = %f" ENDL, state->settings.scient_max);
-                printf("  dec_sep_char_in = %c" ENDL, state->settings.dec_sep_char_in);
-                printf("  dec_sep_char_out = %c" ENDL, state->settings.dec_sep_char_out);
-                printf("  sep_out = %i" ENDL, state->settings.sep_out ? 1 : 0);
-                printf("  sep_char_in = %c" ENDL, state->settings.sep_char_in);
-                printf("  sep_char_out = %c" ENDL, state->settings.sep_char_out);
-                continue;
-            } else if (hs_str_same(tokens1->items[i].content, "dec")) {
-                state->settings.output_mode = HS_OUTPUT_DEC;
-                if (is_number_base != NULL)
-                    *is_number_base = true;
-                continue;
-            } else if (hs_str_same(tokens1->items[i].content, "hex")) {
-                state->settings.output_mode = HS_OUTPUT_HEX;
-                if (is_number_base != NULL)
-                    *is_number_base = true;
-                continue;
-            } else if (hs_str_same(tokens1->items[i].content, "oct")) {
-                state->settings.output_mode = HS_OUTPUT_OCT;
-                if (is_number_base != NULL)
-                    *is_number_base = true;
-                continue;
-            } else if (hs_str_same(tokens1->items[i].content, "bin")) {
-                state->settings.output_mode = HS_OUTPUT_BIN;
-                if (is_number_base != NULL)
-                    *is_number_base = true;
-                continue;
+            }
+            if (!hs_conn_handle(conn)) {
+                epoll_ctl(epoll, EPOLL_CTL_DEL, conn->fd, NULL);
+                hs_conn_free(conn);
             }
         }
-        if (tokens2 != NULL)
-            if (!hs_token_list_push(tokens2, tokens1->items[i]))
-                return 1;
     }
 
-    return 0;
+    close(epoll);
+    close(listener);
+    unlink(path);
+    hs_shared_destroy(shared);
+    return 1;
 }
+#endif
 
-hs_settings_t temp_settings;
-
-void hs_run(char *input, hs_state_t *state) {
+int main(int argc, char *argv[]) {
+    hs_state_t *state = hs_state_create();
     if (state == NULL) {
-        return;
+        printf("ERROR: out of memory during initialization :(" ENDL);
+        return 1;
     }
+    hs_set_output_file(state, stdout);
 
-    hs_token_list_t tokens1 = {.items = NULL, .size = 0, .capacity = 0};
-    hs_token_list_t tokens2 = {.items = NULL, .size = 0, .capacity = 0};
-    hs_token_list_t tokens3 = {.items = NULL, .size = 0, .capacity = 0};
-
-    bool restore_settings = false;
-    temp_settings = state->settings;
-
-    hs_preprocess_input(input);
-
-    size_t lvalue_i = 0;
-    char lvalue_buffer[HS_BUF_SIZE];
-    for (; lvalue_i < sizeof(lvalue_buffer); lvalue_i++) {
-        if (input[lvalue_i] == '\0') {
-            lvalue_i = 0;
-            break;
-        } else if (input[lvalue_i] == '=') {
-            lvalue_buffer[lvalue_i] = '\0';
-            break;
-        } else {
-            lvalue_buffer[lvalue_i] = input[lvalue_i];
+    char *snapshot = NULL;
+#if !HS_FORCE_INTERACTIVE
+    // starts from the session saved in the file (if there is one), the prompt and single expressions save it back
+    if (argc > 2 && strcmp(argv[1], "--snapshot") == 0) {
+        snapshot = argv[2];
+        argv += 2;
+        argc -= 2;
+        FILE *file = fopen(snapshot, "rb");
+        if (file != NULL) {
+            fclose(file);
+            bool loaded = hs_snapshot_load(state, snapshot);
+            hs_flush(state);
+            if (!loaded) {
+                hs_state_destroy(state);
+                return 1;
+            }
         }
     }
-    hs_var_t lvalue_var = {
-        .id = "",
-        .value = HS_ZERO,
-    };
-    hs_func_t lvalue_func = {
-        .id = "",
-        .func = NULL,
-        .params_count = 0,
-        .params_linked = NULL,
-        .expression = "",
-    };
-    if (lvalue_i > 0) {
-        hs_token_list_t tokens_lvalue = hs_tokenize(lvalue_buffer, state);
-        if (tokens_lvalue.items == NULL)
-            goto hs_run_error;
-        hs_token_list_t tokens_lvalue2 = hs_token_list_init();
-        if (tokens_lvalue2.items == NULL)
-            goto hs_run_error;
-        if (hs_handle_commands(&tokens_lvalue, &tokens_lvalue2, &restore_settings, state) != 0)
-            goto hs_run_error;
-        free(tokens_lvalue.items);
-        if (tokens_lvalue2.size == 2) {
-            if (tokens_lvalue2.items[0].kind == HS_TOKEN_ID) {
-                for (size_t i = 0; i < HS_BUF_SIZE; i++) {
-                    lvalue_var.id[i] = tokens_lvalue2.items[0].content[i];
-                    if (lvalue_var.id[i] == '\0')
-                        break;
-                }
-            } else {
-                printf("WARNING: did not understand input left of \"=\", will be ignored" ENDL);
-            }
-        } else if (tokens_lvalue2.size > 2) {
-            if (tokens_lvalue2.items[0].kind == HS_TOKEN_ID &&
-                tokens_lvalue2.items[1].kind == HS_TOKEN_OPEN_P) {
-                lvalue_func.params_count = 0;
-                hs_func_param_t *param = NULL;
-                for (size_t t_i = 2; t_i < tokens_lvalue2.size; t_i += 2) {
-                    bool is_last = false;
-                    if (tokens_lvalue2.items[t_i].kind == HS_TOKEN_CLOSE_P) {
-                        break;
-                    }
-                    if (tokens_lvalue2.items[t_i].kind != HS_TOKEN_ID) {
-                        printf("ERROR: invalid format for function definition" ENDL);
-                        free(tokens_lvalue2.items);
-                        goto hs_run_error;
-                    }
-                    if (tokens_lvalue2.items[t_i + 1].kind == HS_TOKEN_CLOSE_P) {
-                        is_last = true;
-                    } else if (tokens_lvalue2.items[t_i + 1].kind != HS_TOKEN_COMMA) {
-                        printf("ERROR: invalid format for function definition" ENDL);
-                        free(tokens_lvalue2.items);
-                        goto hs_run_error;
-                    }
-                    hs_func_param_t *next_param = malloc(sizeof(hs_func_param_t));
-                    if (param != NULL) {
-                        param->next = next_param;
-                    } else {
-                        lvalue_func.params_linked = next_param;
-                    }
-                    param = next_param;
-                    for (size_t s_i = 0; s_i < HS_BUF_SIZE; s_i++) {
-                        param->id[s_i] = tokens_lvalue2.items[t_i].content[s_i];
-                        if (param->id[s_i] == '\0')
-                            break;
-                    }
-                    param->next = NULL;
-                    lvalue_func.params_count++;
-                    if (is_last)
-                        break;
-                }
-                for (size_t i = 0; i < HS_BUF_SIZE; i++) {
-                    lvalue_func.id[i] = tokens_lvalue2.items[0].content[i];
-                    if (lvalue_func.id[i] == '\0')
-                        break;
-                }
-                lvalue_func.expression = malloc(hs_str_len(input + lvalue_i));
-                for (size_t i = 0; i < hs_str_len(input + lvalue_i); i++) {
-                    lvalue_func.expression[i] = input[lvalue_i + 1 + i];
-                }
-                hs_funcs_push(state, lvalue_func);
+    if (argc > 1 && strcmp(argv[1], "--batch") == 0) {
+        char *path = NULL;
+        size_t threads = 1;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+                threads = strtoul(argv[++i], NULL, 10);
             } else {
-                printf("WARNING: did not understand input left of \"=\", will be ignored" ENDL);
+                path = argv[i];
             }
         }
-        free(tokens_lvalue2.items);
-        if (lvalue_func.id[0] != '\0') {
-            return;
-        }
+        int result = hs_batch(path, threads, state);
+        hs_state_destroy(state);
+        return result;
     }
-
-    tokens1 = hs_tokenize(input + lvalue_i, state);
-    if (tokens1.items == NULL)
-        goto hs_run_error;
-
-    tokens2 = hs_token_list_init();
-    if (tokens2.items == NULL)
-        goto hs_run_error;
-    if (hs_handle_commands(&tokens1, &tokens2, &restore_settings, state) != 0)
-        goto hs_run_error;
-    free(tokens1.items);
-    if (tokens2.items[0].kind == HS_TOKEN_EOF) {
-        restore_settings = false;
+    if (argc > 2 && strcmp(argv[1], "--columns") == 0) {
+        int result = hs_columns(argv[2], argc > 3 ? argv[3] : "", argc > 4 ? argv[4] : NULL, state);
+        hs_state_destroy(state);
+        return result;
     }
-
-    tokens3 = hs_shunting_yard(tokens2);
-    if (tokens3.items == NULL)
-        goto hs_run_error;
-    free(tokens2.items);
-
-    if (tokens3.size > 0) {
-        // assuming the first context_var is "ans"
-        hs_value_t result = state->context_vars[0].value = hs_solve(tokens3, state);
-        if (lvalue_var.id[0] != '\0') {
-            if (hs_str_same(lvalue_var.id, "scient_min")) {
-                state->settings.scient_min = result.re;
-            } else if (hs_str_same(lvalue_var.id, "scient_max")) {
-                state->settings.scient_max = result.re;
-            } else if (hs_str_same(lvalue_var.id, "sep_out")) {
-                state->settings.sep_out = fabs(result.re) >= HS_EPSILON;
-            } else {
-                lvalue_var.value = result;
-                hs_vars_push(state, lvalue_var);
-            }
-        }
-        hs_output(result, state);
-        printf(ENDL);
+#if HS_SERVER
+    if (argc > 1 && strcmp(argv[1], "--serve") == 0) {
+        int result = hs_serve(argc > 2 ? argv[2] : HS_SERVER_DEFAULT_PATH, state);
+        hs_state_destroy(state);
+        return result;
     }
-    free(tokens3.items);
-    if (restore_settings)
-        state->settings = temp_settings;
-    return;
-
-hs_run_error:
-    if (tokens1.items != NULL)
-        free(tokens1.items);
-    if (tokens2.items != NULL)
-        free(tokens2.items);
-    if (tokens3.items != NULL)
-        free(tokens3.items);
-
-    if (restore_settings)
-        state->settings = temp_settings;
-}
+#endif
+#endif
 
-int main(int argc, char *argv[]) {
     size_t hs_input_size = 1 * sizeof(char);
     char *hs_input = malloc(hs_input_size);
     hs_input[0] = '\0';
     size_t hs_input_i = 0;
 
-    hs_state_t state = hs_default_state();
-    if (state.context_vars == NULL || state.context_funcs == NULL)
-        return 1;
-
 #if !HS_FORCE_INTERACTIVE
     if (argc > 1) {
         // use quotes for command line argument
@@ -1634,12 +760,24 @@ int main(int argc, char *argv[]) {
         }
         hs_input[hs_input_i] = '\0';
 
-        hs_run(hs_input, &state);
+        hs_run(state, hs_input);
+        hs_flush(state);
     } else {
 #endif
-        while (true) {
-            printf("> ");
-            for (hs_input_i = 0; (hs_input[hs_input_i] = getchar()) != '\n'; hs_input_i++) {
+        bool interactive = HS_IS_TERMINAL(stdin);
+        bool eof = false;
+        while (!eof) {
+            if (interactive) {
+                hs_flush(state);
+                printf("> ");
+                fflush(stdout);
+            }
+            int c;
+            for (hs_input_i = 0; (c = getchar()) != '\n'; hs_input_i++) {
+                if (c == EOF) {
+                    eof = true;
+                    break;
+                }
                 if (hs_input_i >= hs_input_size - 1) {
                     hs_input_size *= 2;
                     hs_input = realloc(hs_input, hs_input_size);
@@ -1648,24 +786,26 @@ int main(int argc, char *argv[]) {
                         return 1;
                     }
                 }
+                hs_input[hs_input_i] = c;
             }
             hs_input[hs_input_i] = '\0';
 
             if (hs_input_i == 0) {
                 break;
             }
-            hs_run(hs_input, &state);
+            hs_run(state, hs_input);
+            hs_flush(state);
         }
-
-        if (state.context_vars != NULL)
-            free(state.context_vars);
-        if (state.context_funcs != NULL)
-            free(state.context_funcs);
 #if !HS_FORCE_INTERACTIVE
     }
 #endif
 
+    int result = 0;
+    if (snapshot != NULL && !hs_snapshot_save(state, snapshot))
+        result = 1;
+    hs_flush(state);
+    hs_state_destroy(state);
     free(hs_input);
 
-    return 0;
+    return result;
 }
@@ -0,0 +1,112 @@
+#ifndef HSOLVER_H
+#define HSOLVER_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// hsolver as a library: every call works on a state, there is no global mutable data.
+// a state must only be used by one thread at a time, use one state (or a clone) per thread.
+// nothing is printed unless an output is set with hs_set_output_file or hs_set_output_callback
+
+#if defined(__GNUC__)
+#define HS_API __attribute__((visibility("default")))
+#else
+#define HS_API
+#endif
+
+typedef struct hs_value {
+    double re;
+    double im;
+} hs_value_t;
+
+typedef struct hs_state hs_state_t;
+
+// counters since the state was created or last reset, the numbers of the "stats" command
+typedef struct hs_stats {
+    uint64_t lines; // lines run by hs_run and hs_eval
+    uint64_t line_hits; // lines hs_run answered from its cache of repeated lines
+    uint64_t evaluations; // expressions solved, including table rows and hs_expr_eval
+    uint64_t tokens; // tokens the tokenizer produced
+    uint64_t ops; // rpn tokens and bytecode instructions executed
+    uint64_t calls; // calls of user functions
+    uint64_t memo_hits; // calls of pure functions answered from their cache, see the memo setting
+    uint64_t memo_misses; // calls of pure functions that had to be evaluated
+    uint64_t allocations; // heap allocations
+    // nanoseconds spent in each phase of a line, timed for every 8th line and scaled up to all of them
+    uint64_t tokenize_ns;
+    uint64_t commands_ns;
+    uint64_t shunting_yard_ns;
+    uint64_t optimize_ns;
+    uint64_t solve_ns;
+    uint64_t output_ns;
+} hs_stats_t;
+
+// compiled expression, see hs_compile
+typedef struct hs_expr hs_expr_t;
+
+// base context many states read without copying it, see hs_shared_create
+typedef struct hs_shared hs_shared_t;
+
+// state with the default variables, functions and settings, NULL if out of memory
+HS_API hs_state_t *hs_state_create(void);
+// independent copy of state (variables, functions, settings and output), NULL if out of memory
+HS_API hs_state_t *hs_state_clone(hs_state_t *state);
+HS_API void hs_state_destroy(hs_state_t *state);
+
+// publishes the variables, functions and settings of state as a read-only base for hs_state_create_shared, NULL if out of memory
+HS_API hs_shared_t *hs_shared_create(hs_state_t *state);
+// replaces the base with the definitions of state, the states reading it switch over at their next hs_run/hs_eval/hs_compile.
+// nobody waits for anybody, the replaced base is freed once no state can still be reading it
+HS_API bool hs_shared_publish(hs_shared_t *shared, hs_state_t *state);
+// every state created from shared has to be destroyed before
+HS_API void hs_shared_destroy(hs_shared_t *shared);
+// state reading the base of shared, only its own assignments and definitions are stored in it.
+// assigning or defining a name of the base gives it a private copy which no longer follows hs_shared_publish
+HS_API hs_state_t *hs_state_create_shared(hs_shared_t *shared);
+
+// output of hs_run, NULL discards it
+HS_API void hs_set_output_file(hs_state_t *state, FILE *file);
+HS_API void hs_set_output_callback(hs_state_t *state, void (*callback)(const char *data, size_t size, void *context), void *context);
+// writes out what hs_run buffered so far
+HS_API void hs_flush(hs_state_t *state);
+// whether the save and load commands of hs_run/hs_eval may touch files, allowed by default and kept by hs_state_clone.
+// hs_snapshot_save and hs_snapshot_load are not affected
+HS_API void hs_set_files(hs_state_t *state, bool allowed);
+
+// runs line like the interactive prompt does (commands, assignments, definitions), printing to the output
+HS_API void hs_run(hs_state_t *state, const char *line);
+
+// evaluates text without printing, returns false if it reported an error.
+// result is zero if text has no value (i.e. a command or function definition).
+// error (if not NULL) receives the diagnostics or NULL, the text is valid until the next call on state
+HS_API bool hs_eval(hs_state_t *state, const char *text, hs_value_t *result, const char **error);
+
+// compiles text once to evaluate it many times with changing variables, NULL on error.
+// commands in text (i.e. "hex") stay in effect
+HS_API hs_expr_t *hs_compile(hs_state_t *state, const char *text, const char **error);
+HS_API bool hs_expr_eval(hs_state_t *state, hs_expr_t *expr, hs_value_t *result, const char **error);
+HS_API void hs_expr_free(hs_expr_t *expr);
+
+HS_API void hs_stats_get(hs_state_t *state, hs_stats_t *stats);
+HS_API void hs_stats_reset(hs_state_t *state);
+
+// names are lower case letters, digits and '_', not starting with a digit
+HS_API bool hs_var_get(hs_state_t *state, const char *name, hs_value_t *value);
+HS_API bool hs_var_set(hs_state_t *state, const char *name, hs_value_t value);
+// same as "name(params) = expression"
+HS_API bool hs_func_define(hs_state_t *state, const char *name, const char **params, size_t params_count, const char *expression);
+
+// writes the variables, functions (with their compiled bodies) and settings of state to a snapshot file at path
+HS_API bool hs_snapshot_save(hs_state_t *state, const char *path);
+// replaces the variables, functions and settings of state with the snapshot at path. the file is mapped and used in place,
+// so loading takes about the same time however many definitions it holds. snapshots only load into the version of hsolver (and platform) that saved them
+HS_API bool hs_snapshot_load(hs_state_t *state, const char *path);
+
+// writes value as the current output settings would print it, returns the length without the terminating '\0'
+HS_API size_t hs_format(hs_state_t *state, hs_value_t value, char *buffer, size_t size);
+// parses a plain decimal number like "-1'234.5e3" from text[0..length), honoring the input separator settings
+HS_API bool hs_parse_number(hs_state_t *state, const char *text, size_t length, double *value);
+
+#endif
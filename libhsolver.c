@@ -0,0 +1,5635 @@
+#ifdef UNIX
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <malloc.h>
+#include <math.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "hsolver.h"
+
+// TODO:
+//  - commands for char settings (sep_char_in/_out, dec_sep_char_in/_out)
+//  - console colors/bold (especially "list")
+
+#define HS_MAX_FRAC_DIGITS 13
+#define HS_EPSILON 1e-20
+#define HS_MAX_EXP_LIST_LEN 30
+#define HS_PRINT_ALLOCATIONS 0
+#define HS_ARENA_BLOCK_SIZE 4096
+#define HS_LIST_INITIAL_CAPACITY 16
+#define HS_SINK_INITIAL_CAPACITY 256
+#define HS_SINK_FLUSH_SIZE (64 * 1024)
+// enough for any double in plain notation with separators, even in binary
+#define HS_FORMAT_BUFFER_SIZE 1536
+// phases are timed for one line out of this many, the totals are scaled up to all lines
+#define HS_STATS_SAMPLE 8
+// results cached per pure function by default and at most, and the most parameters a memoized function can have
+#define HS_MEMO_DEFAULT_SIZE 1024
+#define HS_MEMO_MAX_SIZE (1 << 20)
+#define HS_MEMO_MAX_PARAMS 8
+// shorter bodies are evaluated faster than their cache is looked up, unless they call other user functions
+#define HS_MEMO_MIN_BODY 16
+// lines (and what they print) remembered by hs_run, and the longest line and output worth remembering
+#define HS_LINE_CACHE_SIZE 256
+#define HS_LINE_CACHE_MAX 1024
+
+#ifdef WIN
+#define ENDL "\r\n"
+#define SIZE_T_F "%i"
+#endif
+#ifdef UNIX
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define HS_THREADS 1
+#define HS_MMAP 1
+#define ENDL "\n"
+#define SIZE_T_F "%lu"
+#endif
+
+#ifndef ENDL
+#warning "Please specify platform using -D WIN or -D UNIX"
+#define ENDL "\n"
+#endif
+#ifndef SIZE_T_F
+#define SIZE_T_F "%lu"
+#endif
+#ifndef HS_THREADS
+#define HS_THREADS 0
+#endif
+#ifndef HS_MMAP
+#define HS_MMAP 0
+#endif
+
+#define HS_ZERO ((hs_value_t){.re = 0, .im = 0})
+#define HS_ONE ((hs_value_t){.re = 1, .im = 0})
+
+const char help_text[] = \
+"--COMMANDS--" ENDL \
+"  help" ENDL \
+"  list" ENDL \
+"  settings" ENDL \
+"  bin [optional inline expression]" ENDL \
+"  oct [optional inline expression]" ENDL \
+"  dec [optional inline expression]" ENDL \
+"  hex [optional inline expression]" ENDL \
+"  table expression, x = start .. end [step s]" ENDL \
+"  save file" ENDL \
+"  load file" ENDL \
+"  stats [reset|json]" ENDL \
+"  scient_min = expression" ENDL \
+"  scient_max = expression" ENDL \
+"  sep_out = expression" ENDL \
+"  fold = expression" ENDL \
+"  cse = expression" ENDL \
+"  vm = expression" ENDL \
+"  memo = expression" ENDL \
+;
+
+int hs_printf(hs_state_t *state, const char *format, ...);
+void hs_error(hs_state_t *state, const char *format, ...);
+void hs_putc(hs_state_t *state, char c);
+
+typedef uint32_t hs_symbol_t;
+
+#define HS_SYMBOL_NONE UINT32_MAX
+
+typedef struct hs_var {
+    hs_symbol_t id;
+    hs_value_t value;
+    // builtin value the user never assigned to, may be folded into compiled expressions
+    bool constant;
+} hs_var_t;
+
+typedef struct hs_default_var {
+    char *id;
+    hs_value_t value;
+} hs_default_var_t;
+
+const hs_default_var_t hs_default_vars[] = {
+    {.id = "zero",   .value = {.re = 0,                .im = 0}},
+    {.id = "one",    .value = {.re = 1,                .im = 0}},
+    {.id = "inch",   .value = {.re = 0.0254,           .im = 0}},
+    {.id = "foot",   .value = {.re = 0.3048,           .im = 0}},
+    {.id = "mile",   .value = {.re = 1609.34,          .im = 0}},
+    {.id = "i",      .value = {.re = 0,                .im = 1}},
+    {.id = "e",      .value = {.re = 2.718281828459045235360287471352662497757247093, .im = 0}},
+    {.id = "pi",     .value = {.re = 3.141592653589793238462643383279502884197169399, .im = 0}},
+    {.id = "tau",    .value = {.re = 6.283185307179586476925286766559005768394338798, .im = 0}},
+    {.id = "phi",    .value = {.re = 1.618033988749894848204586834365638117720309179, .im = 0}},
+    {.id = "c",      .value = {.re = 299792458,        .im = 0}},
+    {.id = "g",      .value = {.re = 9.80665,          .im = 0}},
+    {.id = "ev",     .value = {.re = 1.602176634e-19,  .im = 0}},
+    {.id = "mu_0",   .value = {.re = 1.25663706127e-6, .im = 0}},
+    {.id = "epsi_0", .value = {.re = 8.8541878188e-12, .im = 0}},
+};
+
+hs_value_t hs_f_abs(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    return (hs_value_t){.re = sqrt(a.re * a.re + a.im * a.im), .im = 0};
+}
+
+hs_value_t hs_f_add(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    return (hs_value_t){.re = a.re + b.re, .im = a.im + b.im};
+}
+
+hs_value_t hs_f_subtract(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    return (hs_value_t){.re = a.re - b.re, .im = a.im - b.im};
+}
+
+hs_value_t hs_f_multiply(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    return (hs_value_t){.re = a.re * b.re - a.im * b.im, .im = a.re * b.im + a.im * b.re};
+}
+
+hs_value_t hs_f_divide(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    if (hs_f_abs(state, b, HS_ZERO).re < HS_EPSILON) {
+        hs_error(state, "division by zero" ENDL);
+        return (hs_value_t){.re = NAN, .im = NAN};
+    }
+    return (hs_value_t){.re = (a.re * b.re + a.im * b.im) / (b.re * b.re + b.im * b.im), .im = (a.im * b.re - a.re * b.im) / (b.re * b.re + b.im * b.im)};
+}
+
+hs_value_t hs_f_round(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    return (hs_value_t){.re = round(a.re), .im = round(a.im)};
+}
+
+hs_value_t hs_f_floor(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    return (hs_value_t){.re = floor(a.re), .im = floor(a.im)};
+}
+
+hs_value_t hs_f_ceil(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    return (hs_value_t){.re = ceil(a.re), .im = ceil(a.im)};
+}
+
+hs_value_t hs_f_modulo(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    if (fabs(b.im) < HS_EPSILON) {
+        return (hs_value_t){.re = fmod(a.re, b.re), .im = 0};
+    } else {
+        return (hs_value_t){.re = fmod(a.re, b.re), .im = fmod(a.im, b.im)};
+    }
+}
+
+hs_value_t hs_f_pow(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    if (fabs(a.im) >= HS_EPSILON || fabs(b.im) >= HS_EPSILON) {
+        hs_error(state, "i'm sorry dave, i can't let you do that (-> exponent) with complex numbers" ENDL);
+    }
+    return (hs_value_t){.re = pow(a.re, b.re), .im = 0};
+}
+
+hs_value_t hs_f_root(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    if (fabs(a.im) >= HS_EPSILON || fabs(b.im) >= HS_EPSILON) {
+        hs_error(state, "i'm sorry dave, i can't let you do that (-> root) with complex numbers" ENDL);
+    }
+    return hs_f_pow(state, a, hs_f_divide(state, HS_ONE, b));
+}
+
+hs_value_t hs_f_sqrt(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    if (fabs(b.im) >= HS_EPSILON) {
+        return (hs_value_t){.re = sqrt((hs_f_abs(state, a, HS_ZERO).re + a.re) / 2), .im = a.im / fabs(a.im) * sqrt((hs_f_abs(state, a, HS_ZERO).re - a.re) / 2)};
+    } else if (hs_f_abs(state, hs_f_subtract(state, a, (hs_value_t){.re = -1, .im = 0}), HS_ZERO).re < HS_EPSILON) {
+        return (hs_value_t){.re = 0, .im = 1};
+    }
+    return hs_f_root(state, a, (hs_value_t){.re = 2, .im = 0});
+}
+
+hs_value_t hs_f_ln(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    return (hs_value_t){.re = log(sqrt(a.re * a.re + a.im * a.im)), .im = atan2(a.im, a.re)};
+}
+
+hs_value_t hs_f_log2(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    if (fabs(a.im) >= HS_EPSILON) {
+        hs_error(state, "i'm sorry dave, i can't let you do that (-> log2) with complex numbers" ENDL);
+    }
+    return (hs_value_t){.re = log2(a.re), .im = 0};
+}
+
+hs_value_t hs_f_log10(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    if (fabs(a.im) >= HS_EPSILON) {
+        hs_error(state, "i'm sorry dave, i can't let you do that (-> log10) with complex numbers" ENDL);
+    }
+    return (hs_value_t){.re = log10(a.re), .im = 0};
+}
+
+hs_value_t hs_f_sin(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    if (fabs(a.im) >= HS_EPSILON) {
+        hs_error(state, "i'm sorry dave, i can't let you do that (-> sin) with complex numbers" ENDL);
+    }
+    return (hs_value_t){.re = sin(a.re), .im = 0};
+}
+
+hs_value_t hs_f_sinh(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    if (fabs(a.im) >= HS_EPSILON) {
+        hs_error(state, "i'm sorry dave, i can't let you do that (-> sinh) with complex numbers" ENDL);
+    }
+    return (hs_value_t){.re = sinh(a.re), .im = 0};
+}
+
+hs_value_t hs_f_asin(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    if (fabs(a.im) >= HS_EPSILON) {
+        hs_error(state, "i'm sorry dave, i can't let you do that (-> asin) with complex numbers" ENDL);
+    }
+    return (hs_value_t){.re = asin(a.re), .im = 0};
+}
+
+hs_value_t hs_f_cos(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    if (fabs(a.im) >= HS_EPSILON) {
+        hs_error(state, "i'm sorry dave, i can't let you do that (-> cos) with complex numbers" ENDL);
+    }
+    return (hs_value_t){.re = cos(a.re), .im = 0};
+}
+
+hs_value_t hs_f_cosh(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    if (fabs(a.im) >= HS_EPSILON) {
+        hs_error(state, "i'm sorry dave, i can't let you do that (-> cosh) with complex numbers" ENDL);
+    }
+    return (hs_value_t){.re = cosh(a.re), .im = 0};
+}
+
+hs_value_t hs_f_acos(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    if (fabs(a.im) >= HS_EPSILON) {
+        hs_error(state, "i'm sorry dave, i can't let you do that (-> acos) with complex numbers" ENDL);
+    }
+    return (hs_value_t){.re = acos(a.re), .im = 0};
+}
+
+hs_value_t hs_f_tan(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    if (fabs(a.im) >= HS_EPSILON) {
+        hs_error(state, "i'm sorry dave, i can't let you do that (-> tan) with complex numbers" ENDL);
+    }
+    return (hs_value_t){.re = tan(a.re), .im = 0};
+}
+
+hs_value_t hs_f_tanh(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    if (fabs(a.im) >= HS_EPSILON) {
+        hs_error(state, "i'm sorry dave, i can't let you do that (-> tanh) with complex numbers" ENDL);
+    }
+    return (hs_value_t){.re = tanh(a.re), .im = 0};
+}
+
+hs_value_t hs_f_atan(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    if (fabs(a.im) >= HS_EPSILON) {
+        hs_error(state, "i'm sorry dave, i can't let you do that (-> atan) with complex numbers" ENDL);
+    }
+    return (hs_value_t){.re = atan(a.re), .im = 0};
+}
+
+hs_value_t hs_f_atan2(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    if (fabs(a.im) >= HS_EPSILON || fabs(b.im) >= HS_EPSILON) {
+        hs_error(state, "i'm sorry dave, i can't let you do that (-> atan2) with complex numbers" ENDL);
+    }
+    return (hs_value_t){.re = atan2(a.re, b.re), .im = 0};
+}
+
+hs_value_t hs_f_and(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    return (hs_value_t){.re = (uint64_t)a.re & (uint64_t)b.re, .im = (uint64_t)a.im & (uint64_t)b.im};
+}
+
+hs_value_t hs_f_or(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    return (hs_value_t){.re = (uint64_t)a.re | (uint64_t)b.re, .im = (uint64_t)a.im | (uint64_t)b.im};
+}
+
+hs_value_t hs_f_xor(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    return (hs_value_t){.re = (uint64_t)a.re ^ (uint64_t)b.re, .im = (uint64_t)a.im ^ (uint64_t)b.im};
+}
+
+hs_value_t hs_f_shiftl(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    return (hs_value_t){.re = (uint64_t)a.re << (uint64_t)b.re, .im = (uint64_t)a.im << (uint64_t)b.im};
+}
+
+hs_value_t hs_f_shiftr(hs_state_t *state, hs_value_t a, hs_value_t b) {
+    return (hs_value_t){.re = (uint64_t)a.re >> (uint64_t)b.re, .im = (uint64_t)a.im >> (uint64_t)b.im};
+}
+
+typedef enum hs_token_kind {
+    HS_TOKEN_EOF,
+    HS_TOKEN_ID,
+    HS_TOKEN_ID_IS_VAR,
+    HS_TOKEN_PARAM,
+    HS_TOKEN_VALUE,
+    HS_TOKEN_STORE,
+    HS_TOKEN_LOAD,
+    HS_TOKEN_ADD,
+    HS_TOKEN_SUBTRACT,
+    HS_TOKEN_MULTIPLY,
+    HS_TOKEN_DIVIDE,
+    HS_TOKEN_MODULO,
+    HS_TOKEN_POWER,
+    HS_TOKEN_AND,
+    HS_TOKEN_OR,
+    HS_TOKEN_XOR,
+    HS_TOKEN_SHIFTL,
+    HS_TOKEN_SHIFTR,
+    HS_TOKEN_OPEN_P,
+    HS_TOKEN_CLOSE_P,
+    HS_TOKEN_COMMA,
+} hs_token_kind_t;
+
+typedef struct hs_token {
+    uint8_t kind; // hs_token_kind_t
+    union {
+        // interned identifier (HS_TOKEN_ID and HS_TOKEN_ID_IS_VAR only)
+        hs_symbol_t symbol;
+        // index into the parameter list of the function being compiled (HS_TOKEN_PARAM only)
+        uint8_t param_i;
+        // index into the values of its list, literals are decoded into these while tokenizing (HS_TOKEN_VALUE only)
+        uint32_t value_i;
+        // temporary slot of its list (HS_TOKEN_STORE and HS_TOKEN_LOAD only)
+        uint32_t temp_i;
+    };
+} hs_token_t;
+
+// token lists live in the arena of their state and are dropped with it after each evaluation,
+// only compiled function bodies are copied to the heap (and never pushed to again)
+typedef struct hs_token_list {
+    hs_token_t *items;
+    size_t capacity;
+    size_t size;
+    // values of literals and folded constants, allocated like items
+    hs_value_t *values;
+    size_t values_size;
+    size_t values_capacity;
+    // number of temporary slots hs_solve reserves below the values of this list
+    size_t temps;
+} hs_token_list_t;
+
+typedef enum hs_op {
+    HS_OP_VALUE,
+    HS_OP_VAR,
+    HS_OP_PARAM,
+    HS_OP_STORE,
+    HS_OP_LOAD,
+    // same order as the operator tokens
+    HS_OP_ADD,
+    HS_OP_SUBTRACT,
+    HS_OP_MULTIPLY,
+    HS_OP_DIVIDE,
+    HS_OP_MODULO,
+    HS_OP_POWER,
+    HS_OP_AND,
+    HS_OP_OR,
+    HS_OP_XOR,
+    HS_OP_SHIFTL,
+    HS_OP_SHIFTR,
+    HS_OP_CALL_BUILTIN_1,
+    HS_OP_CALL_BUILTIN_2,
+    HS_OP_CALL,
+    HS_OP_CALL_UNKNOWN,
+    HS_OP_RETURN,
+} hs_op_t;
+
+typedef struct hs_instruction {
+    // address of the handler in hs_program_run when dispatching with computed goto
+    const void *target;
+    uint32_t op; // hs_op_t
+    uint32_t arg;
+} hs_instruction_t;
+
+// bytecode compiled from rpn by hs_program_compile
+typedef struct hs_program {
+    hs_instruction_t *code; // NULL if the rpn has to be solved by hs_solve
+    size_t size;
+    hs_value_t *values;
+    size_t values_size;
+    size_t temps;
+    // most values on the stack at any point while running, not counting temps
+    size_t max_depth;
+} hs_program_t;
+
+// passed as frame to hs_program_run to only resolve the handler addresses of a program
+#define HS_PROGRAM_THREAD ((size_t)-2)
+
+typedef struct hs_func_param hs_func_param_t;
+
+typedef struct hs_func {
+    hs_symbol_t id;
+    hs_value_t (*func)(hs_state_t *state, hs_value_t a, hs_value_t b);
+    uint8_t params_count;
+    hs_func_param_t *params_linked;
+    char *expression;
+    // expression compiled to rpn once in hs_funcs_push, parameters already bound to their slots
+    hs_token_list_t body;
+    // body compiled to bytecode, code is NULL if that was not possible
+    hs_program_t program;
+    // the result only depends on the arguments, see hs_funcs_purity
+    bool pure;
+    // pure and expensive enough to cache its results
+    bool memoize;
+} hs_func_t;
+
+typedef struct hs_func_param {
+    hs_symbol_t id;
+    hs_func_param_t *next;
+} hs_func_param_t;
+
+typedef struct hs_default_func {
+    char *id;
+    hs_value_t (*func)(hs_state_t *state, hs_value_t a, hs_value_t b);
+    uint8_t params_count;
+    // never prints a warning or error, see hs_cse
+    bool quiet;
+} hs_default_func_t;
+
+const hs_default_func_t hs_default_funcs[] = {
+    {.id = "add",       .func = hs_f_add,       .params_count = 2, .quiet = true},
+    {.id = "subtract",  .func = hs_f_subtract,  .params_count = 2, .quiet = true},
+    {.id = "multiply",  .func = hs_f_multiply,  .params_count = 2, .quiet = true},
+    {.id = "divide",    .func = hs_f_divide,    .params_count = 2},
+    {.id = "modulo",    .func = hs_f_modulo,    .params_count = 2, .quiet = true},
+    {.id = "pow",       .func = hs_f_pow,       .params_count = 2},
+    {.id = "root",      .func = hs_f_root,      .params_count = 2},
+    {.id = "sqrt",      .func = hs_f_sqrt,      .params_count = 1},
+    {.id = "round",     .func = hs_f_round,     .params_count = 1, .quiet = true},
+    {.id = "floor",     .func = hs_f_floor,     .params_count = 1, .quiet = true},
+    {.id = "ceil",      .func = hs_f_ceil,      .params_count = 1, .quiet = true},
+    {.id = "abs",       .func = hs_f_abs,       .params_count = 1, .quiet = true},
+    {.id = "ln",        .func = hs_f_ln,        .params_count = 1, .quiet = true},
+    {.id = "log2",      .func = hs_f_log2,      .params_count = 1},
+    {.id = "log10",     .func = hs_f_log10,     .params_count = 1},
+    {.id = "sin",       .func = hs_f_sin,       .params_count = 1},
+    {.id = "sinh",      .func = hs_f_sinh,      .params_count = 1},
+    {.id = "asin",      .func = hs_f_asin,      .params_count = 1},
+    {.id = "cos",       .func = hs_f_cos,       .params_count = 1},
+    {.id = "cosh",      .func = hs_f_cosh,      .params_count = 1},
+    {.id = "acos",      .func = hs_f_acos,      .params_count = 1},
+    {.id = "tan",       .func = hs_f_tan,       .params_count = 1},
+    {.id = "tanh",      .func = hs_f_tanh,      .params_count = 1},
+    {.id = "atan",      .func = hs_f_atan,      .params_count = 1},
+    {.id = "atan2",     .func = hs_f_atan2,     .params_count = 1},
+    {.id = "and",       .func = hs_f_and,       .params_count = 2, .quiet = true},
+    {.id = "or",        .func = hs_f_or,        .params_count = 2, .quiet = true},
+    {.id = "xor",       .func = hs_f_xor,       .params_count = 2, .quiet = true},
+    {.id = "shiftl",    .func = hs_f_shiftl,    .params_count = 2, .quiet = true},
+    {.id = "shiftr",    .func = hs_f_shiftr,    .params_count = 2, .quiet = true},
+};
+
+typedef enum hs_output_mode {
+    HS_OUTPUT_BIN = 2,
+    HS_OUTPUT_OCT = 8,
+    HS_OUTPUT_DEC = 10,
+    HS_OUTPUT_HEX = 16,
+} hs_output_mode_t;
+
+typedef struct hs_settings {
+    hs_output_mode_t output_mode;
+    double scient_min;
+    double scient_max;
+    char dec_sep_char_in;
+    char dec_sep_char_out;
+    bool sep_out;
+    char sep_char_in;
+    char sep_char_out;
+    bool fold;
+    bool cse;
+    bool vm;
+    // results cached per pure function, 0 turns memoization off
+    uint32_t memo;
+} hs_settings_t;
+
+// open addressing hash index from names to symbols
+typedef struct hs_index {
+    hs_symbol_t *buckets; // symbol + 1, 0 marks an empty bucket
+    size_t capacity; // always a power of two
+} hs_index_t;
+
+// interned identifiers, each symbol also remembers which variable and function slot it is bound to.
+// symbols below first belong to the base of the state, the arrays only hold the ones from first on
+typedef struct hs_symbols {
+    char *names; // all names back to back, each one terminated by '\0'
+    size_t names_size;
+    size_t names_capacity;
+    size_t *name_offsets;
+    size_t *var_slots; // -1 if there is no variable with this name
+    size_t *func_slots; // -1 if there is no function with this name
+    size_t length;
+    size_t capacity;
+    hs_index_t index;
+    hs_symbol_t first;
+} hs_symbols_t;
+
+typedef struct hs_base hs_base_t;
+
+// definitions shared read-only by every state layered on it, never changed once published.
+// its symbols are bound to variable slots 0 .. vars_length and function slots 0 .. funcs_length,
+// "ans" is bound to slot vars_length, the first variable of every layered state
+struct hs_base {
+    hs_symbols_t symbols;
+    hs_var_t *vars;
+    size_t vars_length;
+    hs_func_t *funcs;
+    size_t funcs_length;
+    hs_settings_t settings;
+    // snapshot the arrays above point into if the base was loaded by hs_snapshot_load, NULL if they are allocated
+    void *image;
+    size_t image_size;
+    // epoch at which the base was replaced, it is freed once every reader announced a later one
+    uint64_t retired_epoch;
+    hs_base_t *retired_next;
+};
+
+typedef struct hs_reader hs_reader_t;
+
+// a state reading the current base of a hs_shared_t
+struct hs_reader {
+    // value of the shared epoch before the reader last loaded the current base
+    _Atomic uint64_t epoch;
+    hs_reader_t *next;
+};
+
+// base context published to many states, readers never lock, replaced bases are reclaimed by epoch
+struct hs_shared {
+    _Atomic(hs_base_t *) current;
+    _Atomic uint64_t epoch;
+#if HS_THREADS
+    // guards readers and retired, only taken when states come and go and when a base is published
+    pthread_mutex_t lock;
+#endif
+    hs_reader_t *readers;
+    hs_base_t *retired;
+};
+
+typedef struct hs_value_list {
+    hs_value_t *items;
+    size_t capacity;
+    size_t size;
+} hs_value_list_t;
+
+typedef struct hs_arena_block hs_arena_block_t;
+
+typedef struct hs_arena_block {
+    hs_arena_block_t *next;
+    size_t size;
+    size_t used;
+    uint64_t data[];
+} hs_arena_block_t;
+
+// bump allocator for everything that only lives during one evaluation
+typedef struct hs_arena {
+    hs_arena_block_t *blocks; // newest first
+} hs_arena_t;
+
+// results of the calls of one pure function by their arguments, the least recently used one is evicted when it is full.
+// entries are numbered from 1 on, 0 means none
+typedef struct hs_memo_link {
+    uint32_t next; // in the same bucket
+    uint32_t newer;
+    uint32_t older;
+} hs_memo_link_t;
+
+typedef struct hs_memo {
+    hs_value_t *values; // the arguments followed by the result, for each entry
+    hs_memo_link_t *links;
+    uint32_t *buckets; // first entry of each bucket
+    uint32_t bucket_mask;
+    uint32_t capacity;
+    uint32_t size;
+    uint32_t newest;
+    uint32_t oldest;
+    // memo_version of the state when the entries were computed
+    uint64_t version;
+} hs_memo_t;
+
+// own functions whose bodies call a name, by function slot
+typedef struct hs_callers {
+    uint32_t *slots;
+    uint32_t size;
+    uint32_t capacity;
+} hs_callers_t;
+
+// line run by hs_run and everything it printed, valid as long as no definition or setting changed
+typedef struct hs_line {
+    char *data; // the line normalized by hs_preprocess_input followed by the output, NULL if the slot is empty
+    size_t capacity; // of data, kept when another line takes the slot
+    size_t text_length;
+    size_t output_size;
+    hs_value_t value;
+    uint64_t hash;
+    uint64_t version; // line_version of the state when the line was run
+    uint64_t memo_version;
+} hs_line_t;
+
+// parts of hs_execute timed for the stats command
+typedef enum hs_phase {
+    HS_PHASE_TOKENIZE,
+    HS_PHASE_COMMANDS,
+    HS_PHASE_SHUNTING_YARD,
+    HS_PHASE_OPTIMIZE,
+    HS_PHASE_SOLVE,
+    HS_PHASE_OUTPUT,
+    HS_PHASES,
+} hs_phase_t;
+
+typedef enum hs_sink_kind {
+    HS_SINK_NONE, // everything is dropped (and counted)
+    HS_SINK_BUFFER, // collected until the owner takes the data
+    HS_SINK_FILE, // written to file on flush
+    HS_SINK_CALLBACK, // handed to callback on flush
+} hs_sink_kind_t;
+
+// destination of all output and diagnostics, it is collected in data and only leaves on hs_sink_flush
+typedef struct hs_sink {
+    hs_sink_kind_t kind;
+    char *data;
+    size_t size;
+    size_t capacity;
+    FILE *file;
+    void (*callback)(const char *data, size_t size, void *context);
+    void *context;
+} hs_sink_t;
+
+struct hs_state {
+    // own variables and functions, their slots start after the ones of base (both 0 without a base)
+    hs_var_t *context_vars;
+    size_t context_vars_length;
+    size_t context_vars_first;
+    hs_func_t *context_funcs;
+    size_t context_funcs_length;
+    size_t context_funcs_first;
+    // room in context_funcs, 0 if it was allocated for exactly context_funcs_length
+    size_t context_funcs_capacity;
+    hs_symbols_t symbols;
+    hs_base_t *base;
+    // set if base comes from hs_shared_t, the state switches to a newly published base between two evaluations
+    hs_shared_t *shared;
+    hs_reader_t *reader;
+    // compiled expressions of hs_compile still alive, the base is not switched under them
+    size_t exprs;
+    // base loaded by hs_snapshot_load, owned by the state alone until it detaches from it
+    hs_base_t *snapshot;
+    hs_settings_t settings;
+    // value stack shared by all (nested) calls of hs_solve, function parameters live in here too
+    hs_value_list_t stack;
+    hs_arena_t arena;
+    // number of heap (re)allocations done through hs_alloc so far
+    size_t allocations;
+    // counters of the stats command, allocations and phase times are filled in by hs_stats_get
+    hs_stats_t stats;
+    size_t stats_allocations; // allocations at the last reset
+    // phase times of the sampled lines, and the number of those lines
+    uint64_t stats_phases[HS_PHASES];
+    uint64_t stats_sampled;
+    // start of the current phase, 0 while the line is not sampled
+    uint64_t stats_clock;
+    // callers of every symbol, so a definition only recompiles the bodies calling it. NULL until first needed
+    hs_callers_t *callers;
+    size_t callers_length;
+    // caches of the pure functions by slot, emptied whenever memo_version changes
+    hs_memo_t *memos;
+    size_t memos_length;
+    // empties every cache when it changes: the functions moved to other slots or the memo setting changed.
+    // a definition only empties the caches of the functions it can change, see hs_funcs_purity
+    uint64_t memo_version;
+    // recently run lines by hash, NULL until the first one is remembered
+    hs_line_t *lines;
+    // changes whenever a variable or a setting changes, together with memo_version it tells if a remembered line is still valid
+    uint64_t line_version;
+    // number of hs_printf calls so far, calls of pure functions that printed a warning are not cached
+    size_t prints;
+    // everything printed goes here
+    hs_sink_t out;
+    // set by hs_set_files to refuse the save and load commands
+    bool files_refused;
+    // number of prints dropped because out was HS_SINK_NONE
+    size_t muted_prints;
+    // number of errors reported so far
+    size_t errors;
+    // collects the diagnostics of hs_eval and friends, also scratch space for hs_format
+    hs_sink_t messages;
+    // scratch buffer for formatting a single number
+    char out_buf[HS_FORMAT_BUFFER_SIZE];
+};
+
+bool hs_funcs_push(hs_state_t *state, hs_func_t func);
+void hs_funcs_recompile(hs_state_t *state);
+bool hs_state_detach(hs_state_t *state);
+void hs_image_unmap(void *image, size_t size);
+hs_value_list_t hs_rpn_list_init(hs_state_t *state);
+bool hs_str_same(char*, char*);
+size_t hs_str_len(char*);
+
+void *hs_alloc(hs_state_t *state, void *ptr, size_t size) {
+    state->allocations++;
+    return realloc(ptr, size);
+}
+
+// makes room for size more bytes (plus a terminator) in the sink
+bool hs_sink_reserve(hs_state_t *state, size_t size) {
+    hs_sink_t *sink = &state->out;
+    if (sink->size + size < sink->capacity)
+        return true;
+    size_t capacity = sink->capacity > 0 ? sink->capacity : HS_SINK_INITIAL_CAPACITY;
+    while (sink->size + size >= capacity)
+        capacity *= 2;
+    char *data = hs_alloc(state, sink->data, capacity);
+    if (data == NULL)
+        return false;
+    sink->data = data;
+    sink->capacity = capacity;
+    return true;
+}
+
+void hs_sink_write(hs_state_t *state, const char *data, size_t size) {
+    if (state->out.kind == HS_SINK_NONE) {
+        state->muted_prints++;
+        return;
+    }
+    if (!hs_sink_reserve(state, size))
+        return;
+    memcpy(state->out.data + state->out.size, data, size);
+    state->out.size += size;
+}
+
+int hs_vprintf(hs_state_t *state, const char *format, va_list args) {
+    hs_sink_t *sink = &state->out;
+    state->prints++;
+    if (sink->kind == HS_SINK_NONE) {
+        state->muted_prints++;
+        return 0;
+    }
+    if (sink->data == NULL && !hs_sink_reserve(state, 0))
+        return -1;
+    va_list retry;
+    va_copy(retry, args);
+    int length = vsnprintf(sink->data + sink->size, sink->capacity - sink->size, format, args);
+    if (length >= 0 && sink->size + (size_t)length >= sink->capacity) {
+        // did not fit, grow and format again
+        if (hs_sink_reserve(state, (size_t)length))
+            vsnprintf(sink->data + sink->size, sink->capacity - sink->size, format, retry);
+        else
+            length = -1;
+    }
+    va_end(retry);
+    if (length < 0)
+        return length;
+    sink->size += (size_t)length;
+    return length;
+}
+
+int hs_printf(hs_state_t *state, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = hs_vprintf(state, format, args);
+    va_end(args);
+    return length;
+}
+
+// prints "ERROR: " and the message, the call that caused it failed
+void hs_error(hs_state_t *state, const char *format, ...) {
+    state->errors++;
+    hs_printf(state, "ERROR: ");
+    va_list args;
+    va_start(args, format);
+    hs_vprintf(state, format, args);
+    va_end(args);
+}
+
+void hs_putc(hs_state_t *state, char c) {
+    hs_sink_t *sink = &state->out;
+    if (sink->kind == HS_SINK_NONE) {
+        state->muted_prints++;
+        return;
+    }
+    if (sink->size + 1 >= sink->capacity && !hs_sink_reserve(state, 1))
+        return;
+    sink->data[sink->size++] = c;
+}
+
+// hands everything collected so far to the file or callback, buffer sinks keep their data
+void hs_sink_flush(hs_state_t *state) {
+    hs_sink_t *sink = &state->out;
+    if (sink->size == 0)
+        return;
+    if (sink->kind == HS_SINK_FILE) {
+        fwrite(sink->data, 1, sink->size, sink->file);
+        fflush(sink->file);
+    } else if (sink->kind == HS_SINK_CALLBACK) {
+        sink->callback(sink->data, sink->size, sink->context);
+    } else {
+        return;
+    }
+    sink->size = 0;
+}
+
+// flushes once a good amount of output has piled up, for producers of many lines
+void hs_sink_flush_full(hs_state_t *state) {
+    if (state->out.size >= HS_SINK_FLUSH_SIZE)
+        hs_sink_flush(state);
+}
+
+uint64_t hs_clock_ns(void) {
+    struct timespec now;
+#ifdef UNIX
+    clock_gettime(CLOCK_MONOTONIC, &now);
+#else
+    timespec_get(&now, TIME_UTC);
+#endif
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+// counts a line and starts timing its phases if it is one of the sampled ones
+void hs_stats_line(hs_state_t *state) {
+    state->stats_clock = state->stats.lines++ % HS_STATS_SAMPLE == 0 ? hs_clock_ns() : 0;
+    if (state->stats_clock != 0)
+        state->stats_sampled++;
+}
+
+// adds the time since the end of the last phase to phase
+void hs_stats_lap(hs_state_t *state, hs_phase_t phase) {
+    if (state->stats_clock == 0)
+        return;
+    uint64_t now = hs_clock_ns();
+    state->stats_phases[phase] += now - state->stats_clock;
+    state->stats_clock = now;
+}
+
+void *hs_arena_alloc(hs_state_t *state, size_t size) {
+    size = (size + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t);
+    hs_arena_block_t *block = state->arena.blocks;
+    if (block == NULL || block->used + size > block->size) {
+        size_t block_size = block == NULL ? HS_ARENA_BLOCK_SIZE : block->size * 2;
+        while (block_size < size)
+            block_size *= 2;
+        hs_arena_block_t *new_block = hs_alloc(state, NULL, sizeof(hs_arena_block_t) + block_size);
+        if (new_block == NULL) {
+            hs_error(state, "out of memory during arena allocation of " SIZE_T_F " bytes :(" ENDL, size);
+            return NULL;
+        }
+        new_block->next = block;
+        new_block->size = block_size;
+        new_block->used = 0;
+        state->arena.blocks = block = new_block;
+    }
+    void *ptr = (char *)block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+void hs_arena_reset(hs_state_t *state) {
+    hs_arena_block_t *block = state->arena.blocks;
+    if (block == NULL)
+        return;
+    if (block->next == NULL) {
+        block->used = 0;
+        return;
+    }
+    // this evaluation needed more than one block, merge them into one so the next one fits without allocating
+    size_t total = 0;
+    while (block != NULL) {
+        hs_arena_block_t *next = block->next;
+        total += block->size;
+        free(block);
+        block = next;
+    }
+    state->arena.blocks = NULL;
+    hs_arena_alloc(state, total);
+    if (state->arena.blocks != NULL)
+        state->arena.blocks->used = 0;
+}
+
+void hs_arena_free(hs_state_t *state) {
+    hs_arena_block_t *block = state->arena.blocks;
+    while (block != NULL) {
+        hs_arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+    state->arena.blocks = NULL;
+}
+
+size_t hs_str_hash(char *a, size_t length) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)a[i];
+        hash *= 1099511628211ull;
+    }
+    return (size_t)hash;
+}
+
+char *hs_symbol_name(hs_state_t *state, hs_symbol_t symbol) {
+    hs_symbols_t *symbols = &state->symbols;
+    if (symbol < symbols->first)
+        return state->base->symbols.names + state->base->symbols.name_offsets[symbol];
+    if (symbol - symbols->first >= symbols->length)
+        return "?";
+    return symbols->names + symbols->name_offsets[symbol - symbols->first];
+}
+
+// looks name[0..length) up in the index of symbols only, HS_SYMBOL_NONE if it is not there
+hs_symbol_t hs_symbols_find(hs_symbols_t *symbols, char *name, size_t length, size_t hash) {
+    if (symbols->index.capacity == 0)
+        return HS_SYMBOL_NONE;
+    size_t mask = symbols->index.capacity - 1;
+    for (size_t b = hash & mask; symbols->index.buckets[b] != 0; b = (b + 1) & mask) {
+        size_t local = symbols->index.buckets[b] - 1;
+        char *symbol_name = symbols->names + symbols->name_offsets[local];
+        size_t i = 0;
+        while (i < length && symbol_name[i] == name[i])
+            i++;
+        if (i == length && symbol_name[length] == '\0')
+            return symbols->first + local;
+    }
+    return HS_SYMBOL_NONE;
+}
+
+bool hs_symbols_rehash(hs_state_t *state, size_t capacity) {
+    hs_symbols_t *symbols = &state->symbols;
+    hs_symbol_t *buckets = hs_alloc(state, symbols->index.buckets, capacity * sizeof(hs_symbol_t));
+    if (buckets == NULL) {
+        hs_error(state, "out of memory during symbol index reallocation at " SIZE_T_F " symbols :(" ENDL, symbols->length);
+        return false;
+    }
+    symbols->index.buckets = buckets;
+    symbols->index.capacity = capacity;
+    for (size_t b = 0; b < capacity; b++)
+        buckets[b] = 0;
+    size_t mask = capacity - 1;
+    for (size_t local = 0; local < symbols->length; local++) {
+        char *name = symbols->names + symbols->name_offsets[local];
+        size_t b = hs_str_hash(name, hs_str_len(name)) & mask;
+        while (buckets[b] != 0)
+            b = (b + 1) & mask;
+        buckets[b] = local + 1;
+    }
+    return true;
+}
+
+// returns the symbol for name[0..length) without interning it, HS_SYMBOL_NONE if there is none
+hs_symbol_t hs_symbol_find(hs_state_t *state, char *name, size_t length) {
+    size_t hash = hs_str_hash(name, length);
+    hs_symbol_t found = HS_SYMBOL_NONE;
+    if (state->base != NULL)
+        found = hs_symbols_find(&state->base->symbols, name, length, hash);
+    if (found == HS_SYMBOL_NONE)
+        found = hs_symbols_find(&state->symbols, name, length, hash);
+    return found;
+}
+
+// returns the symbol for name[0..length), interning it if it is new. names only read by an expression line are
+// forgotten again at its end, see hs_symbols_forget
+hs_symbol_t hs_symbol_intern(hs_state_t *state, char *name, size_t length) {
+    hs_symbols_t *symbols = &state->symbols;
+    hs_symbol_t found = hs_symbol_find(state, name, length);
+    if (found != HS_SYMBOL_NONE)
+        return found;
+
+    if (symbols->length >= symbols->capacity) {
+        size_t capacity = symbols->capacity == 0 ? 64 : symbols->capacity * 2;
+        size_t *name_offsets = hs_alloc(state, symbols->name_offsets, capacity * sizeof(size_t));
+        if (name_offsets == NULL)
+            goto hs_symbol_intern_error;
+        symbols->name_offsets = name_offsets;
+        size_t *var_slots = hs_alloc(state, symbols->var_slots, capacity * sizeof(size_t));
+        if (var_slots == NULL)
+            goto hs_symbol_intern_error;
+        symbols->var_slots = var_slots;
+        size_t *func_slots = hs_alloc(state, symbols->func_slots, capacity * sizeof(size_t));
+        if (func_slots == NULL)
+            goto hs_symbol_intern_error;
+        symbols->func_slots = func_slots;
+        symbols->capacity = capacity;
+    }
+    if (symbols->names_size + length + 1 > symbols->names_capacity) {
+        size_t names_capacity = symbols->names_capacity == 0 ? 1024 : symbols->names_capacity;
+        while (symbols->names_size + length + 1 > names_capacity)
+            names_capacity *= 2;
+        char *names = hs_alloc(state, symbols->names, names_capacity);
+        if (names == NULL)
+            goto hs_symbol_intern_error;
+        symbols->names = names;
+        symbols->names_capacity = names_capacity;
+    }
+    // the index grows before the symbol is added, so a failure leaves everything as it was
+    if ((symbols->length + 1) * 2 > symbols->index.capacity
+        && !hs_symbols_rehash(state, symbols->index.capacity == 0 ? 128 : symbols->index.capacity * 2))
+        return HS_SYMBOL_NONE;
+
+    size_t local = symbols->length++;
+    symbols->name_offsets[local] = symbols->names_size;
+    for (size_t i = 0; i < length; i++)
+        symbols->names[symbols->names_size++] = name[i];
+    symbols->names[symbols->names_size++] = '\0';
+    symbols->var_slots[local] = -1;
+    symbols->func_slots[local] = -1;
+    size_t mask = symbols->index.capacity - 1;
+    size_t b = hs_str_hash(name, length) & mask;
+    while (symbols->index.buckets[b] != 0)
+        b = (b + 1) & mask;
+    symbols->index.buckets[b] = local + 1;
+    return symbols->first + local;
+
+hs_symbol_intern_error:
+    hs_error(state, "out of memory during symbol list reallocation at " SIZE_T_F " symbols :(" ENDL, symbols->length);
+    return HS_SYMBOL_NONE;
+}
+
+// drops the symbols interned since there were length of them, as long as nothing is bound to them.
+// the newest goes first, no other name was placed in the index after it, so emptying its bucket breaks no probe chain
+void hs_symbols_forget(hs_state_t *state, size_t length) {
+    hs_symbols_t *symbols = &state->symbols;
+    size_t mask = symbols->index.capacity - 1;
+    while (symbols->length > length) {
+        size_t local = symbols->length - 1;
+        if (symbols->var_slots[local] != -1 || symbols->func_slots[local] != -1)
+            return;
+        char *name = symbols->names + symbols->name_offsets[local];
+        size_t b = hs_str_hash(name, hs_str_len(name)) & mask;
+        while (symbols->index.buckets[b] != local + 1)
+            b = (b + 1) & mask;
+        symbols->index.buckets[b] = 0;
+        symbols->names_size = symbols->name_offsets[local];
+        symbols->length--;
+    }
+}
+
+// slot of the variable named symbol, -1 if there is none
+size_t hs_var_slot(hs_state_t *state, hs_symbol_t symbol) {
+    if (symbol < state->symbols.first)
+        return state->base->symbols.var_slots[symbol];
+    return state->symbols.var_slots[symbol - state->symbols.first];
+}
+
+// slot of the function named symbol, -1 if there is none
+size_t hs_func_slot(hs_state_t *state, hs_symbol_t symbol) {
+    if (symbol < state->symbols.first)
+        return state->base->symbols.func_slots[symbol];
+    return state->symbols.func_slots[symbol - state->symbols.first];
+}
+
+hs_var_t *hs_var_at(hs_state_t *state, size_t slot) {
+    if (slot < state->context_vars_first)
+        return &state->base->vars[slot];
+    return &state->context_vars[slot - state->context_vars_first];
+}
+
+hs_func_t *hs_func_at(hs_state_t *state, size_t slot) {
+    if (slot < state->context_funcs_first)
+        return &state->base->funcs[slot];
+    return &state->context_funcs[slot - state->context_funcs_first];
+}
+
+size_t hs_vars_count(hs_state_t *state) {
+    return state->context_vars_first + state->context_vars_length;
+}
+
+size_t hs_funcs_count(hs_state_t *state) {
+    return state->context_funcs_first + state->context_funcs_length;
+}
+
+// i-th variable in the order a state without base keeps them: "ans", then the base ones, then the own ones
+hs_var_t *hs_var_listed(hs_state_t *state, size_t i) {
+    if (i == 0)
+        return &state->context_vars[0];
+    if (i <= state->context_vars_first)
+        return &state->base->vars[i - 1];
+    return &state->context_vars[i - state->context_vars_first];
+}
+
+hs_state_t hs_default_state() {
+    hs_state_t state = {
+        .context_vars = NULL,
+        .context_vars_length = sizeof(hs_default_vars) / sizeof(hs_default_var_t) + 1,
+        .context_funcs = NULL,
+        .context_funcs_length = sizeof(hs_default_funcs) / sizeof(hs_default_func_t),
+        .symbols = {
+            .names = NULL,
+            .names_size = 0,
+            .names_capacity = 0,
+            .name_offsets = NULL,
+            .var_slots = NULL,
+            .func_slots = NULL,
+            .length = 0,
+            .capacity = 0,
+            .index = {.buckets = NULL, .capacity = 0},
+        },
+        .stack = {.items = NULL, .capacity = 0, .size = 0},
+        .arena = {.blocks = NULL},
+        .allocations = 0,
+        .out = {.kind = HS_SINK_NONE},
+        .muted_prints = 0,
+        .settings = {
+            .output_mode = HS_OUTPUT_DEC,
+            .scient_min = 0.01,
+            .scient_max = 10000,
+            .dec_sep_char_in = '.',
+            .dec_sep_char_out = '.',
+            .sep_out = true,
+            .sep_char_in = '\'',
+            .sep_char_out = '\'',
+            .fold = true,
+            .cse = true,
+            .vm = true,
+            .memo = HS_MEMO_DEFAULT_SIZE,
+        },
+    };
+    state.context_vars = hs_alloc(&state, NULL, state.context_vars_length * sizeof(hs_var_t));
+    state.context_funcs = hs_alloc(&state, NULL, state.context_funcs_length * sizeof(hs_func_t));
+    if (state.context_vars == NULL) {
+        hs_error(&state, "out of memory during variable list initialization :(" ENDL);
+        return state;
+    }
+    if (state.context_funcs == NULL ) {
+        hs_error(&state, "out of memory during function list initialization :(" ENDL);
+        return state;
+    }
+    state.stack = hs_rpn_list_init(&state);
+    // "ans" is always the first symbol and the first variable
+    state.context_vars[0] = (hs_var_t){
+        .id = hs_symbol_intern(&state, "ans", 3),
+        .value = HS_ZERO,
+    };
+    for (size_t i = 0; i < sizeof(hs_default_vars) / sizeof(hs_default_var_t); i++) {
+        state.context_vars[i + 1] = (hs_var_t){
+            .id = hs_symbol_intern(&state, hs_default_vars[i].id, hs_str_len(hs_default_vars[i].id)),
+            .value = hs_default_vars[i].value,
+            .constant = true,
+        };
+    }
+    for (size_t i = 0; i < state.context_vars_length; i++) {
+        if (state.context_vars[i].id != HS_SYMBOL_NONE)
+            state.symbols.var_slots[state.context_vars[i].id] = i;
+    }
+    for (size_t i = 0; i < state.context_funcs_length; i++) {
+        state.context_funcs[i] = (hs_func_t){
+            .id = hs_symbol_intern(&state, hs_default_funcs[i].id, hs_str_len(hs_default_funcs[i].id)),
+            .func = hs_default_funcs[i].func,
+            .params_count = hs_default_funcs[i].params_count,
+            .params_linked = NULL,
+            .expression = NULL,
+            .body = {.items = NULL, .size = 0, .capacity = 0},
+        };
+        if (state.context_funcs[i].id != HS_SYMBOL_NONE)
+            state.symbols.func_slots[state.context_funcs[i].id] = i;
+    }
+
+    return state;
+}
+
+bool hs_vars_push(hs_state_t *state, hs_var_t var) {
+    if (var.id == HS_SYMBOL_NONE)
+        return false;
+    size_t var_i = hs_var_slot(state, var.id);
+    // functions of the base may read the name, so it can only be rebound in a copy of its own
+    if (var.id < state->symbols.first && var_i != state->context_vars_first) {
+        if (!hs_state_detach(state))
+            return false;
+        var_i = hs_var_slot(state, var.id);
+    }
+    bool was_constant = false;
+    if (var_i != -1) {
+        was_constant = hs_var_at(state, var_i)->constant;
+    } else {
+        state->context_vars_length++;
+        state->context_vars = hs_alloc(state, state->context_vars, state->context_vars_length * sizeof(hs_var_t));
+        if (state->context_vars == NULL) {
+            hs_error(state, "out of memory during variable list reallocation at " SIZE_T_F " tokens :(" ENDL, state->context_vars_length);
+            return false;
+        }
+        var_i = state->context_vars_first + state->context_vars_length - 1;
+        state->symbols.var_slots[var.id - state->symbols.first] = var_i;
+    }
+    *hs_var_at(state, var_i) = var;
+    state->line_version++;
+    // compiled bodies may have folded the old value
+    if (was_constant && !var.constant)
+        hs_funcs_recompile(state);
+    return true;
+}
+
+void hs_param_free_recursive(hs_func_param_t *param) {
+    if (param->next != NULL) {
+        hs_param_free_recursive(param->next);
+        param->next = NULL;
+    }
+    if (param != NULL) {
+        free(param);
+    }
+}
+
+hs_token_list_t hs_tokenize(char *input, size_t length, hs_state_t *state);
+hs_token_list_t hs_shunting_yard(hs_token_list_t *tokens, hs_state_t *state);
+hs_token_list_t hs_optimize(hs_token_list_t *rpn, hs_state_t *state);
+bool hs_program_compile(hs_token_list_t *rpn, hs_state_t *state, hs_program_t *program);
+hs_value_t hs_program_run(hs_program_t *program, hs_state_t *state, size_t frame);
+hs_value_t hs_solve(hs_token_list_t *tokens, hs_state_t *state, size_t frame);
+void hs_funcs_purity_all(hs_state_t *state);
+void hs_funcs_purity_from(hs_state_t *state, size_t func_i);
+
+void hs_body_free(hs_token_list_t *body, hs_program_t *program) {
+    if (body->items != NULL)
+        free(body->items);
+    if (body->values != NULL)
+        free(body->values);
+    if (program->code != NULL)
+        free(program->code);
+    if (program->values != NULL)
+        free(program->values);
+    *body = (hs_token_list_t){.items = NULL, .size = 0, .capacity = 0};
+    *program = (hs_program_t){.code = NULL, .size = 0};
+}
+
+void hs_funcs_body_free(hs_func_t *func) {
+    hs_body_free(&func->body, &func->program);
+}
+
+// the rpn is scratch memory, copies it and its program (if it compiles) to the heap so they outlive this evaluation
+bool hs_body_store(hs_state_t *state, hs_token_list_t *rpn, hs_token_list_t *body, hs_program_t *program) {
+    *body = *rpn;
+    body->capacity = rpn->size > 0 ? rpn->size : 1;
+    body->items = hs_alloc(state, NULL, body->capacity * sizeof(hs_token_t));
+    body->values = NULL;
+    body->values_capacity = rpn->values_size;
+    if (rpn->values_size > 0)
+        body->values = hs_alloc(state, NULL, rpn->values_size * sizeof(hs_value_t));
+    *program = (hs_program_t){.code = NULL, .size = 0};
+    if (body->items == NULL || (rpn->values_size > 0 && body->values == NULL)) {
+        hs_body_free(body, program);
+        return false;
+    }
+    for (size_t i = 0; i < rpn->size; i++)
+        body->items[i] = rpn->items[i];
+    for (size_t i = 0; i < rpn->values_size; i++)
+        body->values[i] = rpn->values[i];
+
+    hs_program_t compiled;
+    if (hs_program_compile(rpn, state, &compiled)) {
+        *program = compiled;
+        program->code = hs_alloc(state, NULL, compiled.size * sizeof(hs_instruction_t));
+        program->values = hs_alloc(state, NULL, (compiled.values_size > 0 ? compiled.values_size : 1) * sizeof(hs_value_t));
+        if (program->code == NULL || program->values == NULL) {
+            hs_body_free(body, program);
+            return false;
+        }
+        for (size_t i = 0; i < compiled.size; i++)
+            program->code[i] = compiled.code[i];
+        for (size_t i = 0; i < compiled.values_size; i++)
+            program->values[i] = compiled.values[i];
+    }
+    return true;
+}
+
+bool hs_funcs_compile(hs_state_t *state, hs_func_t *func) {
+    func->body = (hs_token_list_t){.items = NULL, .size = 0, .capacity = 0};
+    func->program = (hs_program_t){.code = NULL, .size = 0};
+    if (func->expression == NULL)
+        return true;
+
+    hs_token_list_t tokens = hs_tokenize(func->expression, hs_str_len(func->expression), state);
+    if (tokens.items == NULL)
+        return false;
+    hs_token_list_t rpn = hs_shunting_yard(&tokens, state);
+    if (rpn.items == NULL)
+        return false;
+
+    // bind references to parameters to their slot, everything else is resolved when called
+    for (size_t i = 0; i < rpn.size; i++) {
+        if (rpn.items[i].kind != HS_TOKEN_ID_IS_VAR)
+            continue;
+        hs_func_param_t *param = func->params_linked;
+        for (uint8_t p = 0; p < func->params_count && param != NULL; p++) {
+            if (rpn.items[i].symbol == param->id) {
+                rpn.items[i].kind = HS_TOKEN_PARAM;
+                rpn.items[i].param_i = p;
+                break;
+            }
+            param = param->next;
+        }
+    }
+    rpn = hs_optimize(&rpn, state);
+    if (rpn.items == NULL)
+        return false;
+    return hs_body_store(state, &rpn, &func->body, &func->program);
+}
+
+void hs_callers_free(hs_state_t *state) {
+    if (state->callers != NULL) {
+        for (size_t i = 0; i < state->callers_length; i++) {
+            if (state->callers[i].slots != NULL)
+                free(state->callers[i].slots);
+        }
+        free(state->callers);
+    }
+    state->callers = NULL;
+    state->callers_length = 0;
+}
+
+// adds the own function at func_i to the callers of every name its body calls, or removes it again.
+// does nothing while the callers are not built, false if out of memory (they are dropped then)
+bool hs_callers_update(hs_state_t *state, size_t func_i, bool add) {
+    if (state->callers == NULL)
+        return true;
+    hs_token_list_t *body = &hs_func_at(state, func_i)->body;
+    for (size_t t = 0; t < body->size; t++) {
+        if (body->items[t].kind != HS_TOKEN_ID)
+            continue;
+        hs_symbol_t symbol = body->items[t].symbol;
+        if (symbol >= state->callers_length) {
+            if (!add)
+                continue;
+            size_t length = state->callers_length * 2 > symbol ? state->callers_length * 2 : symbol + 1;
+            hs_callers_t *callers = hs_alloc(state, state->callers, length * sizeof(hs_callers_t));
+            if (callers == NULL)
+                goto hs_callers_update_error;
+            for (size_t i = state->callers_length; i < length; i++)
+                callers[i] = (hs_callers_t){.slots = NULL, .size = 0, .capacity = 0};
+            state->callers = callers;
+            state->callers_length = length;
+        }
+        hs_callers_t *callers = &state->callers[symbol];
+        uint32_t k = 0;
+        while (k < callers->size && callers->slots[k] != func_i)
+            k++;
+        if (!add) {
+            if (k < callers->size)
+                callers->slots[k] = callers->slots[--callers->size];
+        } else if (k == callers->size) {
+            if (callers->size == callers->capacity) {
+                uint32_t capacity = callers->capacity > 0 ? callers->capacity * 2 : 4;
+                uint32_t *slots = hs_alloc(state, callers->slots, capacity * sizeof(uint32_t));
+                if (slots == NULL)
+                    goto hs_callers_update_error;
+                callers->slots = slots;
+                callers->capacity = capacity;
+            }
+            callers->slots[callers->size++] = (uint32_t)func_i;
+        }
+    }
+    return true;
+
+hs_callers_update_error:
+    hs_callers_free(state);
+    return false;
+}
+
+// own functions calling symbol, builds the callers of every name the first time. NULL if out of memory
+hs_callers_t *hs_callers_of(hs_state_t *state, hs_symbol_t symbol) {
+    static hs_callers_t none = {.slots = NULL, .size = 0, .capacity = 0};
+    if (state->callers == NULL) {
+        size_t length = state->symbols.first + state->symbols.length;
+        state->callers = hs_alloc(state, NULL, (length > 0 ? length : 1) * sizeof(hs_callers_t));
+        if (state->callers == NULL)
+            return NULL;
+        for (size_t i = 0; i < length; i++)
+            state->callers[i] = (hs_callers_t){.slots = NULL, .size = 0, .capacity = 0};
+        state->callers_length = length;
+        for (size_t i = 0; i < state->context_funcs_length; i++) {
+            if (!hs_callers_update(state, state->context_funcs_first + i, true))
+                return NULL;
+        }
+    }
+    return symbol < state->callers_length ? &state->callers[symbol] : &none;
+}
+
+// compiles the own function at func_i again, keeping its callers up to date
+void hs_funcs_compile_at(hs_state_t *state, size_t func_i) {
+    hs_func_t *func = hs_func_at(state, func_i);
+    if (func->expression == NULL)
+        return;
+    hs_callers_update(state, func_i, false);
+    hs_funcs_body_free(func);
+    if (!hs_funcs_compile(state, func))
+        hs_error(state, "could not compile function %s" ENDL, hs_symbol_name(state, func->id));
+    hs_callers_update(state, func_i, true);
+}
+
+bool hs_funcs_push(hs_state_t *state, hs_func_t func) {
+    if (func.id == HS_SYMBOL_NONE)
+        return false;
+    // same as for variables, compiled functions of the base may call it
+    if (func.id < state->symbols.first && !hs_state_detach(state))
+        return false;
+    size_t func_i = hs_func_slot(state, func.id);
+    // compiled bodies refer to builtins they may have folded and to the parameter count of the functions they call,
+    // so replacing a builtin compiles everything again and a new name or parameter count the bodies calling it
+    bool recompile_all = false;
+    bool recompile_callers = true;
+    if (func_i != -1) {
+        hs_func_t *old = hs_func_at(state, func_i);
+        recompile_all = old->func != NULL;
+        recompile_callers = old->params_count != func.params_count;
+        hs_callers_update(state, func_i, false);
+        if (old->expression != NULL)
+            free(old->expression);
+        if (old->params_linked != NULL)
+            hs_param_free_recursive(old->params_linked);
+        hs_funcs_body_free(old);
+    }
+    func.body = (hs_token_list_t){.items = NULL, .size = 0, .capacity = 0};
+    func.program = (hs_program_t){.code = NULL, .size = 0};
+    if (func_i == -1) {
+        if (state->context_funcs_length >= state->context_funcs_capacity) {
+            size_t capacity = state->context_funcs_length * 2 > HS_LIST_INITIAL_CAPACITY ? state->context_funcs_length * 2 : HS_LIST_INITIAL_CAPACITY;
+            hs_func_t *funcs = hs_alloc(state, state->context_funcs, capacity * sizeof(hs_func_t));
+            if (funcs == NULL) {
+                hs_error(state, "out of memory during function list reallocation at " SIZE_T_F " tokens :(" ENDL, state->context_funcs_length);
+                return false;
+            }
+            state->context_funcs = funcs;
+            state->context_funcs_capacity = capacity;
+        }
+        state->context_funcs_length++;
+        func_i = state->context_funcs_first + state->context_funcs_length - 1;
+        state->symbols.func_slots[func.id - state->symbols.first] = func_i;
+    }
+    // placed before compiling, so it can call itself
+    *hs_func_at(state, func_i) = func;
+    if (recompile_all) {
+        hs_funcs_recompile(state);
+        return true;
+    }
+    hs_funcs_compile_at(state, func_i);
+    hs_callers_t *callers = recompile_callers ? hs_callers_of(state, func.id) : NULL;
+    if (recompile_callers && callers == NULL) {
+        hs_funcs_recompile(state);
+        return true;
+    }
+    if (callers != NULL && callers->size > 0) {
+        // compiling changes the callers, go through a copy
+        uint32_t *slots = hs_arena_alloc(state, callers->size * sizeof(uint32_t));
+        if (slots == NULL) {
+            hs_funcs_recompile(state);
+            return true;
+        }
+        size_t size = callers->size;
+        memcpy(slots, callers->slots, size * sizeof(uint32_t));
+        for (size_t i = 0; i < size; i++) {
+            if (slots[i] != func_i)
+                hs_funcs_compile_at(state, slots[i]);
+        }
+    }
+    hs_funcs_purity_from(state, func_i);
+    state->line_version++;
+    return true;
+}
+
+void hs_funcs_recompile(hs_state_t *state) {
+    for (size_t i = 0; i < state->context_funcs_length; i++) {
+        hs_func_t *func = &state->context_funcs[i];
+        if (func->expression == NULL)
+            continue;
+        hs_funcs_body_free(func);
+        if (!hs_funcs_compile(state, func))
+            hs_error(state, "could not compile function %s" ENDL, hs_symbol_name(state, func->id));
+    }
+    // built again from the new bodies when needed
+    hs_callers_free(state);
+    hs_funcs_purity_all(state);
+    state->line_version++;
+}
+
+void hs_memo_free(hs_memo_t *memo) {
+    if (memo->values != NULL)
+        free(memo->values);
+    if (memo->links != NULL)
+        free(memo->links);
+    if (memo->buckets != NULL)
+        free(memo->buckets);
+    *memo = (hs_memo_t){.values = NULL, .links = NULL, .buckets = NULL};
+}
+
+// a function is pure if it reads nothing but its parameters and constants and only calls builtins and other pure functions.
+// checks the own functions at slots again and empties their caches, every own function calling one of them has to be among them
+void hs_funcs_purity(hs_state_t *state, uint32_t *slots, size_t count) {
+    size_t funcs_count = hs_funcs_count(state);
+    bool *checked = hs_arena_alloc(state, funcs_count > 0 ? funcs_count : 1);
+    uint32_t *impure = hs_arena_alloc(state, (count > 0 ? count : 1) * sizeof(uint32_t));
+    size_t impure_count = 0;
+    if (checked == NULL || impure == NULL) {
+        // nothing is memoized then
+        for (size_t i = 0; i < count; i++)
+            hs_func_at(state, slots[i])->pure = hs_func_at(state, slots[i])->memoize = false;
+        state->memo_version++;
+        return;
+    }
+    memset(checked, 0, funcs_count);
+    for (size_t i = 0; i < count; i++)
+        checked[slots[i]] = true;
+    for (size_t i = 0; i < count; i++) {
+        hs_func_t *func = hs_func_at(state, slots[i]);
+        func->pure = func->func == NULL && func->body.items != NULL;
+        for (size_t t = 0; t < func->body.size && func->pure; t++) {
+            hs_token_t *token = &func->body.items[t];
+            if (token->kind == HS_TOKEN_ID_IS_VAR) {
+                size_t var_i = hs_var_slot(state, token->symbol);
+                func->pure = var_i != -1 && hs_var_at(state, var_i)->constant;
+            } else if (token->kind == HS_TOKEN_ID) {
+                // the ones being checked are assumed to be pure until shown otherwise below
+                size_t callee_i = hs_func_slot(state, token->symbol);
+                func->pure = callee_i != -1 && (checked[callee_i] || hs_func_at(state, callee_i)->func != NULL || hs_func_at(state, callee_i)->pure);
+            }
+        }
+        if (!func->pure)
+            impure[impure_count++] = slots[i];
+        if (slots[i] < state->memos_length)
+            hs_memo_free(&state->memos[slots[i]]);
+    }
+    // calling an impure function makes the caller impure
+    while (impure_count > 0) {
+        hs_callers_t *callers = hs_callers_of(state, hs_func_at(state, impure[--impure_count])->id);
+        for (uint32_t k = 0; callers == NULL && k < count; k++)
+            hs_func_at(state, slots[k])->pure = false;
+        if (callers == NULL)
+            break;
+        for (uint32_t k = 0; k < callers->size; k++) {
+            hs_func_t *caller = hs_func_at(state, callers->slots[k]);
+            if (checked[callers->slots[k]] && caller->pure) {
+                caller->pure = false;
+                impure[impure_count++] = callers->slots[k];
+            }
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        hs_func_t *func = hs_func_at(state, slots[i]);
+        func->memoize = func->pure && func->params_count <= HS_MEMO_MAX_PARAMS && func->body.size >= HS_MEMO_MIN_BODY;
+        for (size_t t = 0; t < func->body.size && func->pure && !func->memoize; t++) {
+            if (func->body.items[t].kind == HS_TOKEN_ID)
+                func->memoize = hs_func_at(state, hs_func_slot(state, func->body.items[t].symbol))->func == NULL;
+        }
+    }
+}
+
+// checks every own function again
+void hs_funcs_purity_all(hs_state_t *state) {
+    uint32_t *slots = hs_arena_alloc(state, (state->context_funcs_length > 0 ? state->context_funcs_length : 1) * sizeof(uint32_t));
+    if (slots == NULL) {
+        for (size_t i = 0; i < state->context_funcs_length; i++)
+            state->context_funcs[i].pure = state->context_funcs[i].memoize = false;
+        state->memo_version++;
+        return;
+    }
+    for (size_t i = 0; i < state->context_funcs_length; i++)
+        slots[i] = (uint32_t)(state->context_funcs_first + i);
+    hs_funcs_purity(state, slots, state->context_funcs_length);
+}
+
+// checks the own function at func_i and everything calling it, directly or through others
+void hs_funcs_purity_from(hs_state_t *state, size_t func_i) {
+    size_t funcs_count = hs_funcs_count(state);
+    bool *seen = hs_arena_alloc(state, funcs_count);
+    uint32_t *slots = hs_arena_alloc(state, state->context_funcs_length * sizeof(uint32_t));
+    if (seen == NULL || slots == NULL) {
+        hs_funcs_purity_all(state);
+        return;
+    }
+    memset(seen, 0, funcs_count);
+    size_t count = 0;
+    slots[count++] = (uint32_t)func_i;
+    seen[func_i] = true;
+    for (size_t i = 0; i < count; i++) {
+        hs_callers_t *callers = hs_callers_of(state, hs_func_at(state, slots[i])->id);
+        if (callers == NULL) {
+            hs_funcs_purity_all(state);
+            return;
+        }
+        for (uint32_t k = 0; k < callers->size; k++) {
+            if (!seen[callers->slots[k]]) {
+                seen[callers->slots[k]] = true;
+                slots[count++] = callers->slots[k];
+            }
+        }
+    }
+    hs_funcs_purity(state, slots, count);
+}
+
+// hash of the exact bits of the arguments, so -0 and 0 or two different nans are different keys
+uint64_t hs_memo_hash(hs_value_t *args, uint8_t count) {
+    uint64_t hash = 0x9e3779b97f4a7c15;
+    for (uint8_t i = 0; i < count; i++) {
+        uint64_t bits[2];
+        memcpy(bits, &args[i], sizeof(bits));
+        hash = (hash ^ bits[0]) * 0xff51afd7ed558ccd;
+        hash = (hash ^ bits[1]) * 0xc4ceb9fe1a85ec53;
+        hash ^= hash >> 33;
+    }
+    // small integers only differ in their upper bits, mix them down to the bucket bits
+    hash *= 0xff51afd7ed558ccd;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// cache of the function at slot, emptied if the functions changed since it was filled. NULL if memoization is off
+hs_memo_t *hs_memo_at(hs_state_t *state, size_t slot) {
+    if (state->settings.memo == 0)
+        return NULL;
+    if (slot >= state->memos_length) {
+        size_t length = hs_funcs_count(state);
+        hs_memo_t *memos = hs_alloc(state, state->memos, length * sizeof(hs_memo_t));
+        if (memos == NULL)
+            return NULL;
+        for (size_t i = state->memos_length; i < length; i++)
+            memos[i] = (hs_memo_t){.values = NULL, .links = NULL, .buckets = NULL};
+        state->memos = memos;
+        state->memos_length = length;
+    }
+    hs_memo_t *memo = &state->memos[slot];
+    if (memo->version != state->memo_version) {
+        // the function may not even have the same parameters anymore
+        hs_memo_free(memo);
+        memo->version = state->memo_version;
+    }
+    return memo;
+}
+
+void hs_memo_unlink(hs_memo_t *memo, uint32_t entry) {
+    hs_memo_link_t *link = &memo->links[entry - 1];
+    if (link->newer != 0)
+        memo->links[link->newer - 1].older = link->older;
+    else
+        memo->newest = link->older;
+    if (link->older != 0)
+        memo->links[link->older - 1].newer = link->newer;
+    else
+        memo->oldest = link->newer;
+}
+
+void hs_memo_link_newest(hs_memo_t *memo, uint32_t entry) {
+    hs_memo_link_t *link = &memo->links[entry - 1];
+    link->newer = 0;
+    link->older = memo->newest;
+    if (memo->newest != 0)
+        memo->links[memo->newest - 1].newer = entry;
+    else
+        memo->oldest = entry;
+    memo->newest = entry;
+}
+
+// result of an earlier call with the same arguments, which becomes the most recently used entry
+bool hs_memo_get(hs_memo_t *memo, uint8_t count, hs_value_t *args, hs_value_t *result) {
+    if (memo->size == 0)
+        return false;
+    uint32_t entry = memo->buckets[hs_memo_hash(args, count) & memo->bucket_mask];
+    while (entry != 0) {
+        hs_value_t *values = memo->values + (size_t)(entry - 1) * (count + 1);
+        if (memcmp(values, args, count * sizeof(hs_value_t)) == 0) {
+            if (entry != memo->newest) {
+                hs_memo_unlink(memo, entry);
+                hs_memo_link_newest(memo, entry);
+            }
+            *result = values[count];
+            return true;
+        }
+        entry = memo->links[entry - 1].next;
+    }
+    return false;
+}
+
+// remembers result for args, evicting the least recently used entry if the cache is full
+void hs_memo_put(hs_state_t *state, hs_memo_t *memo, uint8_t count, hs_value_t *args, hs_value_t result) {
+    if (memo->values == NULL) {
+        uint32_t capacity = state->settings.memo;
+        uint32_t buckets = 1;
+        while (buckets < 2 * capacity)
+            buckets *= 2;
+        memo->values = hs_alloc(state, NULL, (size_t)capacity * (count + 1) * sizeof(hs_value_t));
+        memo->links = hs_alloc(state, NULL, capacity * sizeof(hs_memo_link_t));
+        memo->buckets = hs_alloc(state, NULL, buckets * sizeof(uint32_t));
+        if (memo->values == NULL || memo->links == NULL || memo->buckets == NULL) {
+            uint64_t version = memo->version;
+            hs_memo_free(memo);
+            memo->version = version;
+            return;
+        }
+        memset(memo->buckets, 0, buckets * sizeof(uint32_t));
+        memo->capacity = capacity;
+        memo->bucket_mask = buckets - 1;
+    }
+    uint32_t entry;
+    if (memo->size < memo->capacity) {
+        entry = ++memo->size;
+    } else {
+        entry = memo->oldest;
+        hs_memo_unlink(memo, entry);
+        hs_value_t *old = memo->values + (size_t)(entry - 1) * (count + 1);
+        uint32_t *next = &memo->buckets[hs_memo_hash(old, count) & memo->bucket_mask];
+        while (*next != entry)
+            next = &memo->links[*next - 1].next;
+        *next = memo->links[entry - 1].next;
+    }
+    hs_value_t *values = memo->values + (size_t)(entry - 1) * (count + 1);
+    memcpy(values, args, count * sizeof(hs_value_t));
+    values[count] = result;
+    uint32_t *bucket = &memo->buckets[hs_memo_hash(args, count) & memo->bucket_mask];
+    memo->links[entry - 1].next = *bucket;
+    *bucket = entry;
+    hs_memo_link_newest(memo, entry);
+}
+
+// calls the user function at func_i, its arguments are the topmost values of the stack from call_frame on.
+// a pure function answers from its cache if it was called with the same arguments before
+hs_value_t hs_call(hs_state_t *state, size_t func_i, hs_func_t *func, size_t call_frame, bool vm) {
+    state->stats.calls++;
+    bool memoize = func->memoize && hs_memo_at(state, func_i) != NULL;
+    hs_value_t result;
+    if (memoize && hs_memo_get(&state->memos[func_i], func->params_count, state->stack.items + call_frame, &result)) {
+        state->stats.memo_hits++;
+        return result;
+    }
+    size_t prints = state->prints;
+    result = HS_ZERO;
+    if (vm && func->program.code != NULL) {
+        result = hs_program_run(&func->program, state, call_frame);
+    } else if (func->body.size > 0) {
+        result = hs_solve(&func->body, state, call_frame);
+    }
+    if (memoize) {
+        state->stats.memo_misses++;
+        // a call that warned has to warn again, the nested calls may have moved the caches and the stack
+        if (state->prints == prints)
+            hs_memo_put(state, &state->memos[func_i], func->params_count, state->stack.items + call_frame, result);
+    }
+    return result;
+}
+
+void hs_func_free(hs_func_t *func) {
+    if (func->expression != NULL)
+        free(func->expression);
+    if (func->params_linked != NULL)
+        hs_param_free_recursive(func->params_linked);
+    hs_funcs_body_free(func);
+}
+
+// frees the own variables, functions and symbols of state, never its base
+void hs_defs_free(hs_state_t *state) {
+    if (state->context_vars != NULL)
+        free(state->context_vars);
+    if (state->context_funcs != NULL) {
+        for (size_t i = 0; i < state->context_funcs_length; i++)
+            hs_func_free(&state->context_funcs[i]);
+        free(state->context_funcs);
+    }
+    if (state->symbols.names != NULL)
+        free(state->symbols.names);
+    if (state->symbols.name_offsets != NULL)
+        free(state->symbols.name_offsets);
+    if (state->symbols.var_slots != NULL)
+        free(state->symbols.var_slots);
+    if (state->symbols.func_slots != NULL)
+        free(state->symbols.func_slots);
+    if (state->symbols.index.buckets != NULL)
+        free(state->symbols.index.buckets);
+    hs_callers_free(state);
+    state->context_vars = NULL;
+    state->context_funcs = NULL;
+    state->context_funcs_capacity = 0;
+    state->symbols = (hs_symbols_t){.names = NULL, .index = {.buckets = NULL}};
+}
+
+// hands the definitions of from over to to, from is left without any
+void hs_defs_move(hs_state_t *to, hs_state_t *from) {
+    to->context_vars = from->context_vars;
+    to->context_vars_length = from->context_vars_length;
+    to->context_vars_first = from->context_vars_first;
+    to->context_funcs = from->context_funcs;
+    to->context_funcs_length = from->context_funcs_length;
+    to->context_funcs_first = from->context_funcs_first;
+    to->context_funcs_capacity = from->context_funcs_capacity;
+    to->symbols = from->symbols;
+    to->base = from->base;
+    to->callers = from->callers;
+    to->callers_length = from->callers_length;
+    from->context_vars = NULL;
+    from->context_funcs = NULL;
+    from->context_funcs_length = 0;
+    from->context_funcs_capacity = 0;
+    from->callers = NULL;
+    from->callers_length = 0;
+    from->symbols = (hs_symbols_t){.names = NULL, .index = {.buckets = NULL}};
+    from->base = NULL;
+}
+
+void hs_base_free(hs_base_t *base) {
+    if (base->image != NULL) {
+        hs_image_unmap(base->image, base->image_size);
+    } else {
+        hs_state_t holder = {.context_vars = base->vars, .context_funcs = base->funcs, .context_funcs_length = base->funcs_length, .symbols = base->symbols};
+        hs_defs_free(&holder);
+    }
+    free(base);
+}
+
+void hs_shared_lock(hs_shared_t *shared) {
+#if HS_THREADS
+    pthread_mutex_lock(&shared->lock);
+#endif
+}
+
+void hs_shared_unlock(hs_shared_t *shared) {
+#if HS_THREADS
+    pthread_mutex_unlock(&shared->lock);
+#endif
+}
+
+// frees the retired bases no reader can still be using, without wait it gives up if someone else holds the lock
+void hs_shared_reclaim(hs_shared_t *shared, bool wait) {
+#if HS_THREADS
+    if (wait) {
+        pthread_mutex_lock(&shared->lock);
+    } else if (pthread_mutex_trylock(&shared->lock) != 0) {
+        return;
+    }
+#endif
+    uint64_t oldest = UINT64_MAX;
+    for (hs_reader_t *reader = shared->readers; reader != NULL; reader = reader->next) {
+        uint64_t epoch = atomic_load(&reader->epoch);
+        if (epoch < oldest)
+            oldest = epoch;
+    }
+    hs_base_t **next = &shared->retired;
+    while (*next != NULL) {
+        hs_base_t *base = *next;
+        if (base->retired_epoch < oldest) {
+            *next = base->retired_next;
+            hs_base_free(base);
+        } else {
+            next = &base->retired_next;
+        }
+    }
+    hs_shared_unlock(shared);
+}
+
+// stops state from reading the bases of its hs_shared_t, it must not use its base anymore
+void hs_shared_leave(hs_state_t *state) {
+    hs_shared_t *shared = state->shared;
+    if (shared == NULL)
+        return;
+    hs_shared_lock(shared);
+    for (hs_reader_t **next = &shared->readers; *next != NULL; next = &(*next)->next) {
+        if (*next == state->reader) {
+            *next = state->reader->next;
+            break;
+        }
+    }
+    hs_shared_unlock(shared);
+    free(state->reader);
+    state->reader = NULL;
+    state->shared = NULL;
+    hs_shared_reclaim(shared, false);
+}
+
+void hs_state_free(hs_state_t *state) {
+    hs_shared_leave(state);
+    hs_defs_free(state);
+    if (state->snapshot != NULL)
+        hs_base_free(state->snapshot);
+    if (state->memos != NULL) {
+        for (size_t i = 0; i < state->memos_length; i++)
+            hs_memo_free(&state->memos[i]);
+        free(state->memos);
+    }
+    if (state->lines != NULL) {
+        for (size_t i = 0; i < HS_LINE_CACHE_SIZE; i++) {
+            if (state->lines[i].data != NULL)
+                free(state->lines[i].data);
+        }
+        free(state->lines);
+    }
+    if (state->stack.items != NULL)
+        free(state->stack.items);
+    hs_arena_free(state);
+    if (state->out.data != NULL)
+        free(state->out.data);
+    if (state->messages.data != NULL)
+        free(state->messages.data);
+    *state = (hs_state_t){.context_vars = NULL, .context_funcs = NULL};
+}
+
+// deep copy of func into the zeroed func, what could not be copied stays NULL
+bool hs_func_copy(hs_state_t *state, hs_func_t *func, hs_func_t *source) {
+    *func = *source;
+    func->expression = NULL;
+    func->params_linked = NULL;
+    func->body.items = NULL;
+    func->body.values = NULL;
+    func->program.code = NULL;
+    func->program.values = NULL;
+    if (source->expression != NULL) {
+        size_t length = hs_str_len(source->expression);
+        func->expression = hs_alloc(state, NULL, length + 1);
+        if (func->expression == NULL)
+            return false;
+        memcpy(func->expression, source->expression, length + 1);
+    }
+    hs_func_param_t **param_next = &func->params_linked;
+    for (hs_func_param_t *param = source->params_linked; param != NULL; param = param->next) {
+        *param_next = hs_alloc(state, NULL, sizeof(hs_func_param_t));
+        if (*param_next == NULL)
+            return false;
+        **param_next = (hs_func_param_t){.id = param->id, .next = NULL};
+        param_next = &(*param_next)->next;
+    }
+    if (source->body.items != NULL) {
+        func->body.items = hs_alloc(state, NULL, func->body.capacity * sizeof(hs_token_t));
+        if (func->body.items == NULL)
+            return false;
+        memcpy(func->body.items, source->body.items, func->body.size * sizeof(hs_token_t));
+    }
+    if (source->body.values != NULL) {
+        func->body.values = hs_alloc(state, NULL, func->body.values_capacity * sizeof(hs_value_t));
+        if (func->body.values == NULL)
+            return false;
+        memcpy(func->body.values, source->body.values, func->body.values_size * sizeof(hs_value_t));
+    }
+    if (source->program.code != NULL) {
+        func->program.code = hs_alloc(state, NULL, func->program.size * sizeof(hs_instruction_t));
+        func->program.values = hs_alloc(state, NULL, (func->program.values_size > 0 ? func->program.values_size : 1) * sizeof(hs_value_t));
+        if (func->program.code == NULL || func->program.values == NULL)
+            return false;
+        memcpy(func->program.code, source->program.code, func->program.size * sizeof(hs_instruction_t));
+        memcpy(func->program.values, source->program.values, func->program.values_size * sizeof(hs_value_t));
+    }
+    return true;
+}
+
+// deep copy of everything but the scratch memory, the copy gets its own stack and arena.
+// the definitions of a base are copied as well, so the copy never has a base
+hs_state_t hs_state_copy(hs_state_t *source) {
+    hs_symbols_t *base_symbols = source->base != NULL ? &source->base->symbols : NULL;
+    size_t base_names_size = base_symbols != NULL ? base_symbols->names_size : 0;
+    hs_symbol_t first = source->symbols.first;
+    size_t symbols_length = first + source->symbols.length;
+    hs_state_t state = {
+        .context_vars = NULL,
+        .context_vars_length = hs_vars_count(source),
+        .context_funcs = NULL,
+        .context_funcs_length = hs_funcs_count(source),
+        .symbols = {
+            .names_size = base_names_size + source->symbols.names_size,
+            .names_capacity = base_names_size + source->symbols.names_capacity,
+            .length = symbols_length,
+            .capacity = symbols_length,
+        },
+        .stack = {.items = NULL, .capacity = 0, .size = 0},
+        .arena = {.blocks = NULL},
+        .allocations = 0,
+        // same destination, but a buffer of its own
+        .out = {.kind = source->out.kind, .file = source->out.file, .callback = source->out.callback, .context = source->out.context},
+        .files_refused = source->files_refused,
+        .settings = source->settings,
+    };
+    hs_symbols_t *symbols = &state.symbols;
+    symbols->names = hs_alloc(&state, NULL, symbols->names_capacity);
+    symbols->name_offsets = hs_alloc(&state, NULL, symbols->capacity * sizeof(size_t));
+    symbols->var_slots = hs_alloc(&state, NULL, symbols->capacity * sizeof(size_t));
+    symbols->func_slots = hs_alloc(&state, NULL, symbols->capacity * sizeof(size_t));
+    state.context_vars = hs_alloc(&state, NULL, state.context_vars_length * sizeof(hs_var_t));
+    state.context_funcs = hs_alloc(&state, NULL, (state.context_funcs_length > 0 ? state.context_funcs_length : 1) * sizeof(hs_func_t));
+    if (state.context_funcs != NULL) {
+        for (size_t i = 0; i < state.context_funcs_length; i++)
+            state.context_funcs[i] = (hs_func_t){.expression = NULL, .params_linked = NULL, .body = {.items = NULL}, .program = {.code = NULL}};
+    }
+    if (symbols->names == NULL || symbols->name_offsets == NULL || symbols->var_slots == NULL || symbols->func_slots == NULL
+        || state.context_vars == NULL || state.context_funcs == NULL)
+        goto hs_state_copy_error;
+    if (base_symbols != NULL)
+        memcpy(symbols->names, base_symbols->names, base_names_size);
+    if (source->symbols.names_size > 0)
+        memcpy(symbols->names + base_names_size, source->symbols.names, source->symbols.names_size);
+    size_t vars_first = source->context_vars_first;
+    for (hs_symbol_t symbol = 0; symbol < symbols_length; symbol++) {
+        if (symbol < first) {
+            symbols->name_offsets[symbol] = base_symbols->name_offsets[symbol];
+        } else {
+            symbols->name_offsets[symbol] = base_names_size + source->symbols.name_offsets[symbol - first];
+        }
+        // "ans" moves back in front of the variables of the base
+        size_t var_i = hs_var_slot(source, symbol);
+        if (var_i != -1)
+            var_i = var_i < vars_first ? var_i + 1 : var_i == vars_first ? 0 : var_i;
+        symbols->var_slots[symbol] = var_i;
+        symbols->func_slots[symbol] = hs_func_slot(source, symbol);
+    }
+    size_t index_capacity = 128;
+    while (symbols_length * 2 > index_capacity)
+        index_capacity *= 2;
+    if (!hs_symbols_rehash(&state, index_capacity))
+        goto hs_state_copy_error;
+    for (size_t i = 0; i < state.context_vars_length; i++)
+        state.context_vars[i] = *hs_var_listed(source, i);
+    for (size_t i = 0; i < state.context_funcs_length; i++) {
+        if (!hs_func_copy(&state, &state.context_funcs[i], hs_func_at(source, i)))
+            goto hs_state_copy_error;
+    }
+
+    state.stack = hs_rpn_list_init(&state);
+    return state;
+
+hs_state_copy_error:
+    hs_error(&state, "out of memory while copying state :(" ENDL);
+    hs_state_free(&state);
+    return state;
+}
+
+// frozen copy of the definitions and settings of state, NULL if out of memory
+hs_base_t *hs_base_create(hs_state_t *state) {
+    hs_base_t *base = hs_alloc(state, NULL, sizeof(hs_base_t));
+    hs_state_t flat = hs_state_copy(state);
+    if (base == NULL || flat.context_vars == NULL || flat.context_funcs == NULL) {
+        hs_error(state, "out of memory while creating the base context :(" ENDL);
+        if (base != NULL)
+            free(base);
+        hs_state_free(&flat);
+        return NULL;
+    }
+    // "ans" stays with the states, each one has its own right after the variables of the base
+    size_t vars_length = flat.context_vars_length - 1;
+    memmove(flat.context_vars, flat.context_vars + 1, vars_length * sizeof(hs_var_t));
+    for (hs_symbol_t symbol = 0; symbol < flat.symbols.length; symbol++) {
+        size_t var_i = flat.symbols.var_slots[symbol];
+        if (var_i != -1)
+            flat.symbols.var_slots[symbol] = var_i == 0 ? vars_length : var_i - 1;
+    }
+    *base = (hs_base_t){
+        .vars_length = vars_length,
+        .funcs_length = flat.context_funcs_length,
+        .settings = flat.settings,
+        .retired_epoch = 0,
+        .retired_next = NULL,
+    };
+    base->symbols = flat.symbols;
+    base->vars = flat.context_vars;
+    base->funcs = flat.context_funcs;
+    flat.context_vars = NULL;
+    flat.context_funcs = NULL;
+    flat.context_funcs_length = 0;
+    flat.symbols = (hs_symbols_t){.names = NULL, .index = {.buckets = NULL}};
+    hs_state_free(&flat);
+    state->allocations += flat.allocations;
+    return base;
+}
+
+// replaces the (already freed or moved) definitions of state with an empty layer on top of base
+bool hs_state_layer(hs_state_t *state, hs_base_t *base) {
+    state->base = base;
+    // the functions move to other slots
+    state->memo_version++;
+    state->symbols = (hs_symbols_t){.names = NULL, .index = {.buckets = NULL}, .first = base->symbols.length};
+    state->context_vars_first = base->vars_length;
+    state->context_vars_length = 1;
+    state->context_vars = hs_alloc(state, NULL, sizeof(hs_var_t));
+    state->context_funcs_first = base->funcs_length;
+    state->context_funcs_length = 0;
+    state->context_funcs = hs_alloc(state, NULL, sizeof(hs_func_t));
+    if (state->context_vars == NULL || state->context_funcs == NULL) {
+        hs_error(state, "out of memory during variable list initialization :(" ENDL);
+        return false;
+    }
+    state->context_vars[0] = (hs_var_t){
+        .id = hs_symbol_intern(state, "ans", 3),
+        .value = HS_ZERO,
+    };
+    return true;
+}
+
+// gives a layered state a private copy of its base, so it can rebind what the base defines.
+// it does not follow the bases published afterwards anymore
+bool hs_state_detach(hs_state_t *state) {
+    if (state->base == NULL)
+        return true;
+    hs_state_t flat = hs_state_copy(state);
+    if (flat.context_vars == NULL || flat.context_funcs == NULL) {
+        hs_error(state, "out of memory while copying the base context :(" ENDL);
+        return false;
+    }
+    hs_shared_leave(state);
+    hs_defs_free(state);
+    hs_defs_move(state, &flat);
+    if (state->snapshot != NULL)
+        hs_base_free(state->snapshot);
+    state->snapshot = NULL;
+    state->memo_version++;
+    state->allocations += flat.allocations;
+    hs_state_free(&flat);
+    return true;
+}
+
+// moves the own definitions of state on top of base, they are compiled again against it
+bool hs_state_rebase(hs_state_t *state, hs_base_t *base) {
+    hs_state_t old = {.context_vars = NULL};
+    hs_defs_move(&old, state);
+    if (!hs_state_layer(state, base)) {
+        hs_defs_free(state);
+        hs_defs_move(state, &old);
+        return false;
+    }
+    state->context_vars[0].value = old.context_vars[0].value;
+
+    // all names are looked up before anything is pushed, a push may detach the state and let the old base go
+    for (size_t i = 1; i < old.context_vars_length; i++) {
+        char *name = hs_symbol_name(&old, old.context_vars[i].id);
+        old.context_vars[i].id = hs_symbol_intern(state, name, hs_str_len(name));
+    }
+    for (size_t i = 0; i < old.context_funcs_length; i++) {
+        hs_func_t *func = &old.context_funcs[i];
+        char *name = hs_symbol_name(&old, func->id);
+        func->id = hs_symbol_intern(state, name, hs_str_len(name));
+        for (hs_func_param_t *param = func->params_linked; param != NULL; param = param->next) {
+            name = hs_symbol_name(&old, param->id);
+            param->id = hs_symbol_intern(state, name, hs_str_len(name));
+        }
+    }
+    old.base = NULL;
+
+    bool success = true;
+    for (size_t i = 1; i < old.context_vars_length; i++)
+        success = hs_vars_push(state, old.context_vars[i]) && success;
+    for (size_t i = 0; i < old.context_funcs_length; i++) {
+        hs_func_t func = old.context_funcs[i];
+        hs_funcs_body_free(&old.context_funcs[i]);
+        old.context_funcs[i].expression = NULL;
+        old.context_funcs[i].params_linked = NULL;
+        if (!hs_funcs_push(state, func)) {
+            hs_func_free(&func);
+            success = false;
+        }
+    }
+    hs_defs_free(&old);
+    return success;
+}
+
+// switches a state reading a hs_shared_t over to the newest base, unless compiled expressions still rely on the current one
+void hs_state_sync(hs_state_t *state) {
+    hs_shared_t *shared = state->shared;
+    if (shared == NULL || state->exprs > 0)
+        return;
+    if (atomic_load_explicit(&shared->current, memory_order_acquire) == state->base)
+        return;
+    // the epoch announced before keeps the old base alive until its definitions are moved over
+    uint64_t epoch = atomic_load(&shared->epoch);
+    hs_base_t *base = atomic_load(&shared->current);
+    hs_state_rebase(state, base);
+    if (state->reader != NULL) {
+        atomic_store(&state->reader->epoch, epoch);
+        hs_shared_reclaim(shared, false);
+    }
+}
+
+#define HS_IMAGE_MAGIC "HSOLVER"
+#define HS_IMAGE_VERSION 2
+#define HS_IMAGE_BYTE_ORDER 0x01020304u
+// every section starts aligned like this, so the image can be used right where it is mapped
+#define HS_IMAGE_ALIGN 16
+
+// start of a snapshot, the sections follow at the given offsets.
+// the definitions are laid out like a base context (see hs_base), pointers inside functions are stored as offsets
+typedef struct hs_image_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    // sizes of the structures stored as they are in memory, an image only loads into a build that lays them out the same
+    uint16_t sizes[8];
+    uint64_t size;
+    hs_settings_t settings;
+    hs_value_t ans;
+    uint64_t symbols_length;
+    uint64_t names_size;
+    uint64_t index_capacity;
+    uint64_t vars_length;
+    uint64_t funcs_length;
+    uint64_t names;
+    uint64_t name_offsets;
+    uint64_t var_slots;
+    uint64_t func_slots;
+    uint64_t buckets;
+    uint64_t vars;
+    uint64_t funcs;
+} hs_image_header_t;
+
+const uint16_t hs_image_sizes[8] = {
+    sizeof(size_t), sizeof(void *), sizeof(hs_settings_t), sizeof(hs_var_t),
+    sizeof(hs_func_t), sizeof(hs_func_param_t), sizeof(hs_token_t), sizeof(hs_instruction_t),
+};
+
+typedef struct hs_image_writer {
+    FILE *file;
+    uint64_t size;
+    bool failed;
+} hs_image_writer_t;
+
+// appends data at the next aligned offset and returns that offset, which is never 0 after the header
+uint64_t hs_image_put(hs_image_writer_t *writer, const void *data, size_t size) {
+    static const char padding[HS_IMAGE_ALIGN] = {0};
+    size_t pad = (HS_IMAGE_ALIGN - writer->size % HS_IMAGE_ALIGN) % HS_IMAGE_ALIGN;
+    if (pad > 0 && fwrite(padding, 1, pad, writer->file) != pad)
+        writer->failed = true;
+    uint64_t offset = writer->size + pad;
+    if (size > 0 && fwrite(data, 1, size, writer->file) != size)
+        writer->failed = true;
+    writer->size = offset + size;
+    return offset;
+}
+
+#define HS_IMAGE_OFFSET(offset) ((void *)(uintptr_t)(offset))
+
+// copy of func with everything it points to written to the image and replaced by its offset
+hs_func_t hs_image_put_func(hs_image_writer_t *writer, hs_func_t *func) {
+    hs_func_t stored = *func;
+    if (func->expression != NULL)
+        stored.expression = HS_IMAGE_OFFSET(hs_image_put(writer, func->expression, hs_str_len(func->expression) + 1));
+    if (func->params_linked != NULL) {
+        hs_func_param_t params[UINT8_MAX + 1];
+        size_t count = 0;
+        for (hs_func_param_t *param = func->params_linked; param != NULL && count <= UINT8_MAX; param = param->next)
+            params[count++] = (hs_func_param_t){.id = param->id, .next = NULL};
+        // the nodes are stored as an array, each one links to the one after it
+        uint64_t offset = writer->size + (HS_IMAGE_ALIGN - writer->size % HS_IMAGE_ALIGN) % HS_IMAGE_ALIGN;
+        for (size_t i = 0; i + 1 < count; i++)
+            params[i].next = HS_IMAGE_OFFSET(offset + (i + 1) * sizeof(hs_func_param_t));
+        stored.params_linked = HS_IMAGE_OFFSET(hs_image_put(writer, params, count * sizeof(hs_func_param_t)));
+    }
+    if (func->body.items != NULL) {
+        hs_token_t none = {.kind = HS_TOKEN_EOF};
+        stored.body.capacity = func->body.size > 0 ? func->body.size : 1;
+        stored.body.items = HS_IMAGE_OFFSET(hs_image_put(writer, func->body.size > 0 ? func->body.items : &none, stored.body.capacity * sizeof(hs_token_t)));
+    }
+    if (func->body.values != NULL) {
+        stored.body.values_capacity = func->body.values_size;
+        stored.body.values = HS_IMAGE_OFFSET(hs_image_put(writer, func->body.values, func->body.values_size * sizeof(hs_value_t)));
+    }
+    if (func->program.code != NULL) {
+        // the handler addresses are resolved again when loading
+        stored.program.code = HS_IMAGE_OFFSET(hs_image_put(writer, func->program.code, func->program.size * sizeof(hs_instruction_t)));
+        stored.program.values = HS_IMAGE_OFFSET(hs_image_put(writer, func->program.values, func->program.values_size * sizeof(hs_value_t)));
+    }
+    return stored;
+}
+
+// writes the definitions and settings of state to path as an image for hs_snapshot_load
+bool hs_snapshot_save(hs_state_t *state, const char *path) {
+    if (state == NULL || path == NULL)
+        return false;
+    hs_state_sync(state);
+    bool success = false;
+    hs_func_t *funcs = NULL;
+    hs_base_t *base = hs_base_create(state);
+    if (base == NULL)
+        return false;
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        hs_error(state, "could not open %s for writing" ENDL, path);
+        goto hs_snapshot_save_done;
+    }
+    funcs = hs_alloc(state, NULL, (base->funcs_length > 0 ? base->funcs_length : 1) * sizeof(hs_func_t));
+    if (funcs == NULL) {
+        hs_error(state, "out of memory while saving %s :(" ENDL, path);
+        goto hs_snapshot_save_done;
+    }
+
+    hs_symbols_t *symbols = &base->symbols;
+    hs_image_header_t header = {
+        .version = HS_IMAGE_VERSION,
+        .byte_order = HS_IMAGE_BYTE_ORDER,
+        .settings = base->settings,
+        .ans = state->context_vars[0].value,
+        .symbols_length = symbols->length,
+        .names_size = symbols->names_size,
+        .index_capacity = symbols->index.capacity,
+        .vars_length = base->vars_length,
+        .funcs_length = base->funcs_length,
+    };
+    memcpy(header.magic, HS_IMAGE_MAGIC, sizeof(header.magic));
+    memcpy(header.sizes, hs_image_sizes, sizeof(header.sizes));
+    hs_image_writer_t writer = {.file = file, .size = 0, .failed = false};
+    // written again once the offsets are known
+    hs_image_put(&writer, &header, sizeof(header));
+    header.names = hs_image_put(&writer, symbols->names, symbols->names_size);
+    header.name_offsets = hs_image_put(&writer, symbols->name_offsets, symbols->length * sizeof(size_t));
+    header.var_slots = hs_image_put(&writer, symbols->var_slots, symbols->length * sizeof(size_t));
+    header.func_slots = hs_image_put(&writer, symbols->func_slots, symbols->length * sizeof(size_t));
+    header.buckets = hs_image_put(&writer, symbols->index.buckets, symbols->index.capacity * sizeof(hs_symbol_t));
+    header.vars = hs_image_put(&writer, base->vars, base->vars_length * sizeof(hs_var_t));
+    for (size_t i = 0; i < base->funcs_length; i++)
+        funcs[i] = hs_image_put_func(&writer, &base->funcs[i]);
+    header.funcs = hs_image_put(&writer, funcs, base->funcs_length * sizeof(hs_func_t));
+    header.size = writer.size;
+    if (fseek(file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, file) != 1)
+        writer.failed = true;
+    if (fclose(file) != 0)
+        writer.failed = true;
+    file = NULL;
+    if (writer.failed) {
+        hs_error(state, "could not write %s" ENDL, path);
+        goto hs_snapshot_save_done;
+    }
+    success = true;
+
+hs_snapshot_save_done:
+    if (file != NULL)
+        fclose(file);
+    if (funcs != NULL)
+        free(funcs);
+    hs_base_free(base);
+    return success;
+}
+
+// maps the file at path (or reads it where there is no mmap) into private, writable memory, NULL on error
+void *hs_image_map(hs_state_t *state, const char *path, size_t *size) {
+#if HS_MMAP
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        hs_error(state, "could not open %s" ENDL, path);
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+    *size = info.st_size;
+    void *image = *size >= sizeof(hs_image_header_t) ? mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (image == NULL || image == MAP_FAILED) {
+        hs_error(state, "could not map %s" ENDL, path);
+        return NULL;
+    }
+    return image;
+#else
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        hs_error(state, "could not open %s" ENDL, path);
+        return NULL;
+    }
+    void *image = NULL;
+    long length = -1;
+    if (fseek(file, 0, SEEK_END) == 0)
+        length = ftell(file);
+    if (length >= (long)sizeof(hs_image_header_t) && fseek(file, 0, SEEK_SET) == 0) {
+        *size = length;
+        image = hs_alloc(state, NULL, *size);
+        if (image != NULL && fread(image, 1, *size, file) != *size) {
+            free(image);
+            image = NULL;
+        }
+    }
+    fclose(file);
+    if (image == NULL)
+        hs_error(state, "could not read %s" ENDL, path);
+    return image;
+#endif
+}
+
+void hs_image_unmap(void *image, size_t size) {
+#if HS_MMAP
+    munmap(image, size);
+#else
+    free(image);
+#endif
+}
+
+// true if count items of size starting at offset lie inside an image of image_size bytes
+bool hs_image_fits(uint64_t offset, uint64_t count, size_t size, uint64_t image_size) {
+    if (offset == 0 || offset % HS_IMAGE_ALIGN != 0 || offset > image_size)
+        return false;
+    return count <= (image_size - offset) / (size > 0 ? size : 1);
+}
+
+#define HS_IMAGE_RELOCATE(image, pointer) ((pointer) = (void *)((char *)(image) + (uintptr_t)(pointer)))
+
+// true if the byte at flag is a valid bool, images are read before anything looks at them as one
+bool hs_image_bool(const bool *flag) {
+    uint8_t byte;
+    memcpy(&byte, flag, 1);
+    return byte <= 1;
+}
+
+// true if every token of the body of func only refers to symbols, parameters, values and temps that exist
+bool hs_image_check_body(hs_func_t *func, size_t symbols_length) {
+    hs_token_list_t *body = &func->body;
+    if (body->temps > body->size || (body->values == NULL && body->values_size > 0))
+        return false;
+    for (size_t t = 0; t < body->size; t++) {
+        hs_token_t token = body->items[t];
+        switch (token.kind) {
+            case HS_TOKEN_ID:
+            case HS_TOKEN_ID_IS_VAR:
+                if (token.symbol >= symbols_length)
+                    return false;
+                break;
+            case HS_TOKEN_PARAM:
+                if (token.param_i >= func->params_count)
+                    return false;
+                break;
+            case HS_TOKEN_VALUE:
+                if (token.value_i >= body->values_size)
+                    return false;
+                break;
+            case HS_TOKEN_STORE:
+            case HS_TOKEN_LOAD:
+                if (token.temp_i >= body->temps)
+                    return false;
+                break;
+            default:
+                // parentheses never make it to rpn
+                if (token.kind < HS_TOKEN_ADD || token.kind > HS_TOKEN_COMMA)
+                    return false;
+        }
+    }
+    return true;
+}
+
+// true if the program of func only refers to what exists in base and never needs more stack than it reserves,
+// the same walk over the stack depth as in hs_program_compile
+bool hs_image_check_program(hs_func_t *func, hs_base_t *base) {
+    hs_program_t *program = &func->program;
+    // every instruction pushes at most one value and every temp is written by one of them
+    if (program->size == 0 || program->code[program->size - 1].op != HS_OP_RETURN
+        || program->temps > program->size || program->max_depth > program->size)
+        return false;
+    size_t depth = 0;
+    for (size_t i = 0; i < program->size; i++) {
+        hs_instruction_t instruction = program->code[i];
+        hs_func_t *callee = instruction.arg < base->funcs_length ? &base->funcs[instruction.arg] : NULL;
+        size_t pops = 0;
+        size_t pushes = 1;
+        bool valid = true;
+        switch (instruction.op) {
+            case HS_OP_VALUE:
+                valid = instruction.arg < program->values_size;
+                break;
+            case HS_OP_VAR:
+                valid = instruction.arg < base->symbols.length;
+                break;
+            case HS_OP_PARAM:
+                valid = instruction.arg < func->params_count;
+                break;
+            case HS_OP_STORE:
+                valid = instruction.arg < program->temps;
+                pops = 1;
+                break;
+            case HS_OP_LOAD:
+                valid = instruction.arg < program->temps;
+                break;
+            case HS_OP_CALL_BUILTIN_1:
+            case HS_OP_CALL_BUILTIN_2:
+                valid = callee != NULL && callee->func != NULL && callee->params_count == instruction.op - HS_OP_CALL_BUILTIN_1 + 1;
+                pops = instruction.op - HS_OP_CALL_BUILTIN_1 + 1;
+                break;
+            case HS_OP_CALL:
+                valid = callee != NULL && callee->func == NULL;
+                pops = valid ? callee->params_count : 0;
+                break;
+            case HS_OP_CALL_UNKNOWN:
+                valid = instruction.arg < base->symbols.length;
+                pushes = 0;
+                break;
+            case HS_OP_RETURN:
+                valid = i + 1 == program->size && depth >= 1;
+                pushes = 0;
+                break;
+            default:
+                if (instruction.op < HS_OP_ADD || instruction.op > HS_OP_SHIFTR)
+                    return false;
+                pops = 2;
+        }
+        if (!valid || pops > depth)
+            return false;
+        depth = depth - pops + pushes;
+        if (depth > program->max_depth)
+            return false;
+    }
+    return true;
+}
+
+// turns the offsets stored in the function at slot of base into addresses inside its image, false if they do not fit
+// or anything they point to is out of range
+bool hs_image_relocate_func(hs_state_t *state, hs_base_t *base, size_t slot) {
+    hs_func_t *func = &base->funcs[slot];
+    char *image = base->image;
+    size_t size = base->image_size;
+    if (func->id >= base->symbols.length || !hs_image_bool(&func->pure) || !hs_image_bool(&func->memoize))
+        return false;
+    if (func->func != NULL) {
+        // builtins keep their slot, only the address of the function changes
+        if (slot >= sizeof(hs_default_funcs) / sizeof(hs_default_func_t) || func->params_count != hs_default_funcs[slot].params_count)
+            return false;
+        func->func = hs_default_funcs[slot].func;
+    }
+    if (func->expression != NULL) {
+        if (!hs_image_fits((uintptr_t)func->expression, 1, 1, size))
+            return false;
+        HS_IMAGE_RELOCATE(image, func->expression);
+        if (memchr(func->expression, '\0', image + size - func->expression) == NULL)
+            return false;
+    }
+    if (func->params_linked != NULL) {
+        if (!hs_image_fits((uintptr_t)func->params_linked, func->params_count, sizeof(hs_func_param_t), size))
+            return false;
+        HS_IMAGE_RELOCATE(image, func->params_linked);
+        for (uint8_t p = 0; p < func->params_count; p++) {
+            if (func->params_linked[p].id >= base->symbols.length)
+                return false;
+            func->params_linked[p].next = p + 1 < func->params_count ? &func->params_linked[p + 1] : NULL;
+        }
+    }
+    if (func->body.items != NULL) {
+        if (!hs_image_fits((uintptr_t)func->body.items, func->body.capacity, sizeof(hs_token_t), size) || func->body.size > func->body.capacity)
+            return false;
+        HS_IMAGE_RELOCATE(image, func->body.items);
+    } else if (func->body.size > 0) {
+        return false;
+    }
+    if (func->body.values != NULL) {
+        // written with exactly the room it needs, copies of the function allocate values_capacity
+        if (!hs_image_fits((uintptr_t)func->body.values, func->body.values_size, sizeof(hs_value_t), size)
+            || func->body.values_capacity != func->body.values_size)
+            return false;
+        HS_IMAGE_RELOCATE(image, func->body.values);
+    }
+    if (!hs_image_check_body(func, base->symbols.length))
+        return false;
+    if (func->program.code != NULL) {
+        if (!hs_image_fits((uintptr_t)func->program.code, func->program.size, sizeof(hs_instruction_t), size)
+            || !hs_image_fits((uintptr_t)func->program.values, func->program.values_size, sizeof(hs_value_t), size))
+            return false;
+        HS_IMAGE_RELOCATE(image, func->program.code);
+        HS_IMAGE_RELOCATE(image, func->program.values);
+        if (!hs_image_check_program(func, base))
+            return false;
+        hs_program_run(&func->program, state, HS_PROGRAM_THREAD);
+    }
+    return true;
+}
+
+// true if the names, slots and index of the symbols of base only point to names, variables, functions and symbols
+// that exist, so that looking them up never leaves the image
+bool hs_image_check_symbols(hs_base_t *base) {
+    hs_symbols_t *symbols = &base->symbols;
+    if (symbols->names_size == 0 || symbols->names[symbols->names_size - 1] != '\0')
+        return false;
+    for (size_t i = 0; i < symbols->length; i++) {
+        // "ans" is bound to the slot right after the variables of the base
+        if (symbols->name_offsets[i] >= symbols->names_size
+            || (symbols->var_slots[i] != -1 && symbols->var_slots[i] > base->vars_length)
+            || (symbols->func_slots[i] != -1 && symbols->func_slots[i] >= base->funcs_length))
+            return false;
+    }
+    // lookups stop at the first empty bucket, there has to be one
+    size_t used = 0;
+    for (size_t b = 0; b < symbols->index.capacity; b++) {
+        if (symbols->index.buckets[b] > symbols->length)
+            return false;
+        used += symbols->index.buckets[b] != 0;
+    }
+    if (used > symbols->length)
+        return false;
+    for (size_t i = 0; i < base->vars_length; i++) {
+        if (base->vars[i].id >= symbols->length || !hs_image_bool(&base->vars[i].constant))
+            return false;
+    }
+    return true;
+}
+
+// replaces the definitions and settings of state with the image at path. the image becomes the base of state and is used
+// where it is mapped: symbols, index and variables as they are, functions only get their pointers relocated.
+// every offset, slot and index in the image is checked before it is used, a damaged image is rejected as corrupt
+bool hs_snapshot_load(hs_state_t *state, const char *path) {
+    if (state == NULL || path == NULL)
+        return false;
+    if (state->exprs > 0) {
+        hs_error(state, "can not load %s while compiled expressions use the current definitions" ENDL, path);
+        return false;
+    }
+    size_t size = 0;
+    char *image = hs_image_map(state, path, &size);
+    if (image == NULL)
+        return false;
+    hs_base_t *base = NULL;
+    hs_image_header_t *header = (hs_image_header_t *)image;
+    if (memcmp(header->magic, HS_IMAGE_MAGIC, sizeof(header->magic)) != 0) {
+        hs_error(state, "%s is no snapshot" ENDL, path);
+        goto hs_snapshot_load_error;
+    }
+    if (header->version != HS_IMAGE_VERSION || header->byte_order != HS_IMAGE_BYTE_ORDER
+        || memcmp(header->sizes, hs_image_sizes, sizeof(header->sizes)) != 0) {
+        hs_error(state, "snapshot %s was saved by another version or platform" ENDL, path);
+        goto hs_snapshot_load_error;
+    }
+    if (header->size != size || header->symbols_length >= HS_SYMBOL_NONE || header->vars_length >= header->symbols_length
+        || header->index_capacity < header->symbols_length * 2 || (header->index_capacity & (header->index_capacity - 1)) != 0
+        || !hs_image_fits(header->names, header->names_size, 1, size)
+        || !hs_image_fits(header->name_offsets, header->symbols_length, sizeof(size_t), size)
+        || !hs_image_fits(header->var_slots, header->symbols_length, sizeof(size_t), size)
+        || !hs_image_fits(header->func_slots, header->symbols_length, sizeof(size_t), size)
+        || !hs_image_fits(header->buckets, header->index_capacity, sizeof(hs_symbol_t), size)
+        || !hs_image_fits(header->vars, header->vars_length, sizeof(hs_var_t), size)
+        || !hs_image_fits(header->funcs, header->funcs_length, sizeof(hs_func_t), size))
+        goto hs_snapshot_load_corrupt;
+
+    base = hs_alloc(state, NULL, sizeof(hs_base_t));
+    if (base == NULL) {
+        hs_error(state, "out of memory while loading %s :(" ENDL, path);
+        goto hs_snapshot_load_error;
+    }
+    *base = (hs_base_t){
+        .symbols = {
+            .names = image + header->names,
+            .names_size = header->names_size,
+            .names_capacity = header->names_size,
+            .name_offsets = (size_t *)(image + header->name_offsets),
+            .var_slots = (size_t *)(image + header->var_slots),
+            .func_slots = (size_t *)(image + header->func_slots),
+            .length = header->symbols_length,
+            .capacity = header->symbols_length,
+            .index = {.buckets = (hs_symbol_t *)(image + header->buckets), .capacity = header->index_capacity},
+            .first = 0,
+        },
+        .vars = (hs_var_t *)(image + header->vars),
+        .vars_length = header->vars_length,
+        .funcs = (hs_func_t *)(image + header->funcs),
+        .funcs_length = header->funcs_length,
+        .settings = header->settings,
+        .image = image,
+        .image_size = size,
+    };
+    hs_settings_t *settings = &header->settings;
+    if (!hs_image_check_symbols(base) || !hs_image_bool(&settings->sep_out) || !hs_image_bool(&settings->fold)
+        || !hs_image_bool(&settings->cse) || !hs_image_bool(&settings->vm) || settings->memo > HS_MEMO_MAX_SIZE
+        || (settings->output_mode != HS_OUTPUT_DEC && settings->output_mode != HS_OUTPUT_HEX
+            && settings->output_mode != HS_OUTPUT_OCT && settings->output_mode != HS_OUTPUT_BIN))
+        goto hs_snapshot_load_corrupt;
+    for (size_t i = 0; i < base->funcs_length; i++) {
+        if (!hs_image_relocate_func(state, base, i))
+            goto hs_snapshot_load_corrupt;
+    }
+
+    hs_shared_leave(state);
+    hs_defs_free(state);
+    if (state->snapshot != NULL)
+        hs_base_free(state->snapshot);
+    state->snapshot = base;
+    state->settings = base->settings;
+    if (!hs_state_layer(state, base))
+        return false;
+    state->context_vars[0].value = header->ans;
+    return true;
+
+hs_snapshot_load_corrupt:
+    hs_error(state, "snapshot %s is corrupt" ENDL, path);
+hs_snapshot_load_error:
+    if (base != NULL)
+        free(base);
+    hs_image_unmap(image, size);
+    return false;
+}
+
+void hs_preprocess_input(char *input) {
+    while (*input != '\0') {
+        if (*input >= 'A' && *input <= 'Z') {
+            *input += 'a' - 'A';
+        }
+        input++;
+    }
+}
+
+// values_of is the list the tokens of the new one come from (its values are shared), NULL for a list of its own
+hs_token_list_t hs_token_list_init(hs_state_t *state, hs_token_list_t *values_of) {
+    hs_token_list_t list = {
+        .items = hs_arena_alloc(state, HS_LIST_INITIAL_CAPACITY * sizeof(hs_token_t)),
+        .capacity = HS_LIST_INITIAL_CAPACITY,
+        .size = 0,
+    };
+    if (values_of != NULL) {
+        list.values = values_of->values;
+        list.values_size = values_of->values_size;
+        list.values_capacity = values_of->values_capacity;
+    }
+    if (list.items == NULL) {
+        hs_error(state, "out of memory during token list initialization :(" ENDL);
+        return list;
+    }
+    return list;
+}
+
+bool hs_token_list_push(hs_state_t *state, hs_token_list_t *list, hs_token_t token) {
+    if (list->size >= list->capacity) {
+        hs_token_t *items = hs_arena_alloc(state, list->capacity * 2 * sizeof(hs_token_t));
+        if (items == NULL) {
+            hs_error(state, "out of memory during token list reallocation at " SIZE_T_F " tokens :(" ENDL, list->size);
+            return false;
+        }
+        for (size_t i = 0; i < list->size; i++)
+            items[i] = list->items[i];
+        list->items = items;
+        list->capacity *= 2;
+    }
+    list->items[list->size++] = token;
+    return true;
+}
+
+// appends value to the values of list and a HS_TOKEN_VALUE referring to it
+bool hs_token_list_push_value(hs_state_t *state, hs_token_list_t *list, hs_value_t value) {
+    if (list->values_size >= list->values_capacity) {
+        size_t capacity = list->values_capacity == 0 ? HS_LIST_INITIAL_CAPACITY : list->values_capacity * 2;
+        hs_value_t *values = hs_arena_alloc(state, capacity * sizeof(hs_value_t));
+        if (values == NULL) {
+            hs_error(state, "out of memory during value reallocation at " SIZE_T_F " values :(" ENDL, list->values_size);
+            return false;
+        }
+        for (size_t i = 0; i < list->values_size; i++)
+            values[i] = list->values[i];
+        list->values = values;
+        list->values_capacity = capacity;
+    }
+    list->values[list->values_size] = value;
+    return hs_token_list_push(state, list, (hs_token_t){.kind = HS_TOKEN_VALUE, .value_i = list->values_size++});
+}
+
+hs_token_t hs_token_list_pop(hs_state_t *state, hs_token_list_t *list) {
+    if (list->size > 0) {
+        list->size--;
+        return list->items[list->size];
+    } else {
+        hs_printf(state, "WARNING: missing some expected token" ENDL);
+        return (hs_token_t){
+            .kind = HS_TOKEN_EOF,
+        };
+    }
+}
+
+// 5^q for q = HS_POW5_MIN .. HS_POW5_MAX as normalized 128 bit values (high, low), truncated for q >= 0 and
+// rounded up for q < 0, for the eisel-lemire decimal conversion
+#define HS_POW5_MIN -64
+#define HS_POW5_MAX 64
+// significant digits that can decide how a decimal literal rounds to a double
+#define HS_DECIMAL_DIGITS_MAX 768
+const uint64_t hs_pow5_128[][2] = {
+    {0xa87fea27a539e9a5, 0x3f2398d747b36224}, {0xd29fe4b18e88640e, 0x8eec7f0d19a03aad},
+    {0x83a3eeeef9153e89, 0x1953cf68300424ac}, {0xa48ceaaab75a8e2b, 0x5fa8c3423c052dd7},
+    {0xcdb02555653131b6, 0x3792f412cb06794d}, {0x808e17555f3ebf11, 0xe2bbd88bbee40bd0},
+    {0xa0b19d2ab70e6ed6, 0x5b6aceaeae9d0ec4}, {0xc8de047564d20a8b, 0xf245825a5a445275},
+    {0xfb158592be068d2e, 0xeed6e2f0f0d56712}, {0x9ced737bb6c4183d, 0x55464dd69685606b},
+    {0xc428d05aa4751e4c, 0xaa97e14c3c26b886}, {0xf53304714d9265df, 0xd53dd99f4b3066a8},
+    {0x993fe2c6d07b7fab, 0xe546a8038efe4029}, {0xbf8fdb78849a5f96, 0xde98520472bdd033},
+    {0xef73d256a5c0f77c, 0x963e66858f6d4440}, {0x95a8637627989aad, 0xdde7001379a44aa8},
+    {0xbb127c53b17ec159, 0x5560c018580d5d52}, {0xe9d71b689dde71af, 0xaab8f01e6e10b4a6},
+    {0x9226712162ab070d, 0xcab3961304ca70e8}, {0xb6b00d69bb55c8d1, 0x3d607b97c5fd0d22},
+    {0xe45c10c42a2b3b05, 0x8cb89a7db77c506a}, {0x8eb98a7a9a5b04e3, 0x77f3608e92adb242},
+    {0xb267ed1940f1c61c, 0x55f038b237591ed3}, {0xdf01e85f912e37a3, 0x6b6c46dec52f6688},
+    {0x8b61313bbabce2c6, 0x2323ac4b3b3da015}, {0xae397d8aa96c1b77, 0xabec975e0a0d081a},
+    {0xd9c7dced53c72255, 0x96e7bd358c904a21}, {0x881cea14545c7575, 0x7e50d64177da2e54},
+    {0xaa242499697392d2, 0xdde50bd1d5d0b9e9}, {0xd4ad2dbfc3d07787, 0x955e4ec64b44e864},
+    {0x84ec3c97da624ab4, 0xbd5af13bef0b113e}, {0xa6274bbdd0fadd61, 0xecb1ad8aeacdd58e},
+    {0xcfb11ead453994ba, 0x67de18eda5814af2}, {0x81ceb32c4b43fcf4, 0x80eacf948770ced7},
+    {0xa2425ff75e14fc31, 0xa1258379a94d028d}, {0xcad2f7f5359a3b3e, 0x096ee45813a04330},
+    {0xfd87b5f28300ca0d, 0x8bca9d6e188853fc}, {0x9e74d1b791e07e48, 0x775ea264cf55347e},
+    {0xc612062576589dda, 0x95364afe032a819e}, {0xf79687aed3eec551, 0x3a83ddbd83f52205},
+    {0x9abe14cd44753b52, 0xc4926a9672793543}, {0xc16d9a0095928a27, 0x75b7053c0f178294},
+    {0xf1c90080baf72cb1, 0x5324c68b12dd6339}, {0x971da05074da7bee, 0xd3f6fc16ebca5e04},
+    {0xbce5086492111aea, 0x88f4bb1ca6bcf585}, {0xec1e4a7db69561a5, 0x2b31e9e3d06c32e6},
+    {0x9392ee8e921d5d07, 0x3aff322e62439fd0}, {0xb877aa3236a4b449, 0x09befeb9fad487c3},
+    {0xe69594bec44de15b, 0x4c2ebe687989a9b4}, {0x901d7cf73ab0acd9, 0x0f9d37014bf60a11},
+    {0xb424dc35095cd80f, 0x538484c19ef38c95}, {0xe12e13424bb40e13, 0x2865a5f206b06fba},
+    {0x8cbccc096f5088cb, 0xf93f87b7442e45d4}, {0xafebff0bcb24aafe, 0xf78f69a51539d749},
+    {0xdbe6fecebdedd5be, 0xb573440e5a884d1c}, {0x89705f4136b4a597, 0x31680a88f8953031},
+    {0xabcc77118461cefc, 0xfdc20d2b36ba7c3e}, {0xd6bf94d5e57a42bc, 0x3d32907604691b4d},
+    {0x8637bd05af6c69b5, 0xa63f9a49c2c1b110}, {0xa7c5ac471b478423, 0x0fcf80dc33721d54},
+    {0xd1b71758e219652b, 0xd3c36113404ea4a9}, {0x83126e978d4fdf3b, 0x645a1cac083126ea},
+    {0xa3d70a3d70a3d70a, 0x3d70a3d70a3d70a4}, {0xcccccccccccccccc, 0xcccccccccccccccd},
+    {0x8000000000000000, 0x0000000000000000}, {0xa000000000000000, 0x0000000000000000},
+    {0xc800000000000000, 0x0000000000000000}, {0xfa00000000000000, 0x0000000000000000},
+    {0x9c40000000000000, 0x0000000000000000}, {0xc350000000000000, 0x0000000000000000},
+    {0xf424000000000000, 0x0000000000000000}, {0x9896800000000000, 0x0000000000000000},
+    {0xbebc200000000000, 0x0000000000000000}, {0xee6b280000000000, 0x0000000000000000},
+    {0x9502f90000000000, 0x0000000000000000}, {0xba43b74000000000, 0x0000000000000000},
+    {0xe8d4a51000000000, 0x0000000000000000}, {0x9184e72a00000000, 0x0000000000000000},
+    {0xb5e620f480000000, 0x0000000000000000}, {0xe35fa931a0000000, 0x0000000000000000},
+    {0x8e1bc9bf04000000, 0x0000000000000000}, {0xb1a2bc2ec5000000, 0x0000000000000000},
+    {0xde0b6b3a76400000, 0x0000000000000000}, {0x8ac7230489e80000, 0x0000000000000000},
+    {0xad78ebc5ac620000, 0x0000000000000000}, {0xd8d726b7177a8000, 0x0000000000000000},
+    {0x878678326eac9000, 0x0000000000000000}, {0xa968163f0a57b400, 0x0000000000000000},
+    {0xd3c21bcecceda100, 0x0000000000000000}, {0x84595161401484a0, 0x0000000000000000},
+    {0xa56fa5b99019a5c8, 0x0000000000000000}, {0xcecb8f27f4200f3a, 0x0000000000000000},
+    {0x813f3978f8940984, 0x4000000000000000}, {0xa18f07d736b90be5, 0x5000000000000000},
+    {0xc9f2c9cd04674ede, 0xa400000000000000}, {0xfc6f7c4045812296, 0x4d00000000000000},
+    {0x9dc5ada82b70b59d, 0xf020000000000000}, {0xc5371912364ce305, 0x6c28000000000000},
+    {0xf684df56c3e01bc6, 0xc732000000000000}, {0x9a130b963a6c115c, 0x3c7f400000000000},
+    {0xc097ce7bc90715b3, 0x4b9f100000000000}, {0xf0bdc21abb48db20, 0x1e86d40000000000},
+    {0x96769950b50d88f4, 0x1314448000000000}, {0xbc143fa4e250eb31, 0x17d955a000000000},
+    {0xeb194f8e1ae525fd, 0x5dcfab0800000000}, {0x92efd1b8d0cf37be, 0x5aa1cae500000000},
+    {0xb7abc627050305ad, 0xf14a3d9e40000000}, {0xe596b7b0c643c719, 0x6d9ccd05d0000000},
+    {0x8f7e32ce7bea5c6f, 0xe4820023a2000000}, {0xb35dbf821ae4f38b, 0xdda2802c8a800000},
+    {0xe0352f62a19e306e, 0xd50b2037ad200000}, {0x8c213d9da502de45, 0x4526f422cc340000},
+    {0xaf298d050e4395d6, 0x9670b12b7f410000}, {0xdaf3f04651d47b4c, 0x3c0cdd765f114000},
+    {0x88d8762bf324cd0f, 0xa5880a69fb6ac800}, {0xab0e93b6efee0053, 0x8eea0d047a457a00},
+    {0xd5d238a4abe98068, 0x72a4904598d6d880}, {0x85a36366eb71f041, 0x47a6da2b7f864750},
+    {0xa70c3c40a64e6c51, 0x999090b65f67d924}, {0xd0cf4b50cfe20765, 0xfff4b4e3f741cf6d},
+    {0x82818f1281ed449f, 0xbff8f10e7a8921a4}, {0xa321f2d7226895c7, 0xaff72d52192b6a0d},
+    {0xcbea6f8ceb02bb39, 0x9bf4f8a69f764490}, {0xfee50b7025c36a08, 0x02f236d04753d5b4},
+    {0x9f4f2726179a2245, 0x01d762422c946590}, {0xc722f0ef9d80aad6, 0x424d3ad2b7b97ef5},
+    {0xf8ebad2b84e0d58b, 0xd2e0898765a7deb2}, {0x9b934c3b330c8577, 0x63cc55f49f88eb2f},
+    {0xc2781f49ffcfa6d5, 0x3cbf6b71c76b25fb},
+};
+
+// digit value plus one for every character that is a digit in some base up to 16, 0 for anything else
+const uint8_t hs_digit_values[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5, ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+};
+
+// full 64 x 64 -> 128 bit product
+void hs_multiply_128(uint64_t a, uint64_t b, uint64_t *high, uint64_t *low) {
+    uint64_t a_high = a >> 32, a_low = a & 0xFFFFFFFFULL;
+    uint64_t b_high = b >> 32, b_low = b & 0xFFFFFFFFULL;
+    uint64_t low_low = a_low * b_low;
+    uint64_t high_low = a_high * b_low;
+    uint64_t low_high = a_low * b_high;
+    uint64_t middle = (low_low >> 32) + (high_low & 0xFFFFFFFFULL) + low_high;
+    *low = (middle << 32) | (low_low & 0xFFFFFFFFULL);
+    *high = a_high * b_high + (high_low >> 32) + (middle >> 32);
+}
+
+// true if the 8 chars at text are all decimal digits
+bool hs_is_eight_digits(uint64_t chunk) {
+    return ((chunk & 0xF0F0F0F0F0F0F0F0ULL) | (((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) == 0x3333333333333333ULL;
+}
+
+// value of 8 decimal digits at once, the first char is in the lowest byte of chunk
+uint32_t hs_parse_eight_digits(uint64_t chunk) {
+    chunk -= 0x3030303030303030ULL;
+    chunk = chunk * 10 + (chunk >> 8);
+    chunk = ((chunk & 0x000000FF000000FFULL) * 0x000F424000000064ULL + ((chunk >> 16) & 0x000000FF000000FFULL) * 0x0000271000000001ULL) >> 32;
+    return (uint32_t)chunk;
+}
+
+// correctly rounded w * 10^q for w != 0, false if that can not be decided quickly (eisel-lemire)
+bool hs_decimal_to_double(uint64_t w, int32_t q, double *value) {
+    if (q < HS_POW5_MIN || q > HS_POW5_MAX)
+        return false;
+    const uint64_t *power = hs_pow5_128[q - HS_POW5_MIN];
+    int32_t leading_zeros = 0;
+    while (!(w & (1ULL << 63))) {
+        w <<= 1;
+        leading_zeros++;
+    }
+    uint64_t upper, lower;
+    hs_multiply_128(w, power[0], &upper, &lower);
+    if ((upper & 0x1FF) == 0x1FF && lower + w < lower) {
+        // the truncated power is not precise enough yet, take its lower half into account
+        uint64_t second_upper, second_lower;
+        hs_multiply_128(w, power[1], &second_upper, &second_lower);
+        uint64_t middle = lower + second_upper;
+        if (middle < lower)
+            upper++;
+        if (middle + 1 == 0 && (upper & 0x1FF) == 0x1FF && second_lower + w < second_lower)
+            return false;
+        lower = middle;
+    }
+    uint64_t upper_bit = upper >> 63;
+    uint64_t mantissa = upper >> (upper_bit + 9);
+    leading_zeros += (int32_t)(1 ^ upper_bit);
+    // exactly half way between two doubles, needs the exact decimal value
+    if (lower == 0 && (upper & 0x1FF) == 0 && (mantissa & 3) == 1)
+        return false;
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >= (1ULL << 53)) {
+        mantissa = 1ULL << 52;
+        leading_zeros--;
+    }
+    mantissa &= ~(1ULL << 52);
+    // floor(q * log2(10)) + 1024 + 63 - leading_zeros
+    int64_t scaled = (int64_t)q * (152170 + 65536);
+    int64_t exponent = (scaled >= 0 ? scaled >> 16 : -((-scaled + 65535) >> 16)) + 1024 + 63 - leading_zeros;
+    // subnormals and overflow are left to the fallback
+    if (exponent < 1 || exponent > 2046)
+        return false;
+    uint64_t bits = mantissa | ((uint64_t)exponent << 52);
+    memcpy(value, &bits, sizeof(bits));
+    return true;
+}
+
+// decodes a decimal literal like "1'234.5" times 10^exponent, group separators are skipped and only the first
+// decimal separator counts
+double hs_parse_decimal(const char *text, size_t length, int32_t exponent, hs_settings_t *settings) {
+    uint64_t w = 0;
+    int32_t q = exponent;
+    size_t digits = 0;
+    bool fraction = false;
+    bool truncated = false;
+    for (size_t i = 0; i < length; i++) {
+        if (digits > 0 && digits + 8 <= 19 && i + 8 <= length) {
+            uint64_t chunk = 0;
+            for (size_t k = 0; k < 8; k++)
+                chunk |= (uint64_t)(unsigned char)text[i + k] << (8 * k);
+            if (hs_is_eight_digits(chunk)) {
+                w = w * 100000000ULL + hs_parse_eight_digits(chunk);
+                digits += 8;
+                if (fraction)
+                    q -= 8;
+                i += 7;
+                continue;
+            }
+        }
+        char c = text[i];
+        if (c >= '0' && c <= '9') {
+            if (digits == 0 && c == '0') {
+                // leading zeros do not count towards the 19 digits that fit
+                if (fraction)
+                    q--;
+            } else if (digits < 19) {
+                w = w * 10 + (uint64_t)(c - '0');
+                digits++;
+                if (fraction)
+                    q--;
+            } else {
+                truncated |= c != '0';
+                if (!fraction)
+                    q++;
+            }
+        } else if (c == settings->dec_sep_char_in) {
+            fraction = true;
+        }
+    }
+    if (w == 0)
+        return 0.0;
+    double value;
+    if (!truncated && hs_decimal_to_double(w, q, &value))
+        return value;
+
+    // slow but exact: the significant digits as an integer with an exponent, so the decimal separator of the locale
+    // does not matter. digits past HS_DECIMAL_DIGITS_MAX can not change the rounding, only whether any is non zero
+    char buffer[HS_DECIMAL_DIGITS_MAX + 16];
+    size_t buffer_i = 0;
+    bool sticky = false;
+    q = exponent;
+    fraction = false;
+    for (size_t i = 0; i < length; i++) {
+        char c = text[i];
+        if (c >= '0' && c <= '9') {
+            if (buffer_i == 0 && c == '0') {
+                if (fraction)
+                    q--;
+            } else if (buffer_i < HS_DECIMAL_DIGITS_MAX) {
+                buffer[buffer_i++] = c;
+                if (fraction)
+                    q--;
+            } else {
+                sticky |= c != '0';
+                if (!fraction)
+                    q++;
+            }
+        } else if (c == settings->dec_sep_char_in) {
+            fraction = true;
+        }
+    }
+    if (sticky) {
+        buffer[buffer_i++] = '1';
+        q--;
+    }
+    snprintf(buffer + buffer_i, sizeof(buffer) - buffer_i, "e%i", (int)q);
+    return strtod(buffer, NULL);
+}
+
+// decodes a literal in base 2, 8 or 16 exactly (rounded once to the nearest double), separators as for decimal
+double hs_parse_radix(char *text, size_t length, uint8_t bits_per_digit, hs_settings_t *settings) {
+    uint64_t mantissa = 0;
+    int32_t exponent = 0;
+    bool fraction = false;
+    bool sticky = false;
+    for (size_t i = 0; i < length; i++) {
+        uint8_t digit = hs_digit_values[(unsigned char)text[i]];
+        if (digit == 0) {
+            if (text[i] == settings->dec_sep_char_in)
+                fraction = true;
+            continue;
+        }
+        digit--;
+        if (mantissa >> (64 - bits_per_digit) == 0) {
+            mantissa = (mantissa << bits_per_digit) | digit;
+            if (fraction)
+                exponent -= bits_per_digit;
+        } else {
+            // no room left, the digit only matters for rounding
+            sticky |= digit != 0;
+            if (!fraction)
+                exponent += bits_per_digit;
+        }
+    }
+    if (sticky)
+        mantissa |= 1;
+    return ldexp((double)mantissa, exponent);
+}
+
+// tokenizes input[0..length), literals are decoded right away
+hs_token_list_t hs_tokenize(char *input, size_t length, hs_state_t *state) {
+    hs_token_list_t tokens = hs_token_list_init(state, NULL);
+
+    if (tokens.items == NULL)
+        goto hs_tokenize_error;
+
+    for (size_t i = 0; i < length && input[i] != '\0'; i++) {
+        if (input[i] == '+') {
+            if (!hs_token_list_push(state, &tokens, (hs_token_t){.kind = HS_TOKEN_ADD})) goto hs_tokenize_error;
+        } else if (input[i] == '-') {
+            if (!hs_token_list_push(state, &tokens, (hs_token_t){.kind = HS_TOKEN_SUBTRACT})) goto hs_tokenize_error;
+        } else if (input[i] == '*') {
+            if (!hs_token_list_push(state, &tokens, (hs_token_t){.kind = HS_TOKEN_MULTIPLY})) goto hs_tokenize_error;
+        } else if (input[i] == '/') {
+            if (!hs_token_list_push(state, &tokens, (hs_token_t){.kind = HS_TOKEN_DIVIDE})) goto hs_tokenize_error;
+        } else if (input[i] == '%') {
+            if (!hs_token_list_push(state, &tokens, (hs_token_t){.kind = HS_TOKEN_MODULO})) goto hs_tokenize_error;
+        } else if (input[i] == '^') {
+            if (!hs_token_list_push(state, &tokens, (hs_token_t){.kind = HS_TOKEN_POWER})) goto hs_tokenize_error;
+        } else if (input[i] == '&') {
+            if (!hs_token_list_push(state, &tokens, (hs_token_t){.kind = HS_TOKEN_AND})) goto hs_tokenize_error;
+        } else if (input[i] == '|') {
+            if (!hs_token_list_push(state, &tokens, (hs_token_t){.kind = HS_TOKEN_OR})) goto hs_tokenize_error;
+        } else if (input[i] == '~') {
+            if (!hs_token_list_push(state, &tokens, (hs_token_t){.kind = HS_TOKEN_XOR})) goto hs_tokenize_error;
+        } else if (input[i] == '<') {
+            if (!hs_token_list_push(state, &tokens, (hs_token_t){.kind = HS_TOKEN_SHIFTL})) goto hs_tokenize_error;
+        } else if (input[i] == '>') {
+            if (!hs_token_list_push(state, &tokens, (hs_token_t){.kind = HS_TOKEN_SHIFTR})) goto hs_tokenize_error;
+        } else if (input[i] == '(') {
+            if (!hs_token_list_push(state, &tokens, (hs_token_t){.kind = HS_TOKEN_OPEN_P})) goto hs_tokenize_error;
+        } else if (input[i] == ')') {
+            if (!hs_token_list_push(state, &tokens, (hs_token_t){.kind = HS_TOKEN_CLOSE_P})) goto hs_tokenize_error;
+        } else if (input[i] == ',') {
+            if (!hs_token_list_push(state, &tokens, (hs_token_t){.kind = HS_TOKEN_COMMA})) goto hs_tokenize_error;
+        } else if ((input[i] >= '0' && input[i] <= '9') || input[i] == state->settings.dec_sep_char_in) {
+            if (input[i] == '0' && (input[i + 1] == 'b' || input[i + 1] == 'o' || input[i + 1] == 'x')) {
+                uint8_t bits_per_digit = input[i + 1] == 'b' ? 1 : input[i + 1] == 'o' ? 3 : 4;
+                i += 2;
+                size_t token_start = i;
+                while ((hs_digit_values[(unsigned char)input[i]] != 0 && hs_digit_values[(unsigned char)input[i]] <= (1 << bits_per_digit)) ||
+                       input[i] == state->settings.dec_sep_char_in || input[i] == state->settings.sep_char_in) {
+                    i++;
+                }
+                double value = hs_parse_radix(input + token_start, i - token_start, bits_per_digit, &state->settings);
+                i--;
+                if (!hs_token_list_push_value(state, &tokens, (hs_value_t){.re = value, .im = 0}))
+                    goto hs_tokenize_error;
+                continue;
+            }
+            size_t token_start = i;
+            while ((input[i] >= '0' && input[i] <= '9') || input[i] == state->settings.dec_sep_char_in || input[i] == state->settings.sep_char_in) {
+                i++;
+            }
+            double value = hs_parse_decimal(input + token_start, i - token_start, 0, &state->settings);
+            i--;
+            if (tokens.size > 0 && tokens.items[tokens.size - 1].kind == HS_TOKEN_SUBTRACT &&
+               ((tokens.size >= 2 && (tokens.items[tokens.size - 2].kind == HS_TOKEN_OPEN_P ||
+                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_COMMA ||
+                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_ADD ||
+                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_SUBTRACT ||
+                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_MULTIPLY ||
+                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_DIVIDE ||
+                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_MODULO ||
+                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_POWER ||
+                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_AND ||
+                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_OR ||
+                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_XOR ||
+                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_SHIFTL ||
+                                     tokens.items[tokens.size - 2].kind == HS_TOKEN_SHIFTR)) || tokens.size == 1)) {
+                hs_token_list_pop(state, &tokens);
+                value = -value;
+            }
+            if (!hs_token_list_push_value(state, &tokens, (hs_value_t){.re = value, .im = 0}))
+                goto hs_tokenize_error;
+        } else if (input[i] >= 'a' && input[i] <= 'z') {
+            hs_token_t token_id = {.kind = HS_TOKEN_ID};
+            size_t token_start = i;
+            while ((input[i] >= '0' && input[i] <= '9') || (input[i] >= 'a' && input[i] <= 'z') || input[i] == '_') {
+                i++;
+            }
+            token_id.symbol = hs_symbol_intern(state, input + token_start, i - token_start);
+            i--;
+            if (token_id.symbol == HS_SYMBOL_NONE)
+                goto hs_tokenize_error;
+            if (!hs_token_list_push(state, &tokens, token_id))
+                goto hs_tokenize_error;
+        }
+    }
+    if (!hs_token_list_push(state, &tokens, (hs_token_t){.kind = HS_TOKEN_EOF}))
+        goto hs_tokenize_error;
+    state->stats.tokens += tokens.size;
+
+    return tokens;
+
+hs_tokenize_error:
+    return tokens;
+}
+
+bool hs_is_op(hs_token_kind_t kind) {
+    switch (kind) {
+        case HS_TOKEN_ADD:
+        case HS_TOKEN_SUBTRACT:
+        case HS_TOKEN_MULTIPLY:
+        case HS_TOKEN_DIVIDE:
+        case HS_TOKEN_MODULO:
+        case HS_TOKEN_POWER:
+        case HS_TOKEN_AND:
+        case HS_TOKEN_OR:
+        case HS_TOKEN_XOR:
+        case HS_TOKEN_SHIFTL:
+        case HS_TOKEN_SHIFTR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+int8_t hs_op_prio(hs_token_kind_t kind) {
+    switch (kind) {
+        case HS_TOKEN_OR:
+            return 0;
+        case HS_TOKEN_XOR:
+            return 1;
+        case HS_TOKEN_AND:
+            return 2;
+        case HS_TOKEN_SHIFTL:
+        case HS_TOKEN_SHIFTR:
+            return 3;
+        case HS_TOKEN_ADD:
+        case HS_TOKEN_SUBTRACT:
+            return 4;
+        case HS_TOKEN_MULTIPLY:
+        case HS_TOKEN_DIVIDE:
+        case HS_TOKEN_MODULO:
+            return 5;
+        case HS_TOKEN_POWER:
+            return 6;
+        default:
+            return -1;
+    }
+}
+
+hs_token_list_t hs_shunting_yard(hs_token_list_t *tokens, hs_state_t *state) {
+    size_t input_i = 0;
+    hs_token_list_t output = hs_token_list_init(state, tokens);
+    hs_token_list_t stack = hs_token_list_init(state, tokens);
+
+    if (output.items == NULL)
+        goto hs_shunting_yard_error;
+    if (stack.items == NULL)
+        goto hs_shunting_yard_error;
+
+    int32_t last_value = -2;
+    while (input_i < tokens->size) {
+        switch (tokens->items[input_i].kind) {
+            case HS_TOKEN_VALUE:
+            case HS_TOKEN_ID:
+                if (tokens->items[input_i].kind == HS_TOKEN_ID) {
+                    if (tokens->items[input_i + 1].kind == HS_TOKEN_OPEN_P) {
+                        // function call
+                        if (!hs_token_list_push(state, &stack, tokens->items[input_i]))
+                            goto hs_shunting_yard_error;
+                        break;
+                    } else {
+                        tokens->items[input_i].kind = HS_TOKEN_ID_IS_VAR;
+                        if (last_value == input_i - 1) {
+                            // implied multiplication
+                            while (stack.size > 0 &&
+                                   hs_is_op(stack.items[stack.size - 1].kind) &&
+                                   hs_op_prio(HS_TOKEN_MULTIPLY) <= hs_op_prio(stack.items[stack.size - 1].kind)) {
+                                // TODO: except for exponent, possibly
+                                if (!hs_token_list_push(state, &output, hs_token_list_pop(state, &stack)))
+                                    goto hs_shunting_yard_error;
+                            }
+                            if (!hs_token_list_push(state, &stack, (hs_token_t){.kind = HS_TOKEN_MULTIPLY}))
+                                goto hs_shunting_yard_error;
+                        }
+                    }
+                } else {
+                    last_value = input_i;
+                }
+                // var or value
+                if (!hs_token_list_push(state, &output, tokens->items[input_i]))
+                    goto hs_shunting_yard_error;
+                break;
+            case HS_TOKEN_COMMA:
+                if (stack.size == 0) {
+                    hs_error(state, "unexpected comma" ENDL);
+                    goto hs_shunting_yard_error;
+                }
+                while (stack.items[stack.size - 1].kind != HS_TOKEN_OPEN_P) {
+                    if (!hs_token_list_push(state, &output, hs_token_list_pop(state, &stack)))
+                        goto hs_shunting_yard_error;
+                    if (stack.size == 0) {
+                        hs_error(state, "unexpected comma" ENDL);
+                        goto hs_shunting_yard_error;
+                    }
+                }
+                break;
+            case HS_TOKEN_ADD:
+            case HS_TOKEN_SUBTRACT:
+            case HS_TOKEN_MULTIPLY:
+            case HS_TOKEN_DIVIDE:
+            case HS_TOKEN_MODULO:
+            case HS_TOKEN_POWER:
+            case HS_TOKEN_AND:
+            case HS_TOKEN_OR:
+            case HS_TOKEN_XOR:
+            case HS_TOKEN_SHIFTL:
+            case HS_TOKEN_SHIFTR:
+                while (stack.size > 0 &&
+                       hs_is_op(stack.items[stack.size - 1].kind) &&
+                       hs_op_prio(tokens->items[input_i].kind) <= hs_op_prio(stack.items[stack.size - 1].kind)) {
+                    // TODO: except for exponent, possibly
+                    if (!hs_token_list_push(state, &output, hs_token_list_pop(state, &stack)))
+                        goto hs_shunting_yard_error;
+                }
+                if (!hs_token_list_push(state, &stack, tokens->items[input_i]))
+                    goto hs_shunting_yard_error;
+                break;
+            case HS_TOKEN_OPEN_P:
+                if (last_value == input_i - 1) {
+                    // implied multiplication
+                    while (stack.size > 0 &&
+                           hs_is_op(stack.items[stack.size - 1].kind) &&
+                           hs_op_prio(HS_TOKEN_MULTIPLY) <= hs_op_prio(stack.items[stack.size - 1].kind)) {
+                        // TODO: except for exponent, possibly
+                        if (!hs_token_list_push(state, &output, hs_token_list_pop(state, &stack)))
+                            goto hs_shunting_yard_error;
+                    }
+                    if (!hs_token_list_push(state, &stack, (hs_token_t){.kind = HS_TOKEN_MULTIPLY}))
+                        goto hs_shunting_yard_error;
+                }
+                if (!hs_token_list_push(state, &stack, tokens->items[input_i]))
+                    goto hs_shunting_yard_error;
+                break;
+            case HS_TOKEN_CLOSE_P:
+                if (stack.size == 0) {
+                    hs_error(state, "closing parenthesis without opening one" ENDL);
+                    goto hs_shunting_yard_error;
+                }
+                while (stack.size > 0 && stack.items[stack.size - 1].kind != HS_TOKEN_OPEN_P) {
+                    if (!hs_token_list_push(state, &output, hs_token_list_pop(state, &stack)))
+                        goto hs_shunting_yard_error;
+                }
+                if (stack.size == 0) {
+                    hs_error(state, "closing parenthesis without opening one" ENDL);
+                    goto hs_shunting_yard_error;
+                }
+                hs_token_list_pop(state, &stack);
+                if (stack.size > 0 && stack.items[stack.size - 1].kind == HS_TOKEN_ID) {
+                    if (!hs_token_list_push(state, &output, hs_token_list_pop(state, &stack)))
+                        goto hs_shunting_yard_error;
+                }
+                break;
+            case HS_TOKEN_EOF:
+            default:
+                break;
+        }
+        input_i++;
+    }
+    while (stack.size > 0) {
+        hs_token_t stack_token = hs_token_list_pop(state, &stack);
+        if (!hs_token_list_push(state, &output, stack_token))
+            goto hs_shunting_yard_error;
+    }
+
+    return output;
+
+hs_shunting_yard_error:
+    return output;
+}
+
+// replaces every subtree of rpn that only consists of literals, builtin constants and builtin functions with its value.
+// subtrees that print anything while being solved are kept, so their diagnostics still show up on every evaluation
+hs_token_list_t hs_fold(hs_token_list_t *rpn, hs_state_t *state) {
+    if (!state->settings.fold)
+        return *rpn;
+
+    hs_token_list_t output = hs_token_list_init(state, NULL);
+    // for every operand on the simulated stack: where its tokens start in output and whether it is a single value
+    size_t *starts = hs_arena_alloc(state, (rpn->size + 1) * sizeof(size_t));
+    bool *constants = hs_arena_alloc(state, (rpn->size + 1) * sizeof(bool));
+    if (output.items == NULL || starts == NULL || constants == NULL)
+        return (hs_token_list_t){.items = NULL, .size = 0, .capacity = 0};
+    size_t depth = 0;
+
+    for (size_t i = 0; i < rpn->size; i++) {
+        hs_token_t token = rpn->items[i];
+        size_t start = output.size;
+        size_t operands = 0;
+        bool constant = true;
+
+        switch (token.kind) {
+            case HS_TOKEN_VALUE:
+                if (!hs_token_list_push_value(state, &output, rpn->values[token.value_i]))
+                    return (hs_token_list_t){.items = NULL, .size = 0, .capacity = 0};
+                starts[depth] = start;
+                constants[depth++] = true;
+                continue;
+            case HS_TOKEN_ID_IS_VAR: {
+                size_t var_i = hs_var_slot(state, token.symbol);
+                if (var_i != -1 && hs_var_at(state, var_i)->constant) {
+                    if (!hs_token_list_push_value(state, &output, hs_var_at(state, var_i)->value))
+                        return (hs_token_list_t){.items = NULL, .size = 0, .capacity = 0};
+                    starts[depth] = start;
+                    constants[depth++] = true;
+                    continue;
+                }
+                constant = false;
+                break;
+            }
+            case HS_TOKEN_ID: {
+                // user functions may read variables, only builtins are folded
+                size_t func_i = hs_func_slot(state, token.symbol);
+                if (func_i != -1) {
+                    operands = hs_func_at(state, func_i)->params_count;
+                    constant = hs_func_at(state, func_i)->func != NULL;
+                } else {
+                    constant = false;
+                }
+                break;
+            }
+            default:
+                if (hs_is_op(token.kind)) {
+                    operands = 2;
+                } else {
+                    constant = false;
+                }
+                break;
+        }
+
+        if (operands > depth) {
+            operands = depth;
+            constant = false;
+        }
+        for (size_t k = depth - operands; k < depth; k++) {
+            if (!constants[k])
+                constant = false;
+        }
+        if (operands > 0)
+            start = starts[depth - operands];
+        depth -= operands;
+        if (!hs_token_list_push(state, &output, token))
+            return (hs_token_list_t){.items = NULL, .size = 0, .capacity = 0};
+
+        if (constant) {
+            hs_token_list_t subtree = output;
+            subtree.items += start;
+            subtree.size -= start;
+            subtree.capacity = subtree.size;
+            size_t muted_prints = state->muted_prints;
+            size_t errors = state->errors;
+            hs_sink_kind_t out_kind = state->out.kind;
+            state->out.kind = HS_SINK_NONE;
+            hs_value_t value = hs_solve(&subtree, state, -1);
+            state->out.kind = out_kind;
+            // a failing subtree is left alone, the error shows up when it is evaluated for real
+            state->errors = errors;
+
+            if (state->muted_prints == muted_prints) {
+                // the operands are the most recent values, they are not needed anymore
+                if (operands > 0)
+                    output.values_size = output.items[start].value_i;
+                output.size = start;
+                if (!hs_token_list_push_value(state, &output, value))
+                    return (hs_token_list_t){.items = NULL, .size = 0, .capacity = 0};
+            } else {
+                constant = false;
+            }
+        }
+        starts[depth] = start;
+        constants[depth++] = constant;
+    }
+
+    return output;
+}
+
+bool hs_token_same(hs_token_list_t *list, hs_token_t a, hs_token_t b) {
+    if (a.kind != b.kind)
+        return false;
+    switch (a.kind) {
+        case HS_TOKEN_VALUE:
+            return memcmp(&list->values[a.value_i], &list->values[b.value_i], sizeof(hs_value_t)) == 0;
+        case HS_TOKEN_ID:
+        case HS_TOKEN_ID_IS_VAR:
+            return a.symbol == b.symbol;
+        case HS_TOKEN_PARAM:
+            return a.param_i == b.param_i;
+        default:
+            return true;
+    }
+}
+
+size_t hs_token_hash(hs_token_list_t *list, hs_token_t token) {
+    size_t hash = token.kind * 31;
+    switch (token.kind) {
+        case HS_TOKEN_VALUE:
+            return hash ^ hs_str_hash((char *)&list->values[token.value_i], sizeof(hs_value_t));
+        case HS_TOKEN_ID:
+        case HS_TOKEN_ID_IS_VAR:
+            return hash ^ ((size_t)token.symbol * 0x9E3779B97F4A7C15ull);
+        case HS_TOKEN_PARAM:
+            return hash ^ ((size_t)token.param_i * 0x9E3779B97F4A7C15ull);
+        default:
+            return hash;
+    }
+}
+
+// computes pure subtrees of rpn that show up more than once only the first time, stores them in a temporary slot
+// and loads them from there afterwards. subtrees calling user functions are never shared, and neither are the ones
+// that may print a warning (division, power, most builtins), which has to show up once for every time it is written
+hs_token_list_t hs_cse(hs_token_list_t *rpn, hs_state_t *state) {
+    if (!state->settings.cse || rpn->size < 4)
+        return *rpn;
+
+    size_t n = rpn->size;
+    size_t table_capacity = 16;
+    while (table_capacity < n * 2)
+        table_capacity *= 2;
+    // per token: first token of the subtree it closes, its hash, whether it is pure,
+    // the first token of an equal subtree (its class) and how many subtrees share the class
+    size_t *starts = hs_arena_alloc(state, n * sizeof(size_t));
+    size_t *hashes = hs_arena_alloc(state, n * sizeof(size_t));
+    bool *pure = hs_arena_alloc(state, n * sizeof(bool));
+    size_t *classes = hs_arena_alloc(state, n * sizeof(size_t));
+    size_t *counts = hs_arena_alloc(state, n * sizeof(size_t));
+    size_t *firsts = hs_arena_alloc(state, n * sizeof(size_t));
+    size_t *temps = hs_arena_alloc(state, n * sizeof(size_t));
+    bool *covered = hs_arena_alloc(state, n * sizeof(bool));
+    bool *skipped = hs_arena_alloc(state, n * sizeof(bool));
+    size_t *stack = hs_arena_alloc(state, n * sizeof(size_t));
+    size_t *table = hs_arena_alloc(state, table_capacity * sizeof(size_t));
+    if (starts == NULL || hashes == NULL || pure == NULL || classes == NULL || counts == NULL
+        || firsts == NULL || temps == NULL || covered == NULL || skipped == NULL || stack == NULL || table == NULL)
+        return (hs_token_list_t){.items = NULL, .size = 0, .capacity = 0};
+    for (size_t b = 0; b < table_capacity; b++)
+        table[b] = -1;
+
+    size_t depth = 0;
+    for (size_t i = 0; i < n; i++) {
+        hs_token_t token = rpn->items[i];
+        size_t operands = 0;
+        pure[i] = true;
+        if (token.kind == HS_TOKEN_ID) {
+            size_t func_i = hs_func_slot(state, token.symbol);
+            if (func_i == -1) {
+                pure[i] = false;
+            } else {
+                operands = hs_func_at(state, func_i)->params_count;
+                // builtins keep the slot of their entry in hs_default_funcs
+                pure[i] = hs_func_at(state, func_i)->func != NULL && hs_default_funcs[func_i].quiet;
+            }
+        } else if (hs_is_op(token.kind)) {
+            operands = 2;
+            pure[i] = token.kind != HS_TOKEN_DIVIDE && token.kind != HS_TOKEN_POWER;
+        }
+        if (operands > depth) {
+            // malformed, leave it to hs_solve to complain about it
+            return *rpn;
+        }
+
+        size_t hash = hs_token_hash(rpn, token);
+        starts[i] = operands > 0 ? starts[stack[depth - operands]] : i;
+        for (size_t k = depth - operands; k < depth; k++) {
+            pure[i] = pure[i] && pure[stack[k]];
+            hash = hash * 1099511628211ull ^ hashes[stack[k]];
+        }
+        hashes[i] = hash;
+        depth -= operands;
+        stack[depth++] = i;
+
+        classes[i] = i;
+        counts[i] = 0;
+        temps[i] = -1;
+        covered[i] = false;
+        skipped[i] = false;
+        // single tokens are as cheap to solve as to load
+        if (!pure[i] || i == starts[i])
+            continue;
+        size_t length = i - starts[i] + 1;
+        size_t mask = table_capacity - 1;
+        size_t b = hash & mask;
+        for (; table[b] != -1; b = (b + 1) & mask) {
+            size_t other = table[b];
+            if (hashes[other] != hash || other - starts[other] + 1 != length)
+                continue;
+            size_t k = 0;
+            while (k < length && hs_token_same(rpn, rpn->items[starts[i] + k], rpn->items[starts[other] + k]))
+                k++;
+            if (k == length)
+                break;
+        }
+        if (table[b] == -1)
+            table[b] = i;
+        classes[i] = table[b];
+        counts[classes[i]]++;
+    }
+
+    // every repeat will be replaced by a load, subtrees inside a repeat are not solved at all then
+    size_t cover_start = n;
+    for (size_t i = n; i-- > 0;) {
+        if (i < cover_start)
+            cover_start = n;
+        if (cover_start != n) {
+            covered[i] = true;
+        } else if (counts[classes[i]] > 1 && classes[i] != i) {
+            cover_start = starts[i];
+        }
+    }
+    // count again without the covered subtrees, the first one left of every class is stored
+    for (size_t i = 0; i < n; i++)
+        counts[i] = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!covered[i] && pure[i] && i != starts[i]) {
+            if (counts[classes[i]]++ == 0)
+                firsts[classes[i]] = i;
+        }
+    }
+    // loads may replace less than assumed above, only skip what the final loads replace
+    size_t skip_start = n;
+    for (size_t i = n; i-- > 0;) {
+        if (i < skip_start)
+            skip_start = n;
+        if (skip_start != n) {
+            skipped[i] = true;
+        } else if (!covered[i] && pure[i] && i != starts[i] && counts[classes[i]] > 1 && firsts[classes[i]] != i) {
+            skip_start = starts[i];
+        }
+    }
+
+    hs_token_list_t output = hs_token_list_init(state, rpn);
+    if (output.items == NULL)
+        return output;
+    output.temps = rpn->temps;
+
+    for (size_t i = 0; i < n; i++) {
+        if (skipped[i])
+            continue;
+        hs_token_t token = rpn->items[i];
+        size_t class = classes[i];
+        if (!covered[i] && pure[i] && i != starts[i] && counts[class] > 1) {
+            if (firsts[class] == i) {
+                temps[class] = output.temps++;
+                if (!hs_token_list_push(state, &output, token)
+                    || !hs_token_list_push(state, &output, (hs_token_t){.kind = HS_TOKEN_STORE, .temp_i = temps[class]}))
+                    return (hs_token_list_t){.items = NULL, .size = 0, .capacity = 0};
+            } else {
+                if (!hs_token_list_push(state, &output, (hs_token_t){.kind = HS_TOKEN_LOAD, .temp_i = temps[class]}))
+                    return (hs_token_list_t){.items = NULL, .size = 0, .capacity = 0};
+            }
+            continue;
+        }
+        if (!hs_token_list_push(state, &output, token))
+            return (hs_token_list_t){.items = NULL, .size = 0, .capacity = 0};
+    }
+    return output;
+}
+
+// all passes that run between hs_shunting_yard and hs_solve
+hs_token_list_t hs_optimize(hs_token_list_t *rpn, hs_state_t *state) {
+    hs_token_list_t folded = hs_fold(rpn, state);
+    if (folded.items == NULL)
+        return folded;
+    return hs_cse(&folded, state);
+}
+
+hs_value_list_t hs_rpn_list_init(hs_state_t *state) {
+    hs_value_list_t list = {
+        .items = hs_alloc(state, NULL, HS_LIST_INITIAL_CAPACITY * sizeof(hs_value_t)),
+        .capacity = HS_LIST_INITIAL_CAPACITY,
+        .size = 0,
+    };
+    if (list.items == NULL) {
+        hs_error(state, "out of memory during value list initialization :(" ENDL);
+        return list;
+    }
+    return list;
+}
+
+bool hs_value_list_push(hs_state_t *state, hs_value_list_t *list, hs_value_t item) {
+    if (list->size >= list->capacity) {
+        list->capacity *= 2;
+        list->items = hs_alloc(state, list->items, list->capacity * sizeof(hs_value_t));
+        if (list->items == NULL) {
+            hs_error(state, "out of memory during value list reallocation at " SIZE_T_F " items :(" ENDL, list->size);
+            return false;
+        }
+    }
+    if (list->items == NULL) {
+        return false;
+    }
+    list->items[list->size++] = item;
+    return true;
+}
+
+hs_value_t hs_value_list_pop_above(hs_state_t *state, hs_value_list_t *list, size_t floor) {
+    if (list->size > floor && list->items != NULL) {
+        list->size--;
+        return list->items[list->size];
+    } else {
+        hs_printf(state, "WARNING: missing some expected value" ENDL);
+        return HS_ZERO;
+    }
+}
+
+bool hs_str_same(char *a, char *b) {
+    size_t i = 0;
+    while (a[i] != '\0' && b[i] != '\0') {
+        if (a[i] != b[i]) {
+            return false;
+        }
+        i++;
+    }
+    return a[i] == '\0' && b[i] == '\0';
+}
+
+size_t hs_str_len(char *a) {
+    size_t i = 0;
+    while (a[i] != '\0')
+        i++;
+    return i;
+}
+
+// evaluates rpn on top of state->stack, frame is the stack index of the first parameter (-1 outside of function calls).
+// the stack is left exactly as it was found
+hs_value_t hs_solve(hs_token_list_t *tokens, hs_state_t *state, size_t frame) {
+    hs_value_list_t *list = &state->stack;
+    state->stats.ops += tokens->size;
+    // temporary slots of the list come first, start is where the actual evaluation begins
+    size_t temps = list->size;
+    size_t start = temps;
+    hs_value_t result = HS_ZERO;
+
+    if (list->items == NULL)
+        goto hs_solve_error;
+    for (size_t i = 0; i < tokens->temps; i++) {
+        if (!hs_value_list_push(state, list, HS_ZERO))
+            goto hs_solve_error;
+    }
+    start = list->size;
+
+    for (size_t i = 0; i < tokens->size; i++) {
+        hs_value_t a, b;
+
+        switch (tokens->items[i].kind) {
+            case HS_TOKEN_VALUE:
+                if (!hs_value_list_push(state, list, tokens->values[tokens->items[i].value_i]))
+                    goto hs_solve_error;
+                break;
+            case HS_TOKEN_STORE:
+                list->items[temps + tokens->items[i].temp_i] = list->items[list->size - 1];
+                break;
+            case HS_TOKEN_LOAD:
+                if (!hs_value_list_push(state, list, list->items[temps + tokens->items[i].temp_i]))
+                    goto hs_solve_error;
+                break;
+            case HS_TOKEN_ID_IS_VAR: {
+                size_t var_i = hs_var_slot(state, tokens->items[i].symbol);
+                if (var_i == -1) {
+                    hs_error(state, "var %s not found" ENDL, hs_symbol_name(state, tokens->items[i].symbol));
+                    goto hs_solve_error;
+                }
+                if (!hs_value_list_push(state, list, hs_var_at(state, var_i)->value))
+                    goto hs_solve_error;
+                break;
+            }
+            case HS_TOKEN_PARAM:
+                if (frame == -1) {
+                    hs_error(state, "parameter outside of function call" ENDL);
+                    goto hs_solve_error;
+                }
+                if (!hs_value_list_push(state, list, list->items[frame + tokens->items[i].param_i]))
+                    goto hs_solve_error;
+                break;
+            case HS_TOKEN_ID: {
+                size_t func_i = hs_func_slot(state, tokens->items[i].symbol);
+                if (func_i == -1) {
+                    hs_error(state, "function %s not found" ENDL, hs_symbol_name(state, tokens->items[i].symbol));
+                    goto hs_solve_error;
+                }
+                hs_func_t *func = hs_func_at(state, func_i);
+                hs_value_t return_value;
+                if (func->func == NULL) {
+                    if (func->body.items == NULL) {
+                        hs_error(state, "function %s has no valid expression" ENDL, hs_symbol_name(state, func->id));
+                        goto hs_solve_error;
+                    }
+                    // the arguments already are the topmost values, they become the parameters of the new frame in place
+                    size_t available = list->size - start;
+                    if (available < func->params_count) {
+                        size_t missing = func->params_count - available;
+                        for (size_t k = 0; k < missing; k++) {
+                            hs_printf(state, "WARNING: missing some expected value" ENDL);
+                            if (!hs_value_list_push(state, list, HS_ZERO))
+                                goto hs_solve_error;
+                        }
+                        for (size_t k = list->size - 1; k >= start + missing; k--)
+                            list->items[k] = list->items[k - missing];
+                        for (size_t k = 0; k < missing; k++)
+                            list->items[start + k] = HS_ZERO;
+                    }
+                    size_t call_frame = list->size - func->params_count;
+                    return_value = hs_call(state, func_i, func, call_frame, false);
+                    list->size = call_frame;
+                } else {
+                    if (func->params_count == 1) {
+                        a = hs_value_list_pop_above(state, list, start);
+                        return_value = func->func(state, a, HS_ZERO);
+                    } else {
+                        b = hs_value_list_pop_above(state, list, start);
+                        a = hs_value_list_pop_above(state, list, start);
+                        return_value = func->func(state, a, b);
+                    }
+                }
+                if (!hs_value_list_push(state, list, return_value))
+                    goto hs_solve_error;
+                break;
+            }
+            case HS_TOKEN_COMMA:
+                hs_error(state, "comma made it to rpn?" ENDL);
+                goto hs_solve_error;
+            case HS_TOKEN_ADD:
+                b = hs_value_list_pop_above(state, list, start);
+                a = hs_value_list_pop_above(state, list, start);
+                if (!hs_value_list_push(state, list, hs_f_add(state, a, b)))
+                    goto hs_solve_error;
+                break;
+            case HS_TOKEN_SUBTRACT:
+                b = hs_value_list_pop_above(state, list, start);
+                a = hs_value_list_pop_above(state, list, start);
+                if (!hs_value_list_push(state, list, hs_f_subtract(state, a, b)))
+                    goto hs_solve_error;
+                break;
+            case HS_TOKEN_MULTIPLY:
+                b = hs_value_list_pop_above(state, list, start);
+                a = hs_value_list_pop_above(state, list, start);
+                if (!hs_value_list_push(state, list, hs_f_multiply(state, a, b)))
+                    goto hs_solve_error;
+                break;
+            case HS_TOKEN_DIVIDE:
+                b = hs_value_list_pop_above(state, list, start);
+                a = hs_value_list_pop_above(state, list, start);
+                if (!hs_value_list_push(state, list, hs_f_divide(state, a, b)))
+                    goto hs_solve_error;
+                break;
+            case HS_TOKEN_MODULO:
+                b = hs_value_list_pop_above(state, list, start);
+                a = hs_value_list_pop_above(state, list, start);
+                if (!hs_value_list_push(state, list, hs_f_modulo(state, a, b)))
+                    goto hs_solve_error;
+                break;
+            case HS_TOKEN_POWER:
+                b = hs_value_list_pop_above(state, list, start);
+                a = hs_value_list_pop_above(state, list, start);
+                if (!hs_value_list_push(state, list, hs_f_pow(state, a, b)))
+                    goto hs_solve_error;
+                break;
+            case HS_TOKEN_AND:
+                b = hs_value_list_pop_above(state, list, start);
+                a = hs_value_list_pop_above(state, list, start);
+                if (!hs_value_list_push(state, list, hs_f_and(state, a, b)))
+                    goto hs_solve_error;
+                break;
+            case HS_TOKEN_OR:
+                b = hs_value_list_pop_above(state, list, start);
+                a = hs_value_list_pop_above(state, list, start);
+                if (!hs_value_list_push(state, list, hs_f_or(state, a, b)))
+                    goto hs_solve_error;
+                break;
+            case HS_TOKEN_XOR:
+                b = hs_value_list_pop_above(state, list, start);
+                a = hs_value_list_pop_above(state, list, start);
+                if (!hs_value_list_push(state, list, hs_f_xor(state, a, b)))
+                    goto hs_solve_error;
+                break;
+            case HS_TOKEN_SHIFTL:
+                b = hs_value_list_pop_above(state, list, start);
+                a = hs_value_list_pop_above(state, list, start);
+                if (!hs_value_list_push(state, list, hs_f_shiftl(state, a, b)))
+                    goto hs_solve_error;
+                break;
+            case HS_TOKEN_SHIFTR:
+                b = hs_value_list_pop_above(state, list, start);
+                a = hs_value_list_pop_above(state, list, start);
+                if (!hs_value_list_push(state, list, hs_f_shiftr(state, a, b)))
+                    goto hs_solve_error;
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (list->size == start) {
+        hs_error(state, "something went wrong during rpn calculation" ENDL);
+        goto hs_solve_error;
+    } else {
+        if (list->size > start + 1) {
+            hs_printf(state, "WARNING: multiple entries left at end of rpn, which is slightly odd" ENDL);
+        }
+        result = hs_value_list_pop_above(state, list, start);
+    }
+
+    list->size = temps;
+
+    return result;
+
+hs_solve_error:
+    if (list->size > start && list->items != NULL)
+        result = hs_value_list_pop_above(state, list, start);
+    hs_printf(state, "(possibly erroneous) ");
+
+    list->size = temps;
+
+    return result;
+}
+
+// compiles rpn into bytecode for hs_program_run, the program lives in the arena.
+// returns false if the rpn can not be compiled (malformed, literals with warnings), it has to be solved by hs_solve then
+bool hs_program_compile(hs_token_list_t *rpn, hs_state_t *state, hs_program_t *program) {
+    *program = (hs_program_t){
+        .code = hs_arena_alloc(state, (rpn->size + 1) * sizeof(hs_instruction_t)),
+        .size = 0,
+        .values = hs_arena_alloc(state, (rpn->values_size + 1) * sizeof(hs_value_t)),
+        .values_size = rpn->values_size,
+        .temps = rpn->temps,
+        .max_depth = 0,
+    };
+    if (program->code == NULL || program->values == NULL)
+        goto hs_program_compile_error;
+    for (size_t i = 0; i < rpn->values_size; i++)
+        program->values[i] = rpn->values[i];
+
+    size_t depth = 0;
+    for (size_t i = 0; i < rpn->size; i++) {
+        hs_token_t token = rpn->items[i];
+        hs_instruction_t instruction = {.target = NULL, .op = HS_OP_RETURN, .arg = 0};
+        // values taken from and pushed to the stack
+        size_t pops = 0;
+        size_t pushes = 1;
+
+        switch (token.kind) {
+            case HS_TOKEN_VALUE:
+                instruction.op = HS_OP_VALUE;
+                instruction.arg = token.value_i;
+                break;
+            case HS_TOKEN_ID_IS_VAR:
+                instruction.op = HS_OP_VAR;
+                instruction.arg = token.symbol;
+                break;
+            case HS_TOKEN_PARAM:
+                instruction.op = HS_OP_PARAM;
+                instruction.arg = token.param_i;
+                break;
+            case HS_TOKEN_STORE:
+                instruction.op = HS_OP_STORE;
+                instruction.arg = token.temp_i;
+                pops = 1;
+                break;
+            case HS_TOKEN_LOAD:
+                instruction.op = HS_OP_LOAD;
+                instruction.arg = token.temp_i;
+                break;
+            case HS_TOKEN_ID: {
+                size_t func_i = hs_func_slot(state, token.symbol);
+                if (func_i == -1) {
+                    instruction.op = HS_OP_CALL_UNKNOWN;
+                    instruction.arg = token.symbol;
+                    pushes = 0;
+                    break;
+                }
+                hs_func_t *func = hs_func_at(state, func_i);
+                instruction.arg = func_i;
+                pops = func->params_count;
+                if (func->func == NULL) {
+                    instruction.op = HS_OP_CALL;
+                } else if (func->params_count == 1) {
+                    instruction.op = HS_OP_CALL_BUILTIN_1;
+                } else if (func->params_count == 2) {
+                    instruction.op = HS_OP_CALL_BUILTIN_2;
+                } else {
+                    goto hs_program_compile_error;
+                }
+                break;
+            }
+            case HS_TOKEN_ADD:
+            case HS_TOKEN_SUBTRACT:
+            case HS_TOKEN_MULTIPLY:
+            case HS_TOKEN_DIVIDE:
+            case HS_TOKEN_MODULO:
+            case HS_TOKEN_POWER:
+            case HS_TOKEN_AND:
+            case HS_TOKEN_OR:
+            case HS_TOKEN_XOR:
+            case HS_TOKEN_SHIFTL:
+            case HS_TOKEN_SHIFTR:
+                instruction.op = HS_OP_ADD + (token.kind - HS_TOKEN_ADD);
+                pops = 2;
+                break;
+            default:
+                goto hs_program_compile_error;
+        }
+        // STORE keeps its operand on the stack
+        if (token.kind == HS_TOKEN_STORE)
+            pushes = 1;
+        if (pops > depth)
+            goto hs_program_compile_error;
+        depth = depth - pops + pushes;
+        if (depth > program->max_depth)
+            program->max_depth = depth;
+        program->code[program->size++] = instruction;
+    }
+    // anything else gets the warnings of hs_solve
+    if (depth != 1)
+        goto hs_program_compile_error;
+    program->code[program->size++] = (hs_instruction_t){.target = NULL, .op = HS_OP_RETURN, .arg = 0};
+    hs_program_run(program, state, HS_PROGRAM_THREAD);
+    return true;
+
+hs_program_compile_error:
+    *program = (hs_program_t){.code = NULL, .size = 0};
+    return false;
+}
+
+#if defined(__GNUC__) && !HS_NO_COMPUTED_GOTO
+#define HS_COMPUTED_GOTO 1
+#define HS_OP(name) hs_op_##name:
+#define HS_DISPATCH() goto *(ip++)->target
+#else
+#define HS_COMPUTED_GOTO 0
+#define HS_OP(name) case HS_OP_##name:
+#define HS_DISPATCH() continue
+#endif
+
+// runs a program compiled by hs_program_compile on top of state->stack, frame is the same as for hs_solve.
+// there are no bounds checks while running, the stack is grown once up front to what the compiler computed
+hs_value_t hs_program_run(hs_program_t *program, hs_state_t *state, size_t frame) {
+#if HS_COMPUTED_GOTO
+    static const void *targets[] = {
+        [HS_OP_VALUE] = &&hs_op_VALUE,
+        [HS_OP_VAR] = &&hs_op_VAR,
+        [HS_OP_PARAM] = &&hs_op_PARAM,
+        [HS_OP_STORE] = &&hs_op_STORE,
+        [HS_OP_LOAD] = &&hs_op_LOAD,
+        [HS_OP_ADD] = &&hs_op_ADD,
+        [HS_OP_SUBTRACT] = &&hs_op_SUBTRACT,
+        [HS_OP_MULTIPLY] = &&hs_op_MULTIPLY,
+        [HS_OP_DIVIDE] = &&hs_op_DIVIDE,
+        [HS_OP_MODULO] = &&hs_op_MODULO,
+        [HS_OP_POWER] = &&hs_op_POWER,
+        [HS_OP_AND] = &&hs_op_AND,
+        [HS_OP_OR] = &&hs_op_OR,
+        [HS_OP_XOR] = &&hs_op_XOR,
+        [HS_OP_SHIFTL] = &&hs_op_SHIFTL,
+        [HS_OP_SHIFTR] = &&hs_op_SHIFTR,
+        [HS_OP_CALL_BUILTIN_1] = &&hs_op_CALL_BUILTIN_1,
+        [HS_OP_CALL_BUILTIN_2] = &&hs_op_CALL_BUILTIN_2,
+        [HS_OP_CALL] = &&hs_op_CALL,
+        [HS_OP_CALL_UNKNOWN] = &&hs_op_CALL_UNKNOWN,
+        [HS_OP_RETURN] = &&hs_op_RETURN,
+    };
+#endif
+    if (frame == HS_PROGRAM_THREAD) {
+#if HS_COMPUTED_GOTO
+        for (size_t i = 0; i < program->size; i++)
+            program->code[i].target = targets[program->code[i].op];
+#endif
+        return HS_ZERO;
+    }
+
+    // programs have no jumps, every instruction runs once (unless there is an error)
+    state->stats.ops += program->size;
+    hs_value_list_t *list = &state->stack;
+    size_t base = list->size;
+    size_t needed = base + program->temps + program->max_depth;
+    if (list->items == NULL)
+        return HS_ZERO;
+    if (needed > list->capacity) {
+        size_t capacity = list->capacity * 2 > needed ? list->capacity * 2 : needed;
+        hs_value_t *items = hs_alloc(state, list->items, capacity * sizeof(hs_value_t));
+        if (items == NULL) {
+            hs_error(state, "out of memory during value list reallocation at " SIZE_T_F " items :(" ENDL, list->size);
+            return HS_ZERO;
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+    hs_value_t *stack = list->items;
+    hs_value_t *temps = stack + base;
+    hs_value_t *start = temps + program->temps;
+    hs_value_t *sp = start;
+    hs_instruction_t *ip = program->code;
+    hs_value_t a, b, result;
+
+#if HS_COMPUTED_GOTO
+    HS_DISPATCH();
+#else
+    for (;;) {
+        switch ((ip++)->op) {
+#endif
+    HS_OP(VALUE)
+        *sp++ = program->values[ip[-1].arg];
+        HS_DISPATCH();
+    HS_OP(VAR) {
+        size_t var_i = hs_var_slot(state, ip[-1].arg);
+        if (var_i == -1) {
+            hs_error(state, "var %s not found" ENDL, hs_symbol_name(state, ip[-1].arg));
+            goto hs_program_run_error;
+        }
+        *sp++ = hs_var_at(state, var_i)->value;
+        HS_DISPATCH();
+    }
+    HS_OP(PARAM)
+        if (frame == -1) {
+            hs_error(state, "parameter outside of function call" ENDL);
+            goto hs_program_run_error;
+        }
+        *sp++ = stack[frame + ip[-1].arg];
+        HS_DISPATCH();
+    HS_OP(STORE)
+        temps[ip[-1].arg] = sp[-1];
+        HS_DISPATCH();
+    HS_OP(LOAD)
+        *sp++ = temps[ip[-1].arg];
+        HS_DISPATCH();
+    HS_OP(ADD)
+        sp--;
+        sp[-1] = (hs_value_t){.re = sp[-1].re + sp[0].re, .im = sp[-1].im + sp[0].im};
+        HS_DISPATCH();
+    HS_OP(SUBTRACT)
+        sp--;
+        sp[-1] = (hs_value_t){.re = sp[-1].re - sp[0].re, .im = sp[-1].im - sp[0].im};
+        HS_DISPATCH();
+    HS_OP(MULTIPLY)
+        sp--;
+        a = sp[-1];
+        b = sp[0];
+        sp[-1] = (hs_value_t){.re = a.re * b.re - a.im * b.im, .im = a.re * b.im + a.im * b.re};
+        HS_DISPATCH();
+    HS_OP(DIVIDE)
+        sp--;
+        sp[-1] = hs_f_divide(state, sp[-1], sp[0]);
+        HS_DISPATCH();
+    HS_OP(MODULO)
+        sp--;
+        sp[-1] = hs_f_modulo(state, sp[-1], sp[0]);
+        HS_DISPATCH();
+    HS_OP(POWER)
+        sp--;
+        sp[-1] = hs_f_pow(state, sp[-1], sp[0]);
+        HS_DISPATCH();
+    HS_OP(AND)
+        sp--;
+        sp[-1] = hs_f_and(state, sp[-1], sp[0]);
+        HS_DISPATCH();
+    HS_OP(OR)
+        sp--;
+        sp[-1] = hs_f_or(state, sp[-1], sp[0]);
+        HS_DISPATCH();
+    HS_OP(XOR)
+        sp--;
+        sp[-1] = hs_f_xor(state, sp[-1], sp[0]);
+        HS_DISPATCH();
+    HS_OP(SHIFTL)
+        sp--;
+        sp[-1] = hs_f_shiftl(state, sp[-1], sp[0]);
+        HS_DISPATCH();
+    HS_OP(SHIFTR)
+        sp--;
+        sp[-1] = hs_f_shiftr(state, sp[-1], sp[0]);
+        HS_DISPATCH();
+    HS_OP(CALL_BUILTIN_1)
+        sp[-1] = hs_func_at(state, ip[-1].arg)->func(state, sp[-1], HS_ZERO);
+        HS_DISPATCH();
+    HS_OP(CALL_BUILTIN_2)
+        sp--;
+        sp[-1] = hs_func_at(state, ip[-1].arg)->func(state, sp[-1], sp[0]);
+        HS_DISPATCH();
+    HS_OP(CALL) {
+        hs_func_t *func = hs_func_at(state, ip[-1].arg);
+        if (func->body.items == NULL) {
+            hs_error(state, "function %s has no valid expression" ENDL, hs_symbol_name(state, func->id));
+            goto hs_program_run_error;
+        }
+        // the arguments are the topmost values, they become the frame of the call in place
+        size_t call_frame = (sp - stack) - func->params_count;
+        list->size = sp - stack;
+        result = hs_call(state, ip[-1].arg, func, call_frame, true);
+        // the call may have grown the stack
+        stack = list->items;
+        temps = stack + base;
+        start = temps + program->temps;
+        sp = stack + call_frame;
+        *sp++ = result;
+        HS_DISPATCH();
+    }
+    HS_OP(CALL_UNKNOWN)
+        hs_error(state, "function %s not found" ENDL, hs_symbol_name(state, ip[-1].arg));
+        goto hs_program_run_error;
+    HS_OP(RETURN)
+        list->size = base;
+        return sp[-1];
+#if !HS_COMPUTED_GOTO
+        }
+    }
+#endif
+
+hs_program_run_error:
+    result = sp > start ? sp[-1] : HS_ZERO;
+    hs_printf(state, "(possibly erroneous) ");
+    list->size = base;
+    return result;
+}
+
+// solves rpn with the bytecode engine if it is enabled and the rpn can be compiled, with hs_solve otherwise
+hs_value_t hs_evaluate(hs_token_list_t *rpn, hs_state_t *state, size_t frame) {
+    hs_program_t program;
+    state->stats.evaluations++;
+    if (state->settings.vm && hs_program_compile(rpn, state, &program))
+        return hs_program_run(&program, state, frame);
+    return hs_solve(rpn, state, frame);
+}
+
+// 64 bit significand times power of two, the working number type of the grisu digit generation
+typedef struct hs_diy_fp {
+    uint64_t f;
+    int32_t e;
+} hs_diy_fp_t;
+
+// normalized 10^k for k = -348, -340, ..., 340, f is rounded to 64 bits
+const uint64_t hs_cached_powers_f[] = {
+    0xfa8fd5a0081c0288, 0xbaaee17fa23ebf76, 0x8b16fb203055ac76,
+    0xcf42894a5dce35ea, 0x9a6bb0aa55653b2d, 0xe61acf033d1a45df,
+    0xab70fe17c79ac6ca, 0xff77b1fcbebcdc4f, 0xbe5691ef416bd60c,
+    0x8dd01fad907ffc3c, 0xd3515c2831559a83, 0x9d71ac8fada6c9b5,
+    0xea9c227723ee8bcb, 0xaecc49914078536d, 0x823c12795db6ce57,
+    0xc21094364dfb5637, 0x9096ea6f3848984f, 0xd77485cb25823ac7,
+    0xa086cfcd97bf97f4, 0xef340a98172aace5, 0xb23867fb2a35b28e,
+    0x84c8d4dfd2c63f3b, 0xc5dd44271ad3cdba, 0x936b9fcebb25c996,
+    0xdbac6c247d62a584, 0xa3ab66580d5fdaf6, 0xf3e2f893dec3f126,
+    0xb5b5ada8aaff80b8, 0x87625f056c7c4a8b, 0xc9bcff6034c13053,
+    0x964e858c91ba2655, 0xdff9772470297ebd, 0xa6dfbd9fb8e5b88f,
+    0xf8a95fcf88747d94, 0xb94470938fa89bcf, 0x8a08f0f8bf0f156b,
+    0xcdb02555653131b6, 0x993fe2c6d07b7fac, 0xe45c10c42a2b3b06,
+    0xaa242499697392d3, 0xfd87b5f28300ca0e, 0xbce5086492111aeb,
+    0x8cbccc096f5088cc, 0xd1b71758e219652c, 0x9c40000000000000,
+    0xe8d4a51000000000, 0xad78ebc5ac620000, 0x813f3978f8940984,
+    0xc097ce7bc90715b3, 0x8f7e32ce7bea5c70, 0xd5d238a4abe98068,
+    0x9f4f2726179a2245, 0xed63a231d4c4fb27, 0xb0de65388cc8ada8,
+    0x83c7088e1aab65db, 0xc45d1df942711d9a, 0x924d692ca61be758,
+    0xda01ee641a708dea, 0xa26da3999aef774a, 0xf209787bb47d6b85,
+    0xb454e4a179dd1877, 0x865b86925b9bc5c2, 0xc83553c5c8965d3d,
+    0x952ab45cfa97a0b3, 0xde469fbd99a05fe3, 0xa59bc234db398c25,
+    0xf6c69a72a3989f5c, 0xb7dcbf5354e9bece, 0x88fcf317f22241e2,
+    0xcc20ce9bd35c78a5, 0x98165af37b2153df, 0xe2a0b5dc971f303a,
+    0xa8d9d1535ce3b396, 0xfb9b7cd9a4a7443c, 0xbb764c4ca7a44410,
+    0x8bab8eefb6409c1a, 0xd01fef10a657842c, 0x9b10a4e5e9913129,
+    0xe7109bfba19c0c9d, 0xac2820d9623bf429, 0x80444b5e7aa7cf85,
+    0xbf21e44003acdd2d, 0x8e679c2f5e44ff8f, 0xd433179d9c8cb841,
+    0x9e19db92b4e31ba9, 0xeb96bf6ebadf77d9, 0xaf87023b9bf0ee6b,
+};
+const int16_t hs_cached_powers_e[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954,
+    -927, -901, -874, -847, -821, -794, -768, -741, -715, -688, -661,
+    -635, -608, -582, -555, -529, -502, -475, -449, -422, -396, -369,
+    -343, -316, -289, -263, -236, -210, -183, -157, -130, -103, -77,
+    -50, -24, 3, 30, 56, 83, 109, 136, 162, 189, 216,
+    242, 269, 295, 322, 348, 375, 402, 428, 455, 481, 508,
+    534, 561, 588, 614, 641, 667, 694, 720, 747, 774, 800,
+    827, 853, 880, 907, 933, 960, 986, 1013, 1039, 1066,
+};
+const uint64_t hs_pow10[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL,
+    10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL, 100000000000000ULL,
+    1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL, 1000000000000000000ULL,
+    10000000000000000000ULL,
+};
+
+// upper 64 bits of the 128 bit product, rounded
+hs_diy_fp_t hs_diy_fp_multiply(hs_diy_fp_t x, hs_diy_fp_t y) {
+    uint64_t a = x.f >> 32, b = x.f & 0xFFFFFFFFULL;
+    uint64_t c = y.f >> 32, d = y.f & 0xFFFFFFFFULL;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t middle = (bd >> 32) + (ad & 0xFFFFFFFFULL) + (bc & 0xFFFFFFFFULL) + (1ULL << 31);
+    return (hs_diy_fp_t){ac + (ad >> 32) + (bc >> 32) + (middle >> 32), x.e + y.e + 64};
+}
+
+hs_diy_fp_t hs_diy_fp_normalize(hs_diy_fp_t x) {
+    while (!(x.f & (1ULL << 63))) {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+// writes the shortest digits (without leading or trailing zeros) that read back as value into digits (at least
+// 18 chars), value must be positive and finite; value = digits * 10^exponent
+size_t hs_grisu_digits(double value, char *digits, int32_t *exponent) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint64_t hidden = 1ULL << 52;
+    int32_t biased = (int32_t)((bits >> 52) & 0x7FF);
+    hs_diy_fp_t v = {bits & (hidden - 1), -1074};
+    if (biased != 0) {
+        v.f += hidden;
+        v.e = biased - 1075;
+    }
+
+    // neighbours half way to the next smaller and larger double, everything in between reads back as value
+    hs_diy_fp_t plus = hs_diy_fp_normalize((hs_diy_fp_t){(v.f << 1) + 1, v.e - 1});
+    hs_diy_fp_t minus = v.f == hidden ? (hs_diy_fp_t){(v.f << 2) - 1, v.e - 2} : (hs_diy_fp_t){(v.f << 1) - 1, v.e - 1};
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    // pick the cached power that scales plus into [2^-60, 2^-32) * 2^64, k = ceil((-61 - e) * log10(2)) + 347
+    int64_t scaled = (int64_t)(-61 - plus.e) * 78913;
+    int32_t k = 347;
+    if (scaled > 0)
+        k += (int32_t)(scaled >> 18) + 1;
+    else if (scaled < 0)
+        k -= (int32_t)((-scaled) >> 18);
+    size_t index = (size_t)(k >> 3) + 1;
+    int32_t decimal_exponent = 348 - (int32_t)index * 8;
+    hs_diy_fp_t cached = {hs_cached_powers_f[index], hs_cached_powers_e[index]};
+
+    hs_diy_fp_t w = hs_diy_fp_multiply(hs_diy_fp_normalize(v), cached);
+    hs_diy_fp_t high = hs_diy_fp_multiply(plus, cached);
+    hs_diy_fp_t low = hs_diy_fp_multiply(minus, cached);
+    high.f--;
+    low.f++;
+    uint64_t delta = high.f - low.f;
+    uint64_t high_minus_w = high.f - w.f;
+
+    // generate digits of high until the rest is within delta
+    int32_t shift = -high.e;
+    uint64_t one = 1ULL << shift;
+    uint32_t integral = (uint32_t)(high.f >> shift);
+    uint64_t fraction = high.f & (one - 1);
+    int32_t kappa = 1;
+    while (kappa < 10 && integral >= hs_pow10[kappa])
+        kappa++;
+    size_t length = 0;
+    uint64_t rest, ten_kappa;
+    for (;;) {
+        if (kappa > 0) {
+            uint32_t digit = (uint32_t)(integral / hs_pow10[kappa - 1]);
+            integral %= (uint32_t)hs_pow10[kappa - 1];
+            if (digit || length)
+                digits[length++] = '0' + digit;
+            kappa--;
+            rest = ((uint64_t)integral << shift) + fraction;
+            if (rest <= delta) {
+                ten_kappa = hs_pow10[kappa] << shift;
+                break;
+            }
+        } else {
+            fraction *= 10;
+            delta *= 10;
+            uint32_t digit = (uint32_t)(fraction >> shift);
+            if (digit || length)
+                digits[length++] = '0' + digit;
+            fraction &= one - 1;
+            kappa--;
+            if (fraction < delta) {
+                rest = fraction;
+                ten_kappa = one;
+                high_minus_w *= -kappa < 20 ? hs_pow10[-kappa] : 0;
+                break;
+            }
+        }
+    }
+
+    // walk the last digit down towards w as long as the result stays inside the boundaries
+    while (rest < high_minus_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < high_minus_w || high_minus_w - rest > rest + ten_kappa - high_minus_w)) {
+        digits[length - 1]--;
+        rest += ten_kappa;
+    }
+    while (length > 1 && digits[length - 1] == '0') {
+        length--;
+        kappa++;
+    }
+    *exponent = decimal_exponent + kappa;
+    return length;
+}
+
+// rounds digits (value = 0.digits * 10^point) half up to keep digits, returns the new length and may move point
+size_t hs_round_digits(char *digits, size_t length, int32_t *point, int32_t keep) {
+    if (keep >= (int32_t)length)
+        return length;
+    if (keep < 0)
+        return 0;
+    bool up = digits[keep] >= '5';
+    size_t i = (size_t)keep;
+    while (up && i > 0) {
+        if (digits[i - 1] == '9') {
+            i--;
+        } else {
+            digits[i - 1]++;
+            up = false;
+        }
+    }
+    if (up) {
+        digits[0] = '1';
+        (*point)++;
+        return 1;
+    }
+    while (i > 0 && digits[i - 1] == '0')
+        i--;
+    return i;
+}
+
+void hs_format_put(char *buffer, size_t size, size_t *length, char c) {
+    if (*length + 1 < size)
+        buffer[(*length)++] = c;
+}
+
+void hs_format_text(char *buffer, size_t size, size_t *length, const char *text) {
+    while (*text)
+        hs_format_put(buffer, size, length, *text++);
+}
+
+// lays out 0.digits * 10^point with the separators from settings, no leading zero before the decimal separator
+void hs_format_digits(char *digits, size_t length, int32_t point, hs_settings_t *settings, char *buffer, size_t size, size_t *written) {
+    for (int32_t i = 0; i < point; i++) {
+        hs_format_put(buffer, size, written, (size_t)i < length ? digits[i] : '0');
+        int32_t remaining = point - 1 - i;
+        if (settings->sep_out && remaining > 0 && remaining % 3 == 0)
+            hs_format_put(buffer, size, written, settings->sep_char_out);
+    }
+    if ((int32_t)length > point) {
+        hs_format_put(buffer, size, written, settings->dec_sep_char_out);
+        for (int32_t i = point; i < (int32_t)length; i++)
+            hs_format_put(buffer, size, written, i < 0 ? '0' : digits[i]);
+    }
+}
+
+// formats value in decimal into buffer, plain with up to HS_MAX_FRAC_DIGITS fractional digits or scientific as
+// "m * 10^e" with e a multiple of 3 outside of [scient_min, scient_max), returns the length written
+size_t hs_format_dec(double value, hs_settings_t *settings, char *buffer, size_t size) {
+    size_t written = 0;
+    if (isnan(value)) {
+        hs_format_text(buffer, size, &written, "nan");
+        buffer[written] = '\0';
+        return written;
+    }
+    bool negative = value < 0;
+    if (negative)
+        value = -value;
+    if (negative && value >= HS_EPSILON)
+        hs_format_put(buffer, size, &written, '-');
+    if (isinf(value)) {
+        hs_format_text(buffer, size, &written, "inf");
+        buffer[written] = '\0';
+        return written;
+    }
+
+    char digits[20];
+    size_t length = 0;
+    int32_t point = 0;
+    if (value > 0) {
+        int32_t exponent;
+        length = hs_grisu_digits(value, digits, &exponent);
+        point = (int32_t)length + exponent;
+    }
+
+    if (length > 0 && (value < settings->scient_min || value >= settings->scient_max)) {
+        int32_t expo = (point - 1 >= 0 ? (point - 1) / 3 : -((1 - point + 2) / 3)) * 3;
+        length = hs_round_digits(digits, length, &point, point - expo + 3);
+        if (point - 1 - expo >= 3)
+            expo += 3;
+        hs_format_digits(digits, length, point - expo, settings, buffer, size, &written);
+        char exponent_text[24];
+        snprintf(exponent_text, sizeof(exponent_text), " * 10^%d", (int)expo);
+        hs_format_text(buffer, size, &written, exponent_text);
+    } else {
+        length = hs_round_digits(digits, length, &point, point + HS_MAX_FRAC_DIGITS);
+        if (length == 0) {
+            // rounded away completely, drop the sign too
+            written = 0;
+            hs_format_put(buffer, size, &written, '0');
+        } else {
+            hs_format_digits(digits, length, point, settings, buffer, size, &written);
+        }
+    }
+    buffer[written] = '\0';
+    return written;
+}
+
+const char hs_digit_chars[] = "0123456789ABCDEF";
+
+// per output mode: bits per digit, digits per separator group and the prefix letter
+typedef struct hs_radix {
+    hs_output_mode_t mode;
+    uint8_t bits;
+    uint8_t group;
+    char prefix;
+} hs_radix_t;
+
+const hs_radix_t hs_radixes[] = {
+    {HS_OUTPUT_BIN, 1, 4, 'b'},
+    {HS_OUTPUT_OCT, 3, 2, 'o'},
+    {HS_OUTPUT_HEX, 4, 2, 'x'},
+};
+
+// floor(a / b) for b > 0
+int32_t hs_floor_div(int32_t a, int32_t b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// bits shifted right by offset, or left for a negative offset, zero once everything is shifted out
+uint64_t hs_shift_bits(uint64_t bits, int32_t offset) {
+    if (offset >= 64 || offset <= -64)
+        return 0;
+    return offset >= 0 ? bits >> offset : bits << -offset;
+}
+
+// formats value in a power of two base (bin, oct or hex output mode) into buffer, the digits are cut out of the
+// mantissa with shifts and masks so they are exact, at most HS_MAX_FRAC_DIGITS fractional digits are kept
+size_t hs_format_radix(double value, hs_settings_t *settings, char *buffer, size_t size) {
+    size_t written = 0;
+    const hs_radix_t *radix = &hs_radixes[0];
+    for (size_t i = 0; i < sizeof(hs_radixes) / sizeof(hs_radixes[0]); i++) {
+        if (hs_radixes[i].mode == settings->output_mode)
+            radix = &hs_radixes[i];
+    }
+    if (isnan(value)) {
+        hs_format_text(buffer, size, &written, "nan");
+        buffer[written] = '\0';
+        return written;
+    }
+    if (value <= -HS_EPSILON)
+        hs_format_put(buffer, size, &written, '-');
+    value = fabs(value);
+    if (isinf(value)) {
+        hs_format_text(buffer, size, &written, "inf");
+        buffer[written] = '\0';
+        return written;
+    }
+    hs_format_put(buffer, size, &written, '0');
+    hs_format_put(buffer, size, &written, radix->prefix);
+
+    // value = mantissa * 2^shift with an odd mantissa
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint64_t mantissa = bits & ((1ULL << 52) - 1);
+    int32_t biased = (int32_t)((bits >> 52) & 0x7FF);
+    int32_t shift = -1074;
+    if (biased != 0) {
+        mantissa |= 1ULL << 52;
+        shift = biased - 1075;
+    }
+    if (mantissa == 0) {
+        hs_format_put(buffer, size, &written, '0');
+        buffer[written] = '\0';
+        return written;
+    }
+    while (!(mantissa & 1)) {
+        mantissa >>= 1;
+        shift++;
+    }
+    int32_t top_bit = shift;
+    for (uint64_t rest = mantissa >> 1; rest; rest >>= 1)
+        top_bit++;
+
+    int32_t highest = hs_floor_div(top_bit, radix->bits);
+    int32_t lowest = hs_floor_div(shift, radix->bits);
+    if (lowest < -HS_MAX_FRAC_DIGITS)
+        lowest = -HS_MAX_FRAC_DIGITS;
+    if (settings->output_mode == HS_OUTPUT_BIN) {
+        // binary always shows whole nibbles, a zero one for values below one
+        highest = highest >= 0 ? highest / 4 * 4 + 3 : 3;
+    }
+    uint64_t mask = (1ULL << radix->bits) - 1;
+    // fractional digits below the cut may be zero, drop them
+    while (lowest < 0) {
+        int32_t offset = lowest * radix->bits - shift;
+        if (hs_shift_bits(mantissa, offset) & mask)
+            break;
+        lowest++;
+    }
+
+    size_t digits_start = written;
+    for (int32_t i = highest; i >= 0; i--) {
+        int32_t offset = i * radix->bits - shift;
+        uint64_t digit = hs_shift_bits(mantissa, offset);
+        hs_format_put(buffer, size, &written, hs_digit_chars[digit & mask]);
+        if (settings->sep_out && i > 0 && i % radix->group == 0)
+            hs_format_put(buffer, size, &written, settings->sep_char_out);
+    }
+    if (lowest < 0)
+        hs_format_put(buffer, size, &written, settings->dec_sep_char_out);
+    for (int32_t i = -1; i >= lowest; i--) {
+        int32_t offset = i * radix->bits - shift;
+        uint64_t digit = hs_shift_bits(mantissa, offset);
+        hs_format_put(buffer, size, &written, hs_digit_chars[digit & mask]);
+    }
+    if (written == digits_start)
+        hs_format_put(buffer, size, &written, '0');
+    buffer[written] = '\0';
+    return written;
+}
+
+void hs_output_1dim(double value, hs_state_t *state) {
+    if (fabs(value) < 1e-15) {
+        hs_putc(state, '0');
+    } else if (state->settings.output_mode == HS_OUTPUT_DEC) {
+        hs_format_dec(value, &state->settings, state->out_buf, sizeof(state->out_buf));
+        hs_printf(state, "%s", state->out_buf);
+    } else {
+        hs_format_radix(value, &state->settings, state->out_buf, sizeof(state->out_buf));
+        hs_printf(state, "%s", state->out_buf);
+    }
+}
+
+void hs_output(hs_value_t value, hs_state_t *state) {
+    if (fabs(value.im) < HS_EPSILON) {
+        hs_output_1dim(value.re, state);
+    } else {
+        hs_putc(state, '(');
+        hs_output_1dim(value.re, state);
+        hs_putc(state, ' ');
+        if (value.im <= -HS_EPSILON) {
+            value.im = -value.im;
+            hs_putc(state, '-');
+        } else {
+            hs_putc(state, '+');
+        }
+        hs_putc(state, ' ');
+        hs_output_1dim(value.im, state);
+        hs_putc(state, 'i');
+        hs_putc(state, ')');
+    }
+}
+
+uint8_t hs_handle_commands(hs_token_list_t *tokens1, hs_token_list_t *tokens2, bool *is_number_base, hs_state_t *state) {
+    for (size_t i = 0; i < tokens1->size; i++) {
+        if (tokens1->items[i].kind == HS_TOKEN_ID) {
+            if (hs_str_same(hs_symbol_name(state, tokens1->items[i].symbol), "help")) {
+                hs_printf(state, "%s", help_text);
+                continue;
+            } else if (hs_str_same(hs_symbol_name(state, tokens1->items[i].symbol), "list")) {
+                size_t len_func = 0;
+                size_t len_var = 0;
+                
+                size_t funcs_count = hs_funcs_count(state);
+                size_t vars_count = hs_vars_count(state);
+                for (size_t j = 0; j < funcs_count; j++) {
+                    size_t len = 3;
+                    len += hs_str_len(hs_symbol_name(state, hs_func_at(state, j)->id));
+
+                    hs_func_param_t *param = hs_func_at(state, j)->params_linked;
+                    for (uint8_t p = 0; p < hs_func_at(state, j)->params_count; p++) {
+                        if (param == NULL) {
+                            len++;
+                        } else {
+                            len += hs_str_len(hs_symbol_name(state, param->id));
+                            param = param->next;
+                        }
+                        if (p < hs_func_at(state, j)->params_count - 1) {
+                            len += 2;
+                        }
+                    }
+                    if (hs_func_at(state, j)->expression != NULL) {
+                        size_t exp_len = hs_str_len(hs_func_at(state, j)->expression);
+                        if (exp_len > HS_MAX_EXP_LIST_LEN) {
+                            len += HS_MAX_EXP_LIST_LEN + 6;
+                        } else {
+                            len += exp_len + 3;
+                        }
+                    }
+                    
+                    len_func = len > len_func ? len : len_func;
+                }
+                for (size_t j = 0; j < vars_count; j++) {
+                    size_t len = hs_str_len(hs_symbol_name(state, hs_var_listed(state, j)->id)) + 2;
+                    len_var = len > len_var ? len : len_var;
+                }
+
+                const char *funcs = "FUNCS";
+                const char *vars = "VARS";
+                hs_printf(state, "--%s", funcs);
+                for (size_t s = 0; s <= len_func - (hs_str_len((char *)funcs) + 2); s++) {
+                    hs_putc(state, '-');
+                }
+                hs_printf(state, "-|--%s", vars);
+                for (size_t s = 0; s <= len_var + 2 + HS_MAX_FRAC_DIGITS - hs_str_len((char *)vars); s++) {
+                    hs_putc(state, '-');
+                }
+                hs_printf(state, ENDL);
+
+                for (size_t j = 0; j < vars_count || j < funcs_count; j++) {
+                    if (j < funcs_count) {
+                        size_t len = 3;
+                        hs_printf(state, "  %s(", hs_symbol_name(state, hs_func_at(state, j)->id));
+                        len += hs_str_len(hs_symbol_name(state, hs_func_at(state, j)->id));
+    
+                        hs_func_param_t *param = hs_func_at(state, j)->params_linked;
+                        for (uint8_t p = 0; p < hs_func_at(state, j)->params_count; p++) {
+                            if (param == NULL) {
+                                hs_putc(state, 'a' + p);
+                                len++;
+                            } else {
+                                hs_printf(state, "%s", hs_symbol_name(state, param->id));
+                                len += hs_str_len(hs_symbol_name(state, param->id));
+                                param = param->next;
+                            }
+                            if (p < hs_func_at(state, j)->params_count - 1) {
+                                hs_putc(state, ',');
+                                hs_putc(state, ' ');
+                                len += 2;
+                            }
+                        }
+                        hs_putc(state, ')');
+                        if (hs_func_at(state, j)->expression != NULL) {
+                            hs_putc(state, ' ');
+                            hs_putc(state, '=');
+                            hs_putc(state, ' ');
+                            size_t exp_len = hs_str_len(hs_func_at(state, j)->expression);
+                            if (exp_len > HS_MAX_EXP_LIST_LEN) {
+                                for (size_t k = 0; k < HS_MAX_EXP_LIST_LEN; k++) {
+                                    hs_putc(state, hs_func_at(state, j)->expression[k]);
+                                }
+                                hs_printf(state, "...");
+                                len += HS_MAX_EXP_LIST_LEN + 6;
+                            } else {
+                                hs_printf(state, "%s", hs_func_at(state, j)->expression);
+                                len += exp_len + 3;
+                            }
+                        }
+                        for (size_t s = 0; s <= len_func - len; s++) {
+                            hs_putc(state, ' ');
+                        }
+                    } else {
+                        for (size_t s = 0; s <= len_func + 1; s++) {
+                            hs_putc(state, ' ');
+                        }
+                    }
+                    hs_putc(state, '|');
+                    if (j < vars_count) {
+                        hs_printf(state, "  %s", hs_symbol_name(state, hs_var_listed(state, j)->id));
+                        for (size_t s = 0; s <= len_var - (hs_str_len(hs_symbol_name(state, hs_var_listed(state, j)->id)) + 2); s++) {
+                            hs_putc(state, ' ');
+                        }
+                        hs_putc(state, '=');
+                        hs_putc(state, ' ');
+                        hs_output(hs_var_listed(state, j)->value, state);
+                    }
+                    hs_printf(state, ENDL);
+                }
+                continue;
+            } else if (hs_str_same(hs_symbol_name(state, tokens1->items[i].symbol), "settings")) {
+                hs_printf(state, "--SETTINGS--" ENDL);
+                hs_printf(state, "  scient_min = %f" ENDL, state->settings.scient_min);
+                hs_printf(state, "  scient_max = %f" ENDL, state->settings.scient_max);
+                hs_printf(state, "  dec_sep_char_in = %c" ENDL, state->settings.dec_sep_char_in);
+                hs_printf(state, "  dec_sep_char_out = %c" ENDL, state->settings.dec_sep_char_out);
+                hs_printf(state, "  sep_out = %i" ENDL, state->settings.sep_out ? 1 : 0);
+                hs_printf(state, "  sep_char_in = %c" ENDL, state->settings.sep_char_in);
+                hs_printf(state, "  sep_char_out = %c" ENDL, state->settings.sep_char_out);
+                hs_printf(state, "  fold = %i" ENDL, state->settings.fold ? 1 : 0);
+                hs_printf(state, "  cse = %i" ENDL, state->settings.cse ? 1 : 0);
+                hs_printf(state, "  vm = %i" ENDL, state->settings.vm ? 1 : 0);
+                hs_printf(state, "  memo = %u" ENDL, (unsigned)state->settings.memo);
+                continue;
+            } else if (hs_str_same(hs_symbol_name(state, tokens1->items[i].symbol), "dec")) {
+                state->settings.output_mode = HS_OUTPUT_DEC;
+                if (is_number_base != NULL)
+                    *is_number_base = true;
+                continue;
+            } else if (hs_str_same(hs_symbol_name(state, tokens1->items[i].symbol), "hex")) {
+                state->settings.output_mode = HS_OUTPUT_HEX;
+                if (is_number_base != NULL)
+                    *is_number_base = true;
+                continue;
+            } else if (hs_str_same(hs_symbol_name(state, tokens1->items[i].symbol), "oct")) {
+                state->settings.output_mode = HS_OUTPUT_OCT;
+                if (is_number_base != NULL)
+                    *is_number_base = true;
+                continue;
+            } else if (hs_str_same(hs_symbol_name(state, tokens1->items[i].symbol), "bin")) {
+                state->settings.output_mode = HS_OUTPUT_BIN;
+                if (is_number_base != NULL)
+                    *is_number_base = true;
+                continue;
+            }
+        }
+        if (tokens2 != NULL)
+            if (!hs_token_list_push(state, tokens2, tokens1->items[i]))
+                return 1;
+    }
+
+    return 0;
+}
+
+bool hs_table_bound(char *text, hs_state_t *state, double *value) {
+    hs_token_list_t tokens = hs_tokenize(text, hs_str_len(text), state);
+    if (tokens.items == NULL)
+        return false;
+    hs_token_list_t rpn = hs_shunting_yard(&tokens, state);
+    if (rpn.items == NULL || rpn.size == 0)
+        return false;
+    rpn = hs_optimize(&rpn, state);
+    if (rpn.items == NULL)
+        return false;
+    *value = hs_evaluate(&rpn, state, -1).re;
+    return true;
+}
+
+// "table expression, x = start .. end [step s]", spec is everything after "table".
+// the expression is compiled once with x bound to a single frame slot and solved for every point
+void hs_table(char *spec, bool *restore_settings, hs_state_t *state) {
+    char *equals = spec;
+    while (*equals != '\0' && *equals != '=')
+        equals++;
+    char *comma = equals;
+    while (comma > spec && *comma != ',')
+        comma--;
+    char *range = equals + 1;
+    char *range_to = range;
+    while (*range_to != '\0' && !(range_to[0] == '.' && range_to[1] == '.'))
+        range_to++;
+    if (*equals == '\0' || *comma != ',' || *range_to == '\0') {
+        hs_error(state, "invalid format for table, expected \"table expression, x = start .. end [step s]\"" ENDL);
+        return;
+    }
+    *comma = '\0';
+    *equals = '\0';
+    *range_to = '\0';
+    range_to += 2;
+    char *range_step = NULL;
+    for (char *c = range_to; *c != '\0'; c++) {
+        if (c[0] == 's' && c[1] == 't' && c[2] == 'e' && c[3] == 'p') {
+            *c = '\0';
+            range_step = c + 4;
+            break;
+        }
+    }
+
+    char *name = comma + 1;
+    while (*name == ' ')
+        name++;
+    size_t name_length = 0;
+    while (name[name_length] != '\0' && name[name_length] != ' ')
+        name_length++;
+    if (name_length == 0) {
+        hs_error(state, "table needs a variable name" ENDL);
+        return;
+    }
+    hs_symbol_t var = hs_symbol_intern(state, name, name_length);
+    if (var == HS_SYMBOL_NONE)
+        return;
+
+    double from, to, step = 1;
+    if (!hs_table_bound(range, state, &from) || !hs_table_bound(range_to, state, &to)
+        || (range_step != NULL && !hs_table_bound(range_step, state, &step))) {
+        hs_error(state, "invalid range for table" ENDL);
+        return;
+    }
+    double steps = (to - from) / step;
+    if (!(steps >= 0) || isinf(steps)) {
+        hs_error(state, "step does not lead from start to end of table" ENDL);
+        return;
+    }
+    size_t count = (size_t)floor(steps + 1e-9) + 1;
+
+    hs_token_list_t tokens = hs_tokenize(spec, hs_str_len(spec), state);
+    if (tokens.items == NULL)
+        return;
+    hs_token_list_t tokens2 = hs_token_list_init(state, &tokens);
+    if (tokens2.items == NULL)
+        return;
+    if (hs_handle_commands(&tokens, &tokens2, restore_settings, state) != 0)
+        return;
+    hs_token_list_t rpn = hs_shunting_yard(&tokens2, state);
+    if (rpn.items == NULL || rpn.size == 0)
+        return;
+    for (size_t i = 0; i < rpn.size; i++) {
+        if (rpn.items[i].kind == HS_TOKEN_ID_IS_VAR && rpn.items[i].symbol == var) {
+            rpn.items[i].kind = HS_TOKEN_PARAM;
+            rpn.items[i].param_i = 0;
+        }
+    }
+    rpn = hs_optimize(&rpn, state);
+    if (rpn.items == NULL)
+        return;
+
+    hs_program_t program = {.code = NULL, .size = 0};
+    if (state->settings.vm)
+        hs_program_compile(&rpn, state, &program);
+
+    size_t frame = state->stack.size;
+    if (!hs_value_list_push(state, &state->stack, HS_ZERO))
+        return;
+    for (size_t i = 0; i < count; i++) {
+        hs_value_t x = {.re = from + (double)i * step, .im = 0};
+        state->stack.items[frame] = x;
+        state->stats.evaluations++;
+        hs_value_t y = program.code != NULL ? hs_program_run(&program, state, frame) : hs_solve(&rpn, state, frame);
+        hs_output(x, state);
+        hs_putc(state, '\t');
+        hs_output(y, state);
+        hs_printf(state, ENDL);
+        hs_sink_flush_full(state);
+    }
+    state->stack.size = frame;
+}
+
+// prints the counters of hs_stats_get, as one line of json if json is set
+void hs_stats_print(hs_state_t *state, bool json) {
+    hs_stats_t stats;
+    hs_stats_get(state, &stats);
+    const char *names[] = {
+        "lines", "line_hits", "evaluations", "tokens", "ops", "calls", "memo_hits", "memo_misses", "allocations",
+        "tokenize_ns", "commands_ns", "shunting_yard_ns", "optimize_ns", "solve_ns", "output_ns",
+    };
+    uint64_t values[] = {
+        stats.lines, stats.line_hits, stats.evaluations, stats.tokens, stats.ops, stats.calls, stats.memo_hits, stats.memo_misses, stats.allocations,
+        stats.tokenize_ns, stats.commands_ns, stats.shunting_yard_ns, stats.optimize_ns, stats.solve_ns, stats.output_ns,
+    };
+    if (json)
+        hs_putc(state, '{');
+    else
+        hs_printf(state, "--STATS-- (phase times sampled from one line in %i)" ENDL, HS_STATS_SAMPLE);
+    for (size_t i = 0; i < sizeof(values) / sizeof(uint64_t); i++) {
+        if (json)
+            hs_printf(state, "%s\"%s\":%llu", i > 0 ? "," : "", names[i], (unsigned long long)values[i]);
+        else
+            hs_printf(state, "  %s = %llu" ENDL, names[i], (unsigned long long)values[i]);
+    }
+    if (json)
+        hs_printf(state, "}" ENDL);
+}
+
+uint64_t hs_line_hash(const char *text, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ (uint8_t)text[i]) * 0x100000001b3;
+    return hash;
+}
+
+// prints the output of the same line run before, if nothing it depends on changed since then
+bool hs_line_cache_get(hs_state_t *state, const char *text, size_t length, hs_value_t *value) {
+    if (state->lines == NULL || state->out.kind == HS_SINK_NONE)
+        return false;
+    uint64_t hash = hs_line_hash(text, length);
+    hs_line_t *line = &state->lines[hash % HS_LINE_CACHE_SIZE];
+    if (line->data == NULL || line->hash != hash || line->text_length != length || line->version != state->line_version
+        || line->memo_version != state->memo_version || memcmp(line->data, text, length) != 0)
+        return false;
+    hs_sink_write(state, line->data + length, line->output_size);
+    // assuming the first context_var is "ans"
+    *value = state->context_vars[0].value = line->value;
+    return true;
+}
+
+// true if rpn may read "ans", itself or through the user functions it calls. visited has a flag per function slot
+bool hs_line_reads_ans(hs_state_t *state, hs_token_list_t *rpn, bool *visited) {
+    for (size_t i = 0; i < rpn->size; i++) {
+        hs_token_t *token = &rpn->items[i];
+        if (token->kind == HS_TOKEN_ID_IS_VAR && token->symbol == state->context_vars[0].id)
+            return true;
+        if (token->kind != HS_TOKEN_ID)
+            continue;
+        size_t func_i = hs_func_slot(state, token->symbol);
+        if (func_i == -1 || visited[func_i])
+            continue;
+        visited[func_i] = true;
+        hs_func_t *func = hs_func_at(state, func_i);
+        if (func->func == NULL && !func->pure && hs_line_reads_ans(state, &func->body, visited))
+            return true;
+    }
+    return false;
+}
+
+// remembers the value of a plain expression line and the output it made since output_start.
+// lines reading "ans" are left out, their value changes from one line to the next
+void hs_line_cache_put(hs_state_t *state, const char *text, size_t length, hs_token_list_t *rpn, size_t output_start, hs_value_t value) {
+    if (state->out.kind == HS_SINK_NONE || state->out.size < output_start)
+        return;
+    size_t output_size = state->out.size - output_start;
+    if (length > HS_LINE_CACHE_MAX || output_size > HS_LINE_CACHE_MAX)
+        return;
+    size_t funcs_count = hs_funcs_count(state);
+    bool *visited = hs_arena_alloc(state, funcs_count > 0 ? funcs_count : 1);
+    if (visited == NULL)
+        return;
+    memset(visited, 0, funcs_count);
+    if (hs_line_reads_ans(state, rpn, visited))
+        return;
+    if (state->lines == NULL) {
+        state->lines = hs_alloc(state, NULL, HS_LINE_CACHE_SIZE * sizeof(hs_line_t));
+        if (state->lines == NULL)
+            return;
+        for (size_t i = 0; i < HS_LINE_CACHE_SIZE; i++)
+            state->lines[i] = (hs_line_t){.data = NULL};
+    }
+    uint64_t hash = hs_line_hash(text, length);
+    hs_line_t *line = &state->lines[hash % HS_LINE_CACHE_SIZE];
+    char *data = line->data;
+    size_t capacity = line->capacity;
+    if (data == NULL || length + output_size > capacity) {
+        capacity = length + output_size > 0 ? length + output_size : 1;
+        data = hs_alloc(state, line->data, capacity);
+        if (data == NULL)
+            return;
+    }
+    memcpy(data, text, length);
+    memcpy(data + length, state->out.data + output_start, output_size);
+    *line = (hs_line_t){
+        .data = data,
+        .capacity = capacity,
+        .text_length = length,
+        .output_size = output_size,
+        .value = value,
+        .hash = hash,
+        .version = state->line_version,
+        .memo_version = state->memo_version,
+    };
+}
+
+// argument of the command word at the start of text, NULL if text is no such command. the word has to stand alone and be
+// followed by whitespace and an argument (or nothing if bare is set) that does not start with an operator, so a line
+// like "save = 5" stays an assignment. a path may start with '/'
+char *hs_command_argument(char *text, const char *word, bool bare, bool path) {
+    size_t length = hs_str_len((char *)word);
+    if (strncmp(text, word, length) != 0)
+        return NULL;
+    char *argument = text + length;
+    if (*argument != ' ' && *argument != '\r' && *argument != '\0')
+        return NULL;
+    while (*argument == ' ' || *argument == '\r')
+        argument++;
+    if (*argument == '\0')
+        return bare ? argument : NULL;
+    bool is_path = path && argument[0] == '/' && argument[1] != ' ' && argument[1] != '\0';
+    if (strchr("=+-*/%^&|~<>),", *argument) != NULL && !is_path)
+        return NULL;
+    return argument;
+}
+
+// runs one line (expression, assignment, definition or command) and prints its value if print_value is set,
+// returns true if the line has a value, it is stored in value
+bool hs_execute(hs_state_t *state, const char *line, bool print_value, hs_value_t *value) {
+    if (state == NULL) {
+        return false;
+    }
+    hs_state_sync(state);
+    hs_stats_line(state);
+
+    bool has_value = false;
+    hs_token_list_t tokens1 = {.items = NULL, .size = 0, .capacity = 0};
+    hs_token_list_t tokens2 = {.items = NULL, .size = 0, .capacity = 0};
+    hs_token_list_t tokens3 = {.items = NULL, .size = 0, .capacity = 0};
+#if HS_PRINT_ALLOCATIONS
+    size_t allocations_before = state->allocations;
+#endif
+
+    bool restore_settings = false;
+    hs_settings_t temp_settings = state->settings;
+    // expression without assignment or command, it changes nothing but "ans"
+    bool plain = false;
+    // names an expression only reads are not kept, the line defines nothing they could be bound to
+    size_t symbols_length = state->symbols.length;
+    bool transient = false;
+
+    // the line is lowered in place, work on a copy
+    size_t line_length = strlen(line);
+    char *input = hs_arena_alloc(state, line_length + 1);
+    if (input == NULL) {
+        hs_error(state, "out of memory while reading input :(" ENDL);
+        goto hs_run_done;
+    }
+    memcpy(input, line, line_length + 1);
+    hs_preprocess_input(input);
+    // only hs_run prints, its callers often send the same line again
+    size_t output_start = state->out.size;
+    size_t errors = state->errors;
+    if (print_value && hs_line_cache_get(state, input, line_length, value)) {
+        state->stats.line_hits++;
+        plain = true;
+        has_value = true;
+        goto hs_run_done;
+    }
+
+    char *command = input;
+    while (*command == ' ')
+        command++;
+    char *argument = hs_command_argument(command, "table", false, false);
+    if (argument != NULL) {
+        transient = true;
+        hs_table(argument, &restore_settings, state);
+        if (restore_settings)
+            state->settings = temp_settings;
+        goto hs_run_done;
+    }
+    char *path = hs_command_argument(command, "save", false, true);
+    bool is_save = path != NULL;
+    if (!is_save)
+        path = hs_command_argument(command, "load", false, true);
+    if (path != NULL) {
+        // the file name keeps its case
+        memcpy(input, line, line_length + 1);
+        size_t path_length = hs_str_len(path);
+        while (path_length > 0 && (path[path_length - 1] == ' ' || path[path_length - 1] == '\r'))
+            path[--path_length] = '\0';
+        if (state->files_refused) {
+            hs_error(state, "%s is not allowed here" ENDL, is_save ? "save" : "load");
+        } else if (is_save) {
+            hs_snapshot_save(state, path);
+        } else {
+            hs_snapshot_load(state, path);
+        }
+        goto hs_run_done;
+    }
+    char *option = hs_command_argument(command, "stats", true, false);
+    if (option != NULL) {
+        size_t option_length = hs_str_len(option);
+        while (option_length > 0 && (option[option_length - 1] == ' ' || option[option_length - 1] == '\r'))
+            option[--option_length] = '\0';
+        if (option_length == 0) {
+            hs_stats_print(state, false);
+        } else if (hs_str_same(option, "json")) {
+            hs_stats_print(state, true);
+        } else if (hs_str_same(option, "reset")) {
+            hs_stats_reset(state);
+        } else {
+            hs_error(state, "unknown option %s, expected \"stats\", \"stats reset\" or \"stats json\"" ENDL, option);
+        }
+        goto hs_run_done;
+    }
+
+    size_t lvalue_i = 0;
+    while (input[lvalue_i] != '\0' && input[lvalue_i] != '=')
+        lvalue_i++;
+    if (input[lvalue_i] == '\0')
+        lvalue_i = 0;
+    hs_var_t lvalue_var = {
+        .id = HS_SYMBOL_NONE,
+        .value = HS_ZERO,
+    };
+    hs_func_t lvalue_func = {
+        .id = HS_SYMBOL_NONE,
+        .func = NULL,
+        .params_count = 0,
+        .params_linked = NULL,
+        .expression = "",
+    };
+    if (lvalue_i > 0) {
+        hs_token_list_t tokens_lvalue = hs_tokenize(input, lvalue_i, state);
+        if (tokens_lvalue.items == NULL)
+            goto hs_run_error;
+        hs_stats_lap(state, HS_PHASE_TOKENIZE);
+        hs_token_list_t tokens_lvalue2 = hs_token_list_init(state, &tokens_lvalue);
+        if (tokens_lvalue2.items == NULL)
+            goto hs_run_error;
+        if (hs_handle_commands(&tokens_lvalue, &tokens_lvalue2, &restore_settings, state) != 0)
+            goto hs_run_error;
+        hs_stats_lap(state, HS_PHASE_COMMANDS);
+        if (tokens_lvalue2.size == 2) {
+            if (tokens_lvalue2.items[0].kind == HS_TOKEN_ID) {
+                lvalue_var.id = tokens_lvalue2.items[0].symbol;
+            } else {
+                hs_printf(state, "WARNING: did not understand input left of \"=\", will be ignored" ENDL);
+            }
+        } else if (tokens_lvalue2.size > 2) {
+            if (tokens_lvalue2.items[0].kind == HS_TOKEN_ID &&
+                tokens_lvalue2.items[1].kind == HS_TOKEN_OPEN_P) {
+                lvalue_func.params_count = 0;
+                hs_func_param_t *param = NULL;
+                for (size_t t_i = 2; t_i < tokens_lvalue2.size; t_i += 2) {
+                    bool is_last = false;
+                    if (tokens_lvalue2.items[t_i].kind == HS_TOKEN_CLOSE_P) {
+                        break;
+                    }
+                    if (tokens_lvalue2.items[t_i].kind != HS_TOKEN_ID) {
+                        hs_error(state, "invalid format for function definition" ENDL);
+                        goto hs_run_error;
+                    }
+                    if (tokens_lvalue2.items[t_i + 1].kind == HS_TOKEN_CLOSE_P) {
+                        is_last = true;
+                    } else if (tokens_lvalue2.items[t_i + 1].kind != HS_TOKEN_COMMA) {
+                        hs_error(state, "invalid format for function definition" ENDL);
+                        goto hs_run_error;
+                    }
+                    hs_func_param_t *next_param = hs_alloc(state, NULL, sizeof(hs_func_param_t));
+                    if (param != NULL) {
+                        param->next = next_param;
+                    } else {
+                        lvalue_func.params_linked = next_param;
+                    }
+                    param = next_param;
+                    param->id = tokens_lvalue2.items[t_i].symbol;
+                    param->next = NULL;
+                    lvalue_func.params_count++;
+                    if (is_last)
+                        break;
+                }
+                lvalue_func.id = tokens_lvalue2.items[0].symbol;
+                lvalue_func.expression = hs_alloc(state, NULL, hs_str_len(input + lvalue_i));
+                for (size_t i = 0; i < hs_str_len(input + lvalue_i); i++) {
+                    lvalue_func.expression[i] = input[lvalue_i + 1 + i];
+                }
+                hs_funcs_push(state, lvalue_func);
+            } else {
+                hs_printf(state, "WARNING: did not understand input left of \"=\", will be ignored" ENDL);
+            }
+        }
+        if (lvalue_func.id != HS_SYMBOL_NONE) {
+            goto hs_run_done;
+        }
+    }
+
+    transient = lvalue_var.id == HS_SYMBOL_NONE;
+    tokens1 = hs_tokenize(input + lvalue_i, hs_str_len(input + lvalue_i), state);
+    if (tokens1.items == NULL)
+        goto hs_run_error;
+    hs_stats_lap(state, HS_PHASE_TOKENIZE);
+
+    tokens2 = hs_token_list_init(state, &tokens1);
+    if (tokens2.items == NULL)
+        goto hs_run_error;
+    if (hs_handle_commands(&tokens1, &tokens2, &restore_settings, state) != 0)
+        goto hs_run_error;
+    hs_stats_lap(state, HS_PHASE_COMMANDS);
+    if (tokens2.items[0].kind == HS_TOKEN_EOF) {
+        restore_settings = false;
+    }
+    plain = lvalue_i == 0 && tokens2.size == tokens1.size;
+
+    tokens3 = hs_shunting_yard(&tokens2, state);
+    if (tokens3.items == NULL)
+        goto hs_run_error;
+    hs_stats_lap(state, HS_PHASE_SHUNTING_YARD);
+    tokens3 = hs_optimize(&tokens3, state);
+    if (tokens3.items == NULL)
+        goto hs_run_error;
+    hs_stats_lap(state, HS_PHASE_OPTIMIZE);
+
+    if (tokens3.size > 0) {
+        // assuming the first context_var is "ans"
+        hs_value_t result = state->context_vars[0].value = hs_evaluate(&tokens3, state, -1);
+        if (lvalue_var.id != HS_SYMBOL_NONE) {
+            char *lvalue_name = hs_symbol_name(state, lvalue_var.id);
+            if (hs_str_same(lvalue_name, "scient_min")) {
+                state->settings.scient_min = result.re;
+            } else if (hs_str_same(lvalue_name, "scient_max")) {
+                state->settings.scient_max = result.re;
+            } else if (hs_str_same(lvalue_name, "sep_out")) {
+                state->settings.sep_out = fabs(result.re) >= HS_EPSILON;
+            } else if (hs_str_same(lvalue_name, "fold")) {
+                state->settings.fold = fabs(result.re) >= HS_EPSILON;
+                hs_funcs_recompile(state);
+            } else if (hs_str_same(lvalue_name, "cse")) {
+                state->settings.cse = fabs(result.re) >= HS_EPSILON;
+                hs_funcs_recompile(state);
+            } else if (hs_str_same(lvalue_name, "vm")) {
+                state->settings.vm = fabs(result.re) >= HS_EPSILON;
+            } else if (hs_str_same(lvalue_name, "memo")) {
+                state->settings.memo = result.re >= 1 ? (uint32_t)fmin(result.re, HS_MEMO_MAX_SIZE) : 0;
+                state->memo_version++;
+            } else {
+                lvalue_var.value = result;
+                hs_vars_push(state, lvalue_var);
+            }
+        }
+        hs_stats_lap(state, HS_PHASE_SOLVE);
+        if (print_value) {
+            hs_output(result, state);
+            hs_printf(state, ENDL);
+            hs_stats_lap(state, HS_PHASE_OUTPUT);
+            if (plain && state->errors == errors)
+                hs_line_cache_put(state, input, line_length, &tokens3, output_start, result);
+        }
+        *value = result;
+        has_value = true;
+    }
+    if (restore_settings)
+        state->settings = temp_settings;
+    goto hs_run_done;
+
+hs_run_error:
+    if (restore_settings)
+        state->settings = temp_settings;
+
+hs_run_done:
+    if (transient)
+        hs_symbols_forget(state, symbols_length);
+    // whatever else the line did may have changed a setting or a definition
+    if (!plain)
+        state->line_version++;
+    hs_arena_reset(state);
+#if HS_PRINT_ALLOCATIONS
+    hs_printf(state, "allocations: " SIZE_T_F ENDL, state->allocations - allocations_before);
+#endif
+    return has_value;
+}
+
+void hs_run(hs_state_t *state, const char *line) {
+    hs_value_t value;
+    hs_execute(state, line, true, &value);
+    hs_sink_flush_full(state);
+}
+
+// diagnostics of the calls below go to state->messages instead of the output
+void hs_capture_begin(hs_state_t *state, hs_sink_t *out, size_t *errors) {
+    *out = state->out;
+    *errors = state->errors;
+    state->out = state->messages;
+    state->out.kind = HS_SINK_BUFFER;
+    state->out.size = 0;
+}
+
+// returns false if an error was reported since hs_capture_begin, error (if not NULL) receives the diagnostics or NULL
+bool hs_capture_end(hs_state_t *state, hs_sink_t *out, size_t errors, const char **error) {
+    state->messages = state->out;
+    state->out = *out;
+    if (error != NULL) {
+        *error = NULL;
+        if (state->messages.size > 0) {
+            state->messages.data[state->messages.size] = '\0';
+            *error = state->messages.data;
+        }
+    }
+    return state->errors == errors;
+}
+
+hs_state_t *hs_state_create(void) {
+    hs_state_t *state = malloc(sizeof(hs_state_t));
+    if (state == NULL)
+        return NULL;
+    *state = hs_default_state();
+    if (state->context_vars == NULL || state->context_funcs == NULL) {
+        hs_state_free(state);
+        free(state);
+        return NULL;
+    }
+    return state;
+}
+
+hs_state_t *hs_state_clone(hs_state_t *state) {
+    hs_state_t *clone = malloc(sizeof(hs_state_t));
+    if (clone == NULL)
+        return NULL;
+    *clone = hs_state_copy(state);
+    if (clone->context_vars == NULL || clone->context_funcs == NULL) {
+        hs_state_free(clone);
+        free(clone);
+        return NULL;
+    }
+    return clone;
+}
+
+void hs_state_destroy(hs_state_t *state) {
+    if (state == NULL)
+        return;
+    hs_state_free(state);
+    free(state);
+}
+
+hs_shared_t *hs_shared_create(hs_state_t *state) {
+    hs_shared_t *shared = hs_alloc(state, NULL, sizeof(hs_shared_t));
+    hs_base_t *base = hs_base_create(state);
+    if (shared == NULL || base == NULL) {
+        if (shared != NULL)
+            free(shared);
+        if (base != NULL)
+            hs_base_free(base);
+        return NULL;
+    }
+    atomic_init(&shared->current, base);
+    atomic_init(&shared->epoch, 0);
+#if HS_THREADS
+    pthread_mutex_init(&shared->lock, NULL);
+#endif
+    shared->readers = NULL;
+    shared->retired = NULL;
+    return shared;
+}
+
+bool hs_shared_publish(hs_shared_t *shared, hs_state_t *state) {
+    hs_base_t *base = hs_base_create(state);
+    if (base == NULL)
+        return false;
+    hs_base_t *old = atomic_exchange(&shared->current, base);
+    // readers that loaded old announced this epoch or an earlier one
+    uint64_t epoch = atomic_fetch_add(&shared->epoch, 1);
+    hs_shared_lock(shared);
+    old->retired_epoch = epoch;
+    old->retired_next = shared->retired;
+    shared->retired = old;
+    hs_shared_unlock(shared);
+    hs_shared_reclaim(shared, true);
+    return true;
+}
+
+void hs_shared_destroy(hs_shared_t *shared) {
+    if (shared == NULL)
+        return;
+    hs_base_free(atomic_load(&shared->current));
+    while (shared->retired != NULL) {
+        hs_base_t *base = shared->retired;
+        shared->retired = base->retired_next;
+        hs_base_free(base);
+    }
+#if HS_THREADS
+    pthread_mutex_destroy(&shared->lock);
+#endif
+    free(shared);
+}
+
+hs_state_t *hs_state_create_shared(hs_shared_t *shared) {
+    hs_state_t *state = malloc(sizeof(hs_state_t));
+    hs_reader_t *reader = malloc(sizeof(hs_reader_t));
+    if (state == NULL || reader == NULL) {
+        free(state);
+        free(reader);
+        return NULL;
+    }
+    *state = (hs_state_t){.out = {.kind = HS_SINK_NONE}, .shared = shared, .reader = reader};
+    // epoch 0 holds back every reclamation until the real one is announced
+    atomic_init(&reader->epoch, 0);
+    hs_shared_lock(shared);
+    reader->next = shared->readers;
+    shared->readers = reader;
+    hs_shared_unlock(shared);
+
+    uint64_t epoch = atomic_load(&shared->epoch);
+    hs_base_t *base = atomic_load(&shared->current);
+    if (!hs_state_layer(state, base)) {
+        hs_state_destroy(state);
+        return NULL;
+    }
+    state->settings = base->settings;
+    state->stack = hs_rpn_list_init(state);
+    atomic_store(&reader->epoch, epoch);
+    return state;
+}
+
+void hs_set_output_file(hs_state_t *state, FILE *file) {
+    hs_sink_flush(state);
+    state->out.kind = file != NULL ? HS_SINK_FILE : HS_SINK_NONE;
+    state->out.file = file;
+}
+
+void hs_set_output_callback(hs_state_t *state, void (*callback)(const char *data, size_t size, void *context), void *context) {
+    hs_sink_flush(state);
+    state->out.kind = callback != NULL ? HS_SINK_CALLBACK : HS_SINK_NONE;
+    state->out.callback = callback;
+    state->out.context = context;
+}
+
+void hs_flush(hs_state_t *state) {
+    hs_sink_flush(state);
+}
+
+void hs_set_files(hs_state_t *state, bool allowed) {
+    state->files_refused = !allowed;
+}
+
+bool hs_eval(hs_state_t *state, const char *text, hs_value_t *result, const char **error) {
+    hs_sink_t out;
+    size_t errors;
+    hs_capture_begin(state, &out, &errors);
+    hs_value_t value = HS_ZERO;
+    if (!hs_execute(state, text, false, &value))
+        value = HS_ZERO;
+    if (result != NULL)
+        *result = value;
+    return hs_capture_end(state, &out, errors, error);
+}
+
+// counters since the state was created or hs_stats_reset, with the sampled phase times scaled up to all lines
+void hs_stats_get(hs_state_t *state, hs_stats_t *stats) {
+    *stats = state->stats;
+    stats->allocations = state->allocations - state->stats_allocations;
+    // the sampled lines stand for all of them
+    uint64_t phases[HS_PHASES];
+    for (size_t i = 0; i < HS_PHASES; i++)
+        phases[i] = state->stats_sampled > 0 ? (uint64_t)((double)state->stats_phases[i] * stats->lines / state->stats_sampled) : 0;
+    stats->tokenize_ns = phases[HS_PHASE_TOKENIZE];
+    stats->commands_ns = phases[HS_PHASE_COMMANDS];
+    stats->shunting_yard_ns = phases[HS_PHASE_SHUNTING_YARD];
+    stats->optimize_ns = phases[HS_PHASE_OPTIMIZE];
+    stats->solve_ns = phases[HS_PHASE_SOLVE];
+    stats->output_ns = phases[HS_PHASE_OUTPUT];
+}
+
+void hs_stats_reset(hs_state_t *state) {
+    state->stats = (hs_stats_t){.lines = 0};
+    state->stats_allocations = state->allocations;
+    for (size_t i = 0; i < HS_PHASES; i++)
+        state->stats_phases[i] = 0;
+    state->stats_sampled = 0;
+    state->stats_clock = 0;
+}
+
+// true if name is a valid identifier (lower case, digits and '_', not starting with a digit)
+bool hs_is_name(const char *name) {
+    if (name == NULL || !((name[0] >= 'a' && name[0] <= 'z') || name[0] == '_'))
+        return false;
+    for (size_t i = 1; name[i] != '\0'; i++) {
+        if (!((name[i] >= 'a' && name[i] <= 'z') || (name[i] >= '0' && name[i] <= '9') || name[i] == '_'))
+            return false;
+    }
+    return true;
+}
+
+bool hs_var_get(hs_state_t *state, const char *name, hs_value_t *value) {
+    if (!hs_is_name(name))
+        return false;
+    hs_symbol_t symbol = hs_symbol_find(state, (char *)name, strlen(name));
+    if (symbol == HS_SYMBOL_NONE || hs_var_slot(state, symbol) == -1)
+        return false;
+    *value = hs_var_at(state, hs_var_slot(state, symbol))->value;
+    return true;
+}
+
+bool hs_var_set(hs_state_t *state, const char *name, hs_value_t value) {
+    if (!hs_is_name(name))
+        return false;
+    hs_var_t var = {.id = hs_symbol_intern(state, (char *)name, strlen(name)), .value = value};
+    return hs_vars_push(state, var);
+}
+
+bool hs_func_define(hs_state_t *state, const char *name, const char **params, size_t params_count, const char *expression) {
+    if (!hs_is_name(name) || params_count > UINT8_MAX)
+        return false;
+    for (size_t i = 0; i < params_count; i++) {
+        if (!hs_is_name(params[i]))
+            return false;
+    }
+    hs_func_t func = {
+        .id = hs_symbol_intern(state, (char *)name, strlen(name)),
+        .func = NULL,
+        .params_count = (uint8_t)params_count,
+        .params_linked = NULL,
+        .expression = hs_alloc(state, NULL, strlen(expression) + 1),
+    };
+    if (func.id == HS_SYMBOL_NONE || func.expression == NULL)
+        goto hs_func_define_error;
+    memcpy(func.expression, expression, strlen(expression) + 1);
+    hs_preprocess_input(func.expression);
+    hs_func_param_t **param_next = &func.params_linked;
+    for (size_t i = 0; i < params_count; i++) {
+        *param_next = hs_alloc(state, NULL, sizeof(hs_func_param_t));
+        if (*param_next == NULL)
+            goto hs_func_define_error;
+        (*param_next)->id = hs_symbol_intern(state, (char *)params[i], strlen(params[i]));
+        (*param_next)->next = NULL;
+        if ((*param_next)->id == HS_SYMBOL_NONE)
+            goto hs_func_define_error;
+        param_next = &(*param_next)->next;
+    }
+    return hs_funcs_push(state, func);
+
+hs_func_define_error:
+    if (func.expression != NULL)
+        free(func.expression);
+    if (func.params_linked != NULL)
+        hs_param_free_recursive(func.params_linked);
+    return false;
+}
+
+typedef struct hs_expr {
+    hs_token_list_t body;
+    hs_program_t program;
+    // keeps the state on the base the expression was compiled against
+    hs_state_t *state;
+} hs_expr_t;
+
+hs_expr_t *hs_compile(hs_state_t *state, const char *text, const char **error) {
+    hs_sink_t out;
+    size_t errors;
+    hs_capture_begin(state, &out, &errors);
+    hs_expr_t *expr = NULL;
+    hs_state_sync(state);
+
+    size_t length = strlen(text);
+    char *input = hs_arena_alloc(state, length + 1);
+    if (input == NULL) {
+        hs_error(state, "out of memory while reading input :(" ENDL);
+        goto hs_compile_done;
+    }
+    memcpy(input, text, length + 1);
+    hs_preprocess_input(input);
+    hs_token_list_t tokens = hs_tokenize(input, length, state);
+    if (tokens.items == NULL)
+        goto hs_compile_done;
+    hs_token_list_t tokens2 = hs_token_list_init(state, &tokens);
+    if (tokens2.items == NULL)
+        goto hs_compile_done;
+    // commands in the expression (i.e. "hex") stay in effect
+    bool restore_settings;
+    if (hs_handle_commands(&tokens, &tokens2, &restore_settings, state) != 0)
+        goto hs_compile_done;
+    if (tokens2.size != tokens.size)
+        state->line_version++;
+    hs_token_list_t rpn = hs_shunting_yard(&tokens2, state);
+    if (rpn.items != NULL)
+        rpn = hs_optimize(&rpn, state);
+    if (rpn.items == NULL || rpn.size == 0) {
+        hs_error(state, "invalid expression" ENDL);
+        goto hs_compile_done;
+    }
+    expr = hs_alloc(state, NULL, sizeof(hs_expr_t));
+    if (expr == NULL || !hs_body_store(state, &rpn, &expr->body, &expr->program)) {
+        hs_error(state, "out of memory while compiling expression :(" ENDL);
+        if (expr != NULL)
+            free(expr);
+        expr = NULL;
+    } else {
+        expr->state = state;
+        state->exprs++;
+    }
+
+hs_compile_done:
+    hs_arena_reset(state);
+    if (!hs_capture_end(state, &out, errors, error) && expr != NULL) {
+        hs_expr_free(expr);
+        expr = NULL;
+    }
+    return expr;
+}
+
+bool hs_expr_eval(hs_state_t *state, hs_expr_t *expr, hs_value_t *result, const char **error) {
+    hs_sink_t out;
+    size_t errors;
+    hs_capture_begin(state, &out, &errors);
+    state->stats.evaluations++;
+    if (state->settings.vm && expr->program.code != NULL) {
+        *result = hs_program_run(&expr->program, state, -1);
+    } else {
+        *result = hs_solve(&expr->body, state, -1);
+    }
+    return hs_capture_end(state, &out, errors, error);
+}
+
+void hs_expr_free(hs_expr_t *expr) {
+    if (expr == NULL)
+        return;
+    expr->state->exprs--;
+    hs_body_free(&expr->body, &expr->program);
+    free(expr);
+}
+
+size_t hs_format(hs_state_t *state, hs_value_t value, char *buffer, size_t size) {
+    hs_sink_t out;
+    size_t errors;
+    hs_capture_begin(state, &out, &errors);
+    hs_output(value, state);
+    hs_sink_t *formatted = &state->out;
+    size_t length = 0;
+    for (; length < formatted->size && length + 1 < size; length++)
+        buffer[length] = formatted->data[length];
+    if (size > 0)
+        buffer[length] = '\0';
+    hs_capture_end(state, &out, errors, NULL);
+    return length;
+}
+
+// parses a plain decimal number like "-1'234.5e3" from text[0..length), honoring the input separator settings
+bool hs_parse_number(hs_state_t *state, const char *text, size_t length, double *value) {
+    while (length > 0 && (text[0] == ' ' || text[0] == '"')) {
+        text++;
+        length--;
+    }
+    while (length > 0 && (text[length - 1] == ' ' || text[length - 1] == '"'))
+        length--;
+
+    size_t i = 0;
+    bool negative = false;
+    if (i < length && (text[i] == '-' || text[i] == '+'))
+        negative = text[i++] == '-';
+    size_t start = i;
+    bool digits = false;
+    bool point = false;
+    for (; i < length && text[i] != 'e' && text[i] != 'E'; i++) {
+        char c = text[i];
+        if (c >= '0' && c <= '9') {
+            digits = true;
+        } else if (c == state->settings.dec_sep_char_in && !point) {
+            point = true;
+        } else if (c != state->settings.sep_char_in) {
+            return false;
+        }
+    }
+    if (!digits)
+        return false;
+    size_t end = i;
+
+    // the exponent only moves the decimal point, hs_parse_decimal rounds once with it
+    int32_t exponent = 0;
+    if (i < length) {
+        i++;
+        bool exponent_negative = false;
+        if (i < length && (text[i] == '-' || text[i] == '+'))
+            exponent_negative = text[i++] == '-';
+        if (i == length)
+            return false;
+        for (; i < length; i++) {
+            if (text[i] < '0' || text[i] > '9')
+                return false;
+            // far beyond the range of a double either way
+            if (exponent < 100000)
+                exponent = exponent * 10 + (text[i] - '0');
+        }
+        if (exponent_negative)
+            exponent = -exponent;
+    }
+    *value = hs_parse_decimal(text + start, end - start, exponent, &state->settings);
+    if (negative)
+        *value = -*value;
+    return true;
+}
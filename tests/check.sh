@@ -0,0 +1,52 @@
+#!/bin/sh
+# make check: runs the corpora in tests/ against ./hsolver, exits 1 if any of them fails
+cd "$(dirname "$0")/.." || exit 1
+out=$(mktemp -d) || exit 1
+trap 'rm -rf "$out"' EXIT
+failed=0
+
+# the bytecode engine and the reference rpn evaluator have to print the same for every line
+(echo "vm = 1"; cat tests/engines.txt) | ./hsolver | tail -n +2 > "$out/engines.vm"
+(echo "vm = 0"; cat tests/engines.txt) | ./hsolver | tail -n +2 > "$out/engines.ref"
+if diff "$out/engines.ref" "$out/engines.vm"; then
+    echo "engines ok"
+else
+    echo "engines FAILED (< reference, > bytecode)"
+    failed=1
+fi
+
+# folding and sharing subtrees must not change what is printed either, warnings included
+grep -v '^\(fold\|cse\) =' tests/engines.txt > "$out/plain.txt"
+(echo "fold = 0"; echo "cse = 0"; cat "$out/plain.txt") | ./hsolver | tail -n +3 > "$out/plain.ref"
+./hsolver < "$out/plain.txt" > "$out/plain.opt"
+if diff "$out/plain.ref" "$out/plain.opt"; then
+    echo "optimizer ok"
+else
+    echo "optimizer FAILED (< unoptimized, > optimized)"
+    failed=1
+fi
+
+# formatters, literals, memo and line cache invalidation and a snapshot round trip against the expected output.
+# @DIR@ stands for a scratch directory, it also gets two damaged snapshots: one with a memo setting far too large and
+# one with an unknown output mode (the offsets of both settings in the header of a 64 bit build)
+printf 'memo = 777\nsave %s\n' "$out/memo.img" | ./hsolver > /dev/null
+printf '\377\377\377\377' | dd of="$out/memo.img" bs=1 seek=72 conv=notrunc 2> /dev/null
+printf 'save %s\n' "$out/mode.img" | ./hsolver > /dev/null
+printf '\007' | dd of="$out/mode.img" bs=1 seek=40 conv=notrunc 2> /dev/null
+sed "s|@DIR@|$out|g" tests/golden.txt | ./hsolver | sed "s|$out|@DIR@|g" > "$out/golden.out"
+if diff tests/golden.out "$out/golden.out"; then
+    echo "golden ok"
+else
+    echo "golden FAILED (< expected, > actual)"
+    failed=1
+fi
+
+# once every line of tests/allocations.txt ran, running them again must not allocate anything
+if ./hsolver < tests/allocations.txt | tail -n 1 | grep -q '"allocations":0,'; then
+    echo "allocations ok"
+else
+    echo "allocations FAILED: $(./hsolver < tests/allocations.txt | tail -n 1)"
+    failed=1
+fi
+
+exit $failed